@@ -0,0 +1,784 @@
+//Host benchmark for the SPWM lookup table generator (spwm_lut.cpp). Not for the RP2350 target.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+
+#include "spwm_lut.h"
+#include "spwm_lut_gen.h"
+
+//Number of table computations timed for each configuration
+#define BENCH_REPEAT 20
+
+//Golden set used when no file is given on the command line (BENCH_GOLDEN_DIR is set by bench/CMakeLists.txt)
+#ifndef BENCH_GOLDEN_DIR
+    #define BENCH_GOLDEN_DIR ""
+#endif
+#if (SPWM_SAMPLING != SPWM_SAMPLING_NATURAL) || SPWM_EDGE_DITHER || (SPWM_STRATEGY != SPWM_STRATEGY_UNIPOLAR)
+    #define BENCH_GOLDEN_FILE ""    //The golden sets are for unipolar natural sampling without dithering. Only timing, unless one is given by -g.
+#elif SPWM_SINE_FIXED_POINT
+    #define BENCH_GOLDEN_FILE BENCH_GOLDEN_DIR "golden_fixed.txt"
+#else
+    #define BENCH_GOLDEN_FILE BENCH_GOLDEN_DIR "golden_double.txt"
+#endif
+
+//Counters updated by the generator (see SPWM_LUT_STATS in spwm_lut_gen.h)
+spwm_lut_stats_t spwm_lut_stats;
+
+//Grid of configurations
+static const uint8_t bench_freq[] = {50, 60};
+static const uint16_t bench_mf[] = {8, 12, 64, 100, 128, 200, 256, 512, 1000, 1024};
+static const double bench_ma[] = {0.05, 0.1, 0.3, 0.5, 0.8, 0.9, 0.95, 0.99};
+
+//Corrections as used by main.cpp, with a min pulse to exercise the short pulse stage
+static const spwm_corrections_t bench_corr = {50, 3, 20, SPWM_PULSE_STRETCH};
+
+static uint32_t h1_table[2 * 1024];
+static uint32_t h2_table[2 * 1024];
+
+//Grid of the verification (-v). Every mf of the LUT format is a multiple of 4 (4 is the least)
+static const uint8_t verify_freq[] = {45, 50, 55, 60, 65};
+static const uint16_t verify_mf[] = {4, 8, 12, 16, 20, 24, 28, 32, 40, 48, 60, 64, 100, 120, 128, 200, 240, 256, 
+                                     480, 500, 512, 960, 1000, 1024};
+static const double verify_ma[] = {0.0, 0.01, 0.05, 0.1, 0.25, 0.5, 0.75, 0.8, 0.9, 0.95, 0.99};
+
+//Max distance of a table edge from its exact reference (T_STEP). A natural sampled edge is at the first T_STEP at (or
+//after) the crossing, and its mirror image at (or before) it. A regular sampled edge is rounded to nearest, and a
+//dithered edge to nearest after adding the rounding error of the previous one (upto 0.5 T_STEP).
+#define VERIFY_EDGE_ERROR_MAX 1.0
+
+//Resolution of the reference edges (T_STEP). 40 bisections of a ramp of upto 2 x 138889 T_STEP (45Hz, mf = 4). An
+//edge 1 T_STEP from a reference at a whole T_STEP is not a failure.
+#define VERIFY_REFERENCE_RESOLUTION 1.0e-6
+
+//PIO clock of the tables (s) & carrier amplitude (counts). (T_STEP & scaling_factor of spwm_lut_gen.h are not
+//visible outside it)
+#define VERIFY_T_STEP 1.0e-8
+#define VERIFY_CARRIER_SCALE 1000000
+
+//Corrected tables of the verification
+static uint32_t h1_corr_table[2 * 1024];
+static uint32_t h2_corr_table[2 * 1024];
+
+//Tables of the other paths (phases, packed & quarter wave layout), checked against the full tables
+#define VERIFY_PHASES_MAX 3
+static const uint8_t verify_phases[] = {2, 3};
+static uint32_t phase_table[VERIFY_PHASES_MAX][2 * 1024];
+static uint32_t packed_table[VERIFY_PHASES_MAX][1024];
+static uint32_t packed_scratch[4 * 1024];
+static uint32_t quarter_table[SPWM_QUARTER_WORDS(1024)];
+static uint32_t ref_edges[2 * 1024];
+static uint32_t path_edges[2 * 1024];
+
+/// Worst results of the verification
+typedef struct {
+    uint32_t tables;
+    uint32_t failures;
+    double edge_error_max;      //Largest distance of an edge from the reference (T_STEP)
+    double edge_error_sum;      //Sum of the distances (for the mean)
+    uint32_t edges;
+} verify_stats_t;
+
+/// Result of one configuration
+typedef struct {
+    uint8_t signal_freq;
+    uint16_t mf;
+    uint32_t ma_x10000;     //ma * 10000 (as stored in golden file)
+    uint8_t corrected;      //1 if corrections were applied
+    uint32_t signal_duration;
+    uint32_t h1_sync;
+    uint32_t h2_sync;
+    uint64_t hash;          //FNV-1a hash of both tables
+} bench_result_t;
+
+/**
+ * @brief FNV-1a hash of both tables, to keep the golden file small.
+ */
+static uint64_t hash_tables(uint16_t mf){
+    uint64_t hash = 14695981039346656037ull;
+    for(uint32_t i = 0; i < (2u * mf); i++){
+        hash = (hash ^ h1_table[i]) * 1099511628211ull;
+        hash = (hash ^ h2_table[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * @brief Reads the golden file.
+ *
+ * @returns Number of results read. 0 if the file can not be opened.
+ */
+static uint32_t read_golden(const char* p_path, bench_result_t* p_golden, uint32_t max_count){
+    FILE* p_file = fopen(p_path, "r");
+    if(p_file == NULL){
+        return 0;
+    }
+    uint32_t count = 0;
+    unsigned int freq = 0, mf = 0, corrected = 0;
+    unsigned long long hash = 0;
+    bench_result_t* p = p_golden;
+    while( (count < max_count) && 
+           (fscanf(p_file, "%u %u %u %u %u %u %u %llx", &freq, &mf, &p->ma_x10000, &corrected, &p->signal_duration, 
+                    &p->h1_sync, &p->h2_sync, &hash) == 8) ){
+        p->signal_freq = (uint8_t)freq;
+        p->mf = (uint16_t)mf;
+        p->corrected = (uint8_t)corrected;
+        p->hash = hash;
+        count++;
+        p++;
+    }
+    fclose(p_file);
+    return count;
+}
+
+static void write_result(FILE* p_file, const bench_result_t* p){
+    fprintf(p_file, "%u %u %u %u %u %u %u %016llx\n", p->signal_freq, p->mf, p->ma_x10000, p->corrected, 
+            p->signal_duration, p->h1_sync, p->h2_sync, (unsigned long long)p->hash);
+}
+
+/**
+ * @brief Sine of a phase (in turns) as the generator evaluates it. The Q31 builds use the same quarter wave table
+ * (spwm_sine.h), linearly interpolated at the exact phase, so that only the crossing search is verified. (The table
+ * is within 3e-7 of sin())
+ */
+static long double reference_sin(long double turns){
+#if SPWM_SINE_FIXED_POINT
+    long double angle = (turns - floorl(turns)) * 4;
+    uint32_t quadrant = (uint32_t)angle;
+    angle -= quadrant;
+    if(quadrant & 1u){
+        angle = 1.0L - angle;
+    }
+    long double x = angle * SPWM_SINE_TABLE_SIZE;
+    uint32_t index = (x < SPWM_SINE_TABLE_SIZE) ? (uint32_t)x : (SPWM_SINE_TABLE_SIZE - 1);
+    long double value = spwm_sine_table.q31[index] + 
+                        ((x - index) * ((long double)spwm_sine_table.q31[index + 1] - spwm_sine_table.q31[index]));
+    value /= 2147483648.0L;
+    return (quadrant & 2u) ? -value : value;
+#else
+    return sinl(2.0L * 3.14159265358979323846264338327950288L * turns);
+#endif
+}
+
+/**
+ * @brief Reference wave of the generator (unit amplitude) at a time instance (T_STEP, from the start of signal
+ * wave). SPWM_STRATEGY_MIN_MAX adds the min-max zero sequence of the 3 phases, as spwm_signal_amplitude() does.
+ */
+static long double reference_wave(long double t, uint32_t signal_duration){
+#if SPWM_SINE_FIXED_POINT
+    //Same phase step as the generator (rounded down, Q32.32)
+    long double turns = t * ((long double)spwm_phase_step(signal_duration) / 18446744073709551616.0L);
+#else
+    long double turns = t / signal_duration;
+#endif
+    long double sin_a = reference_sin(turns);
+#if SPWM_STRATEGY == SPWM_STRATEGY_MIN_MAX
+    long double cos_a = reference_sin(turns + 0.25L);
+    long double sin_b = (-0.5L * sin_a) - (0.86602540378443864676L * cos_a);
+    long double sin_c = (-0.5L * sin_a) + (0.86602540378443864676L * cos_a);
+    return sin_a + (0.5L * spwm_median3(sin_a, sin_b, sin_c));
+#else
+    return sin_a;
+#endif
+}
+
+/**
+ * @brief Exact time (T_STEP, from the start of signal wave) of an edge on one ramp of the carrier.
+ *
+ * The carrier of the generator (see spwm_crossing_setup()): period of 4 x quarter counts, starting at +1 & falling
+ * to -1 over the first half. The wave has the period of signal_duration (mf carrier cycles). Like the generator, the
+ * wave is taken in whole counts of the carrier (truncated towards 0), so each edge is the first T_STEP at (or after)
+ * its reference. (A count moves an edge by upto 1 / carrier_slope T_STEP, 0.14 at mf = 4)
+ * - natural sampling: the crossing of wave & carrier. (long double bisection)
+ * - regular sampling: the closed form of spwm_sampled_crossings(), Q x (1 - r) on the falling ramp & Q x (3 + r) on
+ *   the rising ramp for the sample r held on that ramp.
+ *
+ * @param amplitude Amplitude of the wave in counts. (ma x carrier_peak, truncated like the generator)
+ * @param carrier_peak  Amplitude of the carrier in counts. (carrier_slope x quarter)
+ * @param sign  +1 for s1, -1 for s2 (= -s1).
+ * @param cycle Carrier cycle.
+ * @param rising    false for the ON edge (the wave goes above the falling carrier), true for the OFF edge (the rising
+ * carrier goes above the wave).
+ */
+static long double reference_edge(uint32_t quarter, uint32_t signal_duration, uint32_t amplitude, int32_t carrier_peak,
+                                  int sign, uint32_t cycle, bool rising){
+    long double carrier_start = (long double)cycle * 4 * quarter;
+#if SPWM_SAMPLING != SPWM_SAMPLING_NATURAL
+    long double sample_time = (SPWM_SAMPLING == SPWM_SAMPLING_SYMMETRIC) ? (2.0L * quarter) : 
+                              (rising ? (3.0L * quarter) : (1.0L * quarter));
+    long double r = truncl(sign * (long double)amplitude * reference_wave(carrier_start + sample_time, signal_duration)) /
+                    carrier_peak;
+    r = (r > 1.0L) ? 1.0L : ((r < -1.0L) ? -1.0L : r);
+    return carrier_start + (rising ? (quarter * (3.0L + r)) : (quarter * (1.0L - r)));
+#else
+    long double lo = carrier_start + (rising ? (2.0L * quarter) : 0.0L);
+    long double hi = lo + (2.0L * quarter);
+    long double start = lo;
+    //The carrier is much steeper than the wave, so the margin strictly increases along the ramp. (bisection)
+    for(int i = 0; i < 40; i++){
+        long double mid = (lo + hi) / 2;
+        long double carrier = rising ? (-1.0L + ((mid - start) / quarter)) : (1.0L - ((mid - start) / quarter));
+        long double wave = truncl(sign * (long double)amplitude * reference_wave(mid, signal_duration)) / carrier_peak;
+        long double margin = rising ? (carrier - wave) : (wave - carrier);
+        if(margin >= 0){
+            hi = mid;
+        }else{
+            lo = mid;
+        }
+    }
+    return hi;
+#endif
+}
+
+/**
+ * @brief Edge times of a table: the sync count is the 1st ON edge, and the running sum of the values from it gives
+ * every other edge. (ON & OFF edges alternate, one of each in every carrier cycle)
+ */
+static void table_edges(const uint32_t* p_table, uint32_t sync, uint16_t mf, uint32_t* p_edges){
+    uint32_t edge = sync;
+    for(uint32_t i = 0; i < (2u * mf); i++){
+        p_edges[i] = edge;
+        edge += p_table[i];
+    }
+}
+
+/**
+ * @brief Checks the edges of one raw table (see table_edges()) against their exact references.
+ *
+ * @returns false if an edge is further than VERIFY_EDGE_ERROR_MAX from its reference.
+ */
+static bool verify_edges(const uint32_t* p_table, uint32_t sync, uint16_t mf, uint32_t amplitude, int32_t carrier_peak,
+                         int sign, uint32_t quarter, uint32_t signal_duration, verify_stats_t* p_stats){
+    bool ok = true;
+    table_edges(p_table, sync, mf, path_edges);
+    for(uint32_t i = 0; i < (2u * mf); i++){
+        long double reference = reference_edge(quarter, signal_duration, amplitude, carrier_peak, sign, i / 2,
+                                                (i % 2) != 0);
+        double error = (double)fabsl(path_edges[i] - reference);
+        p_stats->edge_error_sum += error;
+        p_stats->edges++;
+        if(error > p_stats->edge_error_max){
+            p_stats->edge_error_max = error;
+        }
+        if(error > (VERIFY_EDGE_ERROR_MAX + VERIFY_REFERENCE_RESOLUTION)){
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+/**
+ * @brief Checks the layout of a table: the values add up to the duration & have the quarter wave symmetry.
+ * - Each half cycle is its own mirror image: [j] = [mf - 2 - j] & [mf + j] = [2mf - 2 - j] for j upto (mf - 2).
+ * - The OFF duration at 180 deg ([mf - 1]) is same as the link into next cycle ([2mf - 1]).
+ */
+static bool verify_layout(const uint32_t* p_table, uint16_t mf, uint64_t duration){
+    uint64_t sum = 0;
+    for(uint32_t i = 0; i < (2u * mf); i++){
+        sum += p_table[i];
+    }
+    if(sum != duration){
+        printf("    values add up to %llu, not %llu\n", (unsigned long long)sum, (unsigned long long)duration);
+        return false;
+    }
+    for(uint32_t j = 0; j <= (uint32_t)(mf - 2); j++){
+        if( (p_table[j] != p_table[mf - 2 - j]) || (p_table[mf + j] != p_table[(2 * mf) - 2 - j]) ){
+            printf("    no mirror symmetry at [%u]\n", j);
+            return false;
+        }
+    }
+    if(p_table[mf - 1] != p_table[(2 * mf) - 1]){
+        printf("    OFF duration at 180 deg differs from the link\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Unfolds the quarter wave layout (see spwm_quarter_arrays()) into the full H1 & H2 tables, as the DMA plays
+ * its segments: each quarter forward, then reverse without its last value.
+ */
+static void unfold_quarters(const uint32_t* p_quarter, uint16_t mf, uint32_t* p_h1, uint32_t* p_h2){
+    uint16_t half = mf / 2;
+    const uint32_t* p_q[2] = {p_quarter, p_quarter + half};
+    uint32_t* p_out[2] = {p_h1, p_h2};
+    for(uint8_t t = 0; t < 2; t++){
+        for(uint8_t h = 0; h < 2; h++){
+            const uint32_t* p_src = p_q[(t + h) % 2];
+            uint32_t* p_dst = p_out[t] + (h * mf);
+            for(uint16_t j = 0; j < half; j++){
+                p_dst[j] = p_src[j];
+            }
+            for(uint16_t j = 0; j < (half - 1); j++){
+                p_dst[half + j] = p_src[half - 2 - j];
+            }
+        }
+        p_out[t][mf - 1] = p_quarter[mf + SPWM_QUARTER_MID];
+    }
+    p_h1[(2 * mf) - 1] = p_quarter[mf + SPWM_QUARTER_LINK_H1];
+    p_h2[(2 * mf) - 1] = p_quarter[mf + SPWM_QUARTER_LINK_H2];
+}
+
+/**
+ * @brief Checks that a table & its sync are same as the expected ones.
+ */
+static bool same_table(const char* p_name, uint8_t t, const uint32_t* p_table, uint32_t sync, const uint32_t* p_expected,
+                       uint32_t expected_sync, uint16_t mf){
+    for(uint32_t i = 0; i < (2u * mf); i++){
+        if(p_table[i] != p_expected[i]){
+            printf("    %s %u: [%u] = %u, expected %u\n", p_name, t, i, p_table[i], p_expected[i]);
+            return false;
+        }
+    }
+    if(sync != expected_sync){
+        printf("    %s %u: sync %u, expected %u\n", p_name, t, sync, expected_sync);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Checks the other paths of the generator against the full tables of spwm_unipolar_arrays(), raw & corrected:
+ * - spwm_phase_arrays(): phase 0 is H1. With 2 phases phase 1 is H2. With more phases, phase k is phase 0 delayed by
+ *   (k / phases) of the cycle, i.e. its edges are those of H1 moved by (2 x mf x k / phases) values & by
+ *   (signal_duration x k / phases). (raw tables, as the corrections of a rotated table are fixed on its own link)
+ * - spwm_packed_phase_arrays(): the halves of each word are the values of spwm_phase_arrays(), or 0 is returned &
+ *   a value (or sync) is more than 16 bits.
+ * - spwm_quarter_arrays(): the unfolded quarters are the full tables. (with corrections, only if no pulse is short,
+ *   as those are fixed on the quarters) It returns 0 for bipolar.
+ *
+ * @param p_raw     Raw full tables (H1 & H2) & their syncs.
+ * @param p_corr    Corrected full tables & their syncs.
+ */
+static bool verify_paths(uint8_t freq, uint16_t mf, double ma, uint32_t signal_duration, const uint32_t* const* p_raw,
+                         const uint32_t* p_raw_sync, const uint32_t* const* p_corr, const uint32_t* p_corr_sync,
+                         bool short_pulses){
+    uint32_t len = 2u * mf;
+    uint32_t* p_phase[VERIFY_PHASES_MAX] = {phase_table[0], phase_table[1], phase_table[2]};
+    uint32_t* p_packed[VERIFY_PHASES_MAX] = {packed_table[0], packed_table[1], packed_table[2]};
+    uint32_t phase_sync[VERIFY_PHASES_MAX] = {};
+    uint32_t packed_sync[VERIFY_PHASES_MAX] = {};
+    bool ok = true;
+
+    for(uint8_t phases : verify_phases){
+        if( ((mf % phases) != 0) || ((SPWM_STRATEGY == SPWM_STRATEGY_BIPOLAR) && (phases != 2)) || 
+            ((SPWM_STRATEGY == SPWM_STRATEGY_MIN_MAX) && (phases != 3)) ){
+            continue;
+        }
+        for(uint8_t corrected = 0; corrected < 2; corrected++){
+            const spwm_corrections_t* p_c = corrected ? &bench_corr : NULL;
+            const uint32_t* const* p_full = corrected ? p_corr : p_raw;
+            const uint32_t* p_full_sync = corrected ? p_corr_sync : p_raw_sync;
+            if(spwm_phase_arrays(freq, mf, ma, phases, p_phase, phase_sync, p_c) != signal_duration){
+                printf("    %u phases: signal_duration differs\n", phases);
+                return false;
+            }
+            ok = same_table("phase", 0, p_phase[0], phase_sync[0], p_full[0], p_full_sync[0], mf) && ok;
+            if(phases == 2){
+                ok = same_table("phase", 1, p_phase[1], phase_sync[1], p_full[1], p_full_sync[1], mf) && ok;
+            }else if(!corrected){
+                table_edges(p_full[0], p_full_sync[0], mf, ref_edges);
+                for(uint8_t k = 1; k < phases; k++){
+                    uint32_t shift = (len * k) / phases;
+                    uint32_t delay = (uint32_t)(((uint64_t)signal_duration * k) / phases);
+                    table_edges(p_phase[k], phase_sync[k], mf, path_edges);
+                    for(uint32_t i = 0; i < len; i++){
+                        uint32_t expected = (ref_edges[(i + len - shift) % len] + delay) % signal_duration;
+                        if((path_edges[i] % signal_duration) != expected){
+                            printf("    phase %u of %u: edge [%u] at %u, expected %u\n", k, phases, i, 
+                                    path_edges[i] % signal_duration, expected);
+                            ok = false;
+                            break;
+                        }
+                    }
+                }
+            }
+
+            //Packed tables hold the same values, if all fit in 16 bits
+            uint32_t packed_duration = spwm_packed_phase_arrays(freq, mf, ma, phases, p_packed, packed_sync, 
+                                                                packed_scratch, p_c);
+            bool fits = true;
+            for(uint8_t k = 0; k < phases; k++){
+                fits = fits && (phase_sync[k] <= SPWM_PACKED_VALUE_MAX);
+                for(uint32_t i = 0; fits && (i < len); i++){
+                    fits = (p_phase[k][i] <= SPWM_PACKED_VALUE_MAX);
+                }
+            }
+            if(packed_duration != (fits ? signal_duration : 0)){
+                printf("    %u phases: packed signal_duration %u (values %s 16 bits)\n", phases, packed_duration,
+                        fits ? "fit in" : "exceed");
+                ok = false;
+                continue;
+            }
+            for(uint8_t k = 0; fits && (k < phases); k++){
+                for(uint32_t j = 0; j < mf; j++){
+                    uint32_t word = p_packed[k][j];
+                    if( ((word & 0xFFFF) != p_phase[k][2 * j]) || ((word >> 16) != p_phase[k][(2 * j) + 1]) ){
+                        printf("    packed phase %u of %u: word [%u] = 0x%08x, values %u %u\n", k, phases, j, word, 
+                                p_phase[k][2 * j], p_phase[k][(2 * j) + 1]);
+                        ok = false;
+                        break;
+                    }
+                }
+                if(packed_sync[k] != phase_sync[k]){
+                    printf("    packed phase %u of %u: sync %u, expected %u\n", k, phases, packed_sync[k], phase_sync[k]);
+                    ok = false;
+                }
+            }
+        }
+    }
+
+    //Quarter wave layout, unfolded into the phase tables. (not for bipolar, its tables are one table)
+    uint32_t sync[2] = {};
+    if(SPWM_STRATEGY == SPWM_STRATEGY_BIPOLAR){
+        if(spwm_quarter_arrays(freq, mf, ma, quarter_table, &sync[0], &sync[1]) != 0){
+            printf("    quarter wave layout is not for bipolar\n");
+            return false;
+        }
+        return ok;
+    }
+    for(uint8_t corrected = 0; corrected < 2; corrected++){
+        if(corrected && short_pulses){
+            continue;
+        }
+        const spwm_corrections_t* p_c = corrected ? &bench_corr : NULL;
+        const uint32_t* const* p_full = corrected ? p_corr : p_raw;
+        const uint32_t* p_full_sync = corrected ? p_corr_sync : p_raw_sync;
+        if(spwm_quarter_arrays(freq, mf, ma, quarter_table, &sync[0], &sync[1], p_c) != signal_duration){
+            printf("    quarter wave layout: signal_duration differs\n");
+            return false;
+        }
+        unfold_quarters(quarter_table, mf, phase_table[0], phase_table[1]);
+        ok = same_table("unfolded quarters H", 1, phase_table[0], sync[0], p_full[0], p_full_sync[0], mf) && ok;
+        ok = same_table("unfolded quarters H", 2, phase_table[1], sync[1], p_full[1], p_full_sync[1], mf) && ok;
+    }
+    return ok;
+}
+
+/**
+ * @brief Checks one configuration (raw & corrected tables) against the invariants of the table format, an exact
+ * reference of the edges & the other paths of the generator. (see verify_paths())
+ *
+ * @returns false if any check fails. (the failed check is printed)
+ */
+static bool verify_config(uint8_t freq, uint16_t mf, double ma, verify_stats_t* p_stats){
+    uint32_t h1_sync = 0, h2_sync = 0;
+    uint32_t signal_duration = spwm_unipolar_arrays(freq, mf, ma, h1_table, h2_table, &h1_sync, &h2_sync, NULL);
+    uint32_t len = 2u * mf;
+    bool ok = true;
+
+    //Carrier quarter in whole T_STEP, so a cycle is short of (1 / freq) by less than 4 x mf counts
+    uint32_t quarter = signal_duration / (4u * mf);
+    double ideal = 1.0 / (VERIFY_T_STEP * freq);
+    if( (signal_duration == 0) || ((quarter * 4u * mf) != signal_duration) || (signal_duration > ideal) ||
+        ((ideal - signal_duration) >= (4.0 * mf)) ){
+        printf("    signal_duration %u for %u Hz\n", signal_duration, freq);
+        return false;
+    }
+
+    ok = verify_layout(h1_table, mf, signal_duration) && ok;
+    ok = verify_layout(h2_table, mf, signal_duration) && ok;
+#if SPWM_STRATEGY == SPWM_STRATEGY_BIPOLAR
+    //H2 is the complement of H1, played from the same table
+    ok = same_table("H", 2, h2_table, h2_sync, h1_table, h1_sync, mf) && ok;
+    const int h2_sign = 1;
+#else
+    const int h2_sign = -1;
+#endif
+#if SPWM_STRATEGY == SPWM_STRATEGY_UNIPOLAR
+    //s2 = -s1 is s1 half a cycle later: H1 & H2 are the halves of each other, swapped
+    for(uint32_t i = 0; i < len; i++){
+        if(h2_table[i] != h1_table[(i + mf) % len]){
+            printf("    H2[%u] is not H1[%u]\n", i, (i + mf) % len);
+            ok = false;
+            break;
+        }
+    }
+#endif
+
+    //Carrier & wave amplitudes as the generator takes them (see spwm_crossing_setup())
+    int32_t carrier_peak = (VERIFY_CARRIER_SCALE / (int32_t)quarter) * (int32_t)quarter;
+    uint32_t amplitude = (uint32_t)(ma * carrier_peak);
+    if(!verify_edges(h1_table, h1_sync, mf, amplitude, carrier_peak, 1, quarter, signal_duration, p_stats) ||
+       !verify_edges(h2_table, h2_sync, mf, amplitude, carrier_peak, h2_sign, quarter, signal_duration, p_stats)){
+        printf("    edge further than %.1f T_STEP from its exact reference\n", VERIFY_EDGE_ERROR_MAX);
+        ok = false;
+    }
+
+    //Corrected tables: the same durations less the corrections, short pulses are stretched with their time taken
+    //from the neighbours. Each table still adds up to the duration.
+    uint32_t h1_corr_sync = 0, h2_corr_sync = 0;
+    spwm_unipolar_arrays(freq, mf, ma, h1_corr_table, h2_corr_table, &h1_corr_sync, &h2_corr_sync, &bench_corr);
+    uint32_t offset = bench_corr.dead_time + bench_corr.pio_overhead;
+    bool short_pulses = false;
+    for(uint32_t i = 0; i < len; i++){
+        short_pulses = short_pulses || (h1_table[i] < (offset + bench_corr.min_pulse)) || 
+                                       (h2_table[i] < (offset + bench_corr.min_pulse));
+    }
+    const uint32_t* p_raw[2] = {h1_table, h2_table};
+    const uint32_t* p_corr[2] = {h1_corr_table, h2_corr_table};
+    for(uint8_t t = 0; t < 2; t++){
+        uint64_t sum = 0;
+        for(uint32_t i = 0; i < len; i++){
+            sum += p_corr[t][i];
+            if(!short_pulses && (p_corr[t][i] != (p_raw[t][i] - offset))){
+                printf("    corrected H%u[%u] = %u, raw %u\n", t + 1, i, p_corr[t][i], p_raw[t][i]);
+                ok = false;
+                break;
+            }
+            //The link into next cycle is left as it is (rewritten by the swaps)
+            if((i != (len - 1)) && ((int32_t)p_corr[t][i] < (int32_t)bench_corr.min_pulse)){
+                printf("    corrected H%u[%u] = %d, shorter than min_pulse\n", t + 1, i, (int32_t)p_corr[t][i]);
+                ok = false;
+                break;
+            }
+        }
+        if((sum + ((uint64_t)offset * len)) != signal_duration){
+            printf("    corrected H%u adds up to %llu\n", t + 1, (unsigned long long)(sum + ((uint64_t)offset * len)));
+            ok = false;
+        }
+    }
+    if( !short_pulses && ((h1_corr_sync != (h1_sync - offset)) || (h2_corr_sync != (h2_sync - offset))) ){
+        printf("    corrected sync %u %u, raw %u %u\n", h1_corr_sync, h2_corr_sync, h1_sync, h2_sync);
+        ok = false;
+    }
+    p_stats->tables += 4;
+
+    const uint32_t raw_sync[2] = {h1_sync, h2_sync};
+    const uint32_t corr_sync[2] = {h1_corr_sync, h2_corr_sync};
+    ok = verify_paths(freq, mf, ma, signal_duration, p_raw, raw_sync, p_corr, corr_sync, short_pulses) && ok;
+    return ok;
+}
+
+//Short pulse cases for spwm_limit_short_pulses() & spwm_limit_quarter_pulses(): each has two adjacent values below
+//the min pulse, so the time merged into one of them must be checked again. (Negative values are corrected values
+//shorter than the corrections, the last full table value is the link)
+#define SHORT_CASE_LEN 8
+#define SHORT_MIN_PULSE 20
+static const int32_t short_cases[][SHORT_CASE_LEN] = {
+    {100, 5, 3, 100, 60, 100, 80, 50},
+    {4, 7, 100, 90, 100, 30, 100, 50},
+    {100, 60, 100, 40, 100, 9, 12, 50},
+    {100, -4, 5, 100, 60, 100, 80, 50},
+    {100, 21, 2, 30, 100, 60, 100, 50},
+    {100, 60, 100, 50, 100, 60, 6, 11},
+};
+
+/**
+ * @brief Checks one table after the short pulse stage: the same total duration, and no value shorter than the
+ * min pulse but the dropped ones (and the odd centre count of a dropped quarter).
+ *
+ * @param weight    How many times each value is played. (NULL for once)
+ */
+static bool short_case_ok(const char* p_name, uint8_t c, const uint32_t* p_values, uint16_t len, const uint8_t* weight,
+                          int64_t expected_sum, uint8_t mode){
+    int64_t sum = 0;
+    bool ok = true;
+    for(uint16_t i = 0; i < len; i++){
+        int32_t value = (int32_t)p_values[i];
+        sum += (int64_t)value * ((weight != NULL) ? weight[i] : 1);
+        bool dropped = (mode == SPWM_PULSE_DROP) && ((value == 0) || ((weight != NULL) && (weight[i] == 1) && (value == 1)));
+        if((value < SHORT_MIN_PULSE) && !dropped){
+            ok = false;
+        }
+    }
+    if(sum != expected_sum){
+        ok = false;
+    }
+    if(!ok){
+        printf("  ^^^ short pulse case %u (%s, %s) :", c, p_name, (mode == SPWM_PULSE_DROP) ? "drop" : "stretch");
+        for(uint16_t i = 0; i < len; i++){
+            printf(" %d", (int32_t)p_values[i]);
+        }
+        printf(", sum %lld of %lld\n", (long long)sum, (long long)expected_sum);
+    }
+    return ok;
+}
+
+/**
+ * @brief Verifies the short pulse stage on the hand made cases, in both modes, for the full tables (the link is left
+ * as it is) & the quarters (played forward & backward around the centre value).
+ *
+ * @returns Number of failed cases.
+ */
+static uint32_t verify_short_pulses(void){
+    uint32_t failures = 0;
+    for(uint8_t mode = SPWM_PULSE_STRETCH; mode <= SPWM_PULSE_DROP; mode++){
+        const spwm_corrections_t corr = {0, 0, SHORT_MIN_PULSE, mode};
+        for(uint8_t c = 0; c < (sizeof(short_cases) / sizeof(short_cases[0])); c++){
+            uint32_t table[SHORT_CASE_LEN];
+            int64_t sum = 0;
+            for(uint16_t i = 0; i < SHORT_CASE_LEN; i++){
+                table[i] = (uint32_t)short_cases[c][i];
+                sum += short_cases[c][i];
+            }
+            spwm_limit_short_pulses(table, SHORT_CASE_LEN, &corr);
+            bool ok = short_case_ok("table", c, table, SHORT_CASE_LEN - 1, NULL, sum - short_cases[c][SHORT_CASE_LEN - 1],
+                                    mode);
+            if((int32_t)table[SHORT_CASE_LEN - 1] != short_cases[c][SHORT_CASE_LEN - 1]){
+                printf("  ^^^ short pulse case %u changed the link\n", c);
+                ok = false;
+            }
+
+            //The same values as a quarter: all played twice, but the centre (the last one)
+            uint8_t weight[SHORT_CASE_LEN];
+            sum = 0;
+            for(uint16_t i = 0; i < SHORT_CASE_LEN; i++){
+                table[i] = (uint32_t)short_cases[c][i];
+                weight[i] = (i == (SHORT_CASE_LEN - 1)) ? 1 : 2;
+                sum += (int64_t)short_cases[c][i] * weight[i];
+            }
+            spwm_limit_quarter_pulses(table, SHORT_CASE_LEN, &corr);
+            ok = short_case_ok("quarter", c, table, SHORT_CASE_LEN, weight, sum, mode) && ok;
+            failures += ok ? 0 : 1;
+        }
+    }
+    printf("Short pulses: %u of %u cases fail\n", failures, 
+            (uint32_t)(2 * (sizeof(short_cases) / sizeof(short_cases[0]))));
+    return failures;
+}
+
+/**
+ * @brief Verifies the tables over a dense grid of signal_freq / mf / ma. (-v)
+ *
+ * @returns 0 if all the tables pass.
+ */
+static int verify_grid(void){
+    printf("Verify: sine: %s, solver: %s\n", SPWM_SINE_FIXED_POINT ? "Q31 table" : "double sin()",
+            (SPWM_CROSSING_SOLVER == SPWM_SOLVER_SCAN) ? "scan" : "bracketed");
+    verify_stats_t stats = {};
+    uint32_t short_failures = verify_short_pulses();
+    for(uint8_t freq : verify_freq){
+        for(uint16_t mf : verify_mf){
+            for(double ma : verify_ma){
+                if(!verify_config(freq, mf, ma, &stats)){
+                    printf("  ^^^ %u Hz, mf %u, ma %.4f fails\n", freq, mf, ma);
+                    stats.failures++;
+                }
+            }
+        }
+    }
+    printf("Tables: %u, edges: %u, edge error max %.3f mean %.3f T_STEP (limit %.1f)\n", stats.tables, stats.edges,
+            stats.edge_error_max, stats.edges ? (stats.edge_error_sum / stats.edges) : 0.0, VERIFY_EDGE_ERROR_MAX);
+    printf("Verify: %u of %u configurations fail\n", stats.failures,
+            (uint32_t)(sizeof(verify_freq) * (sizeof(verify_mf) / sizeof(verify_mf[0])) * 
+                       (sizeof(verify_ma) / sizeof(verify_ma[0]))));
+    return ((stats.failures != 0) || (short_failures != 0)) ? 1 : 0;
+}
+
+/**
+ * @brief Usage:
+ * spwm_lut_bench                      time the grid & diff against the golden set of this build
+ * spwm_lut_bench -g <file>            diff against another golden file (fails if it can not be read)
+ * spwm_lut_bench -w <file>            write a new golden file (after an intended change of tables)
+ * spwm_lut_bench -v                   verify the table invariants & edges against an exact reference (no timing)
+ *
+ * @returns 0 if all the results match the golden set. (or pass the verification)
+ */
+int main(int argc, char** argv){
+    const char* p_golden_path = BENCH_GOLDEN_FILE;
+    const char* p_write_path = NULL;
+    bool golden_given = false;
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "-v") == 0){
+            return verify_grid();
+        }else if((strcmp(argv[i], "-g") == 0) && (i < (argc - 1))){
+            p_golden_path = argv[++i];
+            golden_given = true;
+        }else if((strcmp(argv[i], "-w") == 0) && (i < (argc - 1))){
+            p_write_path = argv[++i];
+        }
+    }
+
+    static bench_result_t golden[1024];
+    uint32_t golden_count = (p_write_path == NULL) ? read_golden(p_golden_path, golden, 1024) : 0;
+    if((p_write_path == NULL) && (golden_count == 0)){
+        printf("Golden file %s not found, only timing....\n", p_golden_path);
+        if(golden_given){
+            return 1;   //A missing golden set of -g (as given by ctest) must not pass as a match
+        }
+    }
+
+    FILE* p_write = NULL;
+    if(p_write_path != NULL){
+        p_write = fopen(p_write_path, "w");
+        if(p_write == NULL){
+            printf("Can not write %s\n", p_write_path);
+            return 1;
+        }
+    }
+
+    printf("sine: %s, solver: %s\n", SPWM_SINE_FIXED_POINT ? "Q31 table" : "double sin()",
+            (SPWM_CROSSING_SOLVER == SPWM_SOLVER_SCAN) ? "scan" : "bracketed");
+    printf("freq   mf     ma corr   time_us  sine/table  iter/table  sine/edge  iter/edge\n");
+
+    uint32_t result_index = 0;
+    uint32_t mismatches = 0;
+    double time_total_us = 0;
+    double time_max_us = 0;
+    bench_result_t result = {};
+
+    for(uint8_t freq : bench_freq){
+        for(uint16_t mf : bench_mf){
+            for(double ma : bench_ma){
+                for(uint8_t corrected = 0; corrected < 2; corrected++){
+                    const spwm_corrections_t* p_corr = corrected ? &bench_corr : NULL;
+                    result.signal_freq = freq;
+                    result.mf = mf;
+                    result.ma_x10000 = (uint32_t)((ma * 10000) + 0.5);
+                    result.corrected = corrected;
+
+                    //Count the work of one table, then time it without the first (cold) run
+                    memset(&spwm_lut_stats, 0, sizeof(spwm_lut_stats));
+                    result.signal_duration = spwm_unipolar_arrays(freq, mf, ma, h1_table, h2_table, 
+                                                &result.h1_sync, &result.h2_sync, p_corr);
+                    spwm_lut_stats_t stats = spwm_lut_stats;
+
+                    auto start = std::chrono::steady_clock::now();
+                    for(int r = 0; r < BENCH_REPEAT; r++){
+                        spwm_unipolar_arrays(freq, mf, ma, h1_table, h2_table, &result.h1_sync, &result.h2_sync, p_corr);
+                    }
+                    auto end = std::chrono::steady_clock::now();
+                    double time_us = std::chrono::duration<double, std::micro>(end - start).count() / BENCH_REPEAT;
+                    time_total_us += time_us;
+                    if(time_us > time_max_us){
+                        time_max_us = time_us;
+                    }
+                    result.hash = hash_tables(mf);
+
+                    printf("%4u %4u %6.4f %4u %9.2f %11u %11u %10.2f %10.2f\n", freq, mf, ma, corrected, time_us,
+                            stats.sine_evals, stats.iterations, 
+                            stats.crossings ? ((double)stats.sine_evals / stats.crossings) : 0.0,
+                            stats.crossings ? ((double)stats.iterations / stats.crossings) : 0.0);
+
+                    if(p_write != NULL){
+                        write_result(p_write, &result);
+                    }else if(golden_count != 0){
+                        const bench_result_t* p_gold = &golden[result_index];
+                        if( (result_index >= golden_count) || 
+                            (p_gold->signal_freq != result.signal_freq) || (p_gold->mf != result.mf) ||
+                            (p_gold->ma_x10000 != result.ma_x10000) || (p_gold->corrected != result.corrected) ||
+                            (p_gold->signal_duration != result.signal_duration) || (p_gold->h1_sync != result.h1_sync) ||
+                            (p_gold->h2_sync != result.h2_sync) || (p_gold->hash != result.hash) ){
+                            printf("  ^^^ differs from golden set\n");
+                            mismatches++;
+                        }
+                    }
+                    result_index++;
+                }
+            }
+        }
+    }
+
+    printf("Tables: %u, total time: %.1f us, max time per table: %.2f us\n", result_index, time_total_us, time_max_us);
+    if(p_write != NULL){
+        fclose(p_write);
+        printf("Golden set written to %s\n", p_write_path);
+        return 0;
+    }
+    if(golden_count != 0){
+        printf("Golden set %s: %u of %u tables differ\n", p_golden_path, mismatches, result_index);
+    }
+    return (mismatches != 0) ? 1 : 0;
+}
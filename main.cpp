@@ -8,29 +8,97 @@
 
 //includes from this project
 #include "spwm_lut.h"
+#include "spwm_swap.h"
+#include "spwm_alloc.h"
+#include "spwm_prof.h"
+#if SPWM_CONST_TABLES
+    #include "spwm_lut_gen.h"
+#endif
+#if SPWM_MULTICORE
+    #include "spwm_core1.h"
+#endif
+#if SPWM_SYNC_IN_LOCK
+    #include "spwm_sync_in.h"
+#endif
+#if SPWM_VOLTAGE_LOOP
+    #include "spwm_rms.h"
+#endif
+#if SPWM_FAULT_TRIP
+    #include "spwm_trip.h"
+#endif
+#if SPWM_SOFT_START
+    #include "spwm_ramp.h"
+#endif
+#if SPWM_STREAMING
+    #include <math.h>
+    #include "spwm_stream.h"
+#endif
+#if SPWM_USB_LINK
+    #include "spwm_link.h"
+#endif
+#if SPWM_HEALTH_MONITOR
+    #include "spwm_health.h"
+#endif
+#if SPWM_DMA_PRIORITY
+    #include "hardware/structs/bus_ctrl.h"
+#endif
+#if SPWM_FAST_BOOT
+    #include "pico/stdio_usb.h"
+#endif
+#if SPWM_TABLE_CACHE
+    #include "spwm_cache.h"
+#endif
 
 //Our assembly program
 #include "spwm_uni.pio.h"
 
+//Number of legs (half bridges) driven. 2 for the H bridge (single phase), 3 for a 3 phase inverter.
+//Pass cmake -DSPWM_PHASES=3 for the 3 phase build. (see spwm_phase_arrays())
+#ifndef SPWM_PHASES
+    #define SPWM_PHASES 2
+#endif
+
+//Legs spread over more than one PIO (RP2350 has 3), all started in the same clock. Pass cmake -DSPWM_MULTI_PIO=1.
+//Needed when the legs & SYNC_OUT (& SYNC_IN) take more than the 4 SMs of one PIO, e.g. with SPWM_INTERLEAVE = 2.
+#ifndef SPWM_MULTI_PIO
+    #define SPWM_MULTI_PIO 0
+#endif
+
+//Number of legs driven: the legs of the tables & their parallel legs. (see SPWM_INTERLEAVE)
+#define SPWM_LEGS (SPWM_PHASES * SPWM_INTERLEAVE)
+
 //MCU RP2350 GPIO pins on PICO2 used for full bridge drive
-#define PICO2_PIN_GP14 14   //H1_HIGH
-#define PICO2_PIN_GP15 15   //H1_LOW
-#define PICO2_PIN_GP17 17   //H2_HIGH
-#define PICO2_PIN_GP16 16   //H2_LOW
+#define PICO2_PIN_GP14 14   //H1_HIGH (Phase A HIGH in 3 phase build)
+#define PICO2_PIN_GP15 15   //H1_LOW  (Phase A LOW)
+#define PICO2_PIN_GP17 17   //H2_HIGH (Phase B HIGH)
+#define PICO2_PIN_GP16 16   //H2_LOW  (Phase B LOW)
 #define SYNC_OUT_50HZ 18   //50Hz Sync out //PICO2_PIN_GP22
+#define PICO2_PIN_GP19 19   //Phase C HIGH (only in 3 phase build)
+#define PICO2_PIN_GP20 20   //Phase C LOW  (only in 3 phase build)
+#define SYNC_IN_PIN 21      //Sine reference (rising edge at zero crossing) for the phase lock //PICO2_PIN_GP21
+#define VOUT_SENSE_PIN 26   //Output voltage sense (filtered & biased to mid supply) for the voltage loop //PICO2_PIN_GP26
+#define VOUT_SENSE_ADC 0    //ADC input of VOUT_SENSE_PIN
+#define FAULT_IN_PIN 22     //Overcurrent / desat fault of the gate drivers for the fast trip //PICO2_PIN_GP22
+#define PICO2_PIN_GP10 10   //H1'_HIGH (parallel leg of H1, only with SPWM_INTERLEAVE = 2)
+#define PICO2_PIN_GP11 11   //H1'_LOW
+#define PICO2_PIN_GP12 12   //H2'_HIGH (parallel leg of H2)
+#define PICO2_PIN_GP13 13   //H2'_LOW
 
-//Buffer size in bits= (1<<size_bits) = 2^11 = 2048 bytes
-//Used while configuring the DMA for PIO data transfer
-#define BUFFER_SIZE_BITS 11
-
-//Buffer Size in Bytes
-#define BUFFER_SIZE 2048    //number of bytes in an array of uint32_t type with size 512 (512 * 4)
+//First of the 2 consecutive pins (HIGH & LOW side) of each leg
+#if SPWM_INTERLEAVE > 1
+static const uint spwm_leg_pin[SPWM_LEGS_MAX] = {PICO2_PIN_GP14, PICO2_PIN_GP16, PICO2_PIN_GP10, PICO2_PIN_GP12};
+#define SPWM_PIN_RANGE_BASE PICO2_PIN_GP10
+#else
+static const uint spwm_leg_pin[SPWM_LEGS_MAX] = {PICO2_PIN_GP14, PICO2_PIN_GP16, PICO2_PIN_GP19};
+#define SPWM_PIN_RANGE_BASE PICO2_PIN_GP14
+#endif
 
-//Arrays for holding the sinusodal waveform values
-uint32_t __attribute__ ((aligned(BUFFER_SIZE))) spwm_h1_high_table[BUFFER_SIZE/4]; //Array size = 512
-uint32_t __attribute__ ((aligned(BUFFER_SIZE))) spwm_h2_high_table[BUFFER_SIZE/4]; //Array size = 512
+//All the pins used by the PIO (legs, SYNC_OUT & SYNC_IN). Each PIO chosen at boot must reach all of them.
+#define SPWM_PIN_RANGE_COUNT (SYNC_IN_PIN - SPWM_PIN_RANGE_BASE + 1)
 
-uint32_t h1_sync_count, h2_sync_count;
+//Banks for holding the sinusodal waveform values (tables are allocated from pool in spwm_alloc.cpp).
+//Two banks are used, one is played by DMA while other can be refilled for next swap.
+spwm_bank_t spwm_bank[2];
 
 //-----------------------------------------------
 //      Constants used in this Application
@@ -38,67 +106,553 @@ uint32_t h1_sync_count, h2_sync_count;
 // Configurable constants before compilation
 #define SIGNAL_FREQ 50
 #define MOD_INDEX_MA 0.8f
-#define MOD_INDEX_MF 256
+#if SPWM_PHASES == 2
+#define MOD_INDEX_MF 256        //Default mf. Any multiple of 4 upto SPWM_MF_MAX (e.g. 64, 128, 256, 512, 1024)
+#else
+#define MOD_INDEX_MF 240        //Default mf. Must be a multiple of 4 & of SPWM_PHASES (e.g. 120, 240, 480, 960)
+#endif
 
 #define DEAD_TIME 50            //The DEAD_TIME to ensure HI & LO side switches do not switch simultaniously
 #define DEADTIME_COMPENSATION 2 //This delay is added by the instructions in the PIO program while adding DEADTIME.
+#if SPWM_PACKED_TABLES
+#define IE_DELAY_COMPENSATION 2 //This delay is added by the instructions in the PIO program while creating SPWM pulses.
+#define SPWM_LEG_PROGRAM spwm_leg16_program         //Takes 2 packed durations from each word (autopull)
+#define SPWM_LEG_PROGRAM_INIT spwm_leg16_program_init
+#define SPWM_LEG_HIGH_HALF 0                        //Start of HIGH side in the program (H2 of bipolar SPWM starts here)
+#else
 #define IE_DELAY_COMPENSATION 3 //This delay is added by the instructions in the PIO program while creating SPWM pulses.
+#define SPWM_LEG_PROGRAM spwm_leg_program           //Takes one duration from each word
+#define SPWM_LEG_PROGRAM_INIT spwm_leg_program_init
+#define SPWM_LEG_HIGH_HALF spwm_leg_offset_high_half
+#endif
+#define MIN_PULSE_COUNT 0       //Min value loaded into PIO delay loop (after the corrections).
+#define SHORT_PULSE_MODE SPWM_PULSE_STRETCH //Shorter pulses are stretched (SPWM_PULSE_STRETCH) or dropped (SPWM_PULSE_DROP)
+#define GATE_ACTIVE_LOW false   //true if the gate drivers have active low inputs. The leg pins are then inverted.
+#define VOUT_RMS_TARGET 800     //Target RMS of the output voltage (SPWM_VOLTAGE_LOOP), in ADC counts at VOUT_SENSE_PIN
+#define VOUT_SAMPLES_PER_CARRIER 1  //ADC samples taken in each carrier cycle, at the same point of it (SPWM_VOLTAGE_LOOP)
+#define SOFT_START_CYCLES 50    //Fundamental cycles of the ramp from 'ma' = 0 to MOD_INDEX_MA at power-on (SPWM_SOFT_START)
+#define FAULT_ACTIVE_LOW true   //true if FAULT_IN_PIN goes LOW at a fault (e.g. open drain comparator) (SPWM_FAULT_TRIP)
+#define HEALTH_REPORT_PASSES 100    //Passes of the idle loop (100 ms) between two reports of the counters (SPWM_HEALTH_MONITOR)
+#define BOOT_BUDGET_US 50000    //Max time from main() to the start of the SMs (SPWM_FAST_BOOT). A longer boot is reported.
 
 // Auto calculations
-#define NET_DEADTIME_COUNT (DEAD_TIME-DEADTIME_COMPENSATION)
+#define NET_DEADTIME_COUNT (spwm_corr.dead_time - DEADTIME_COMPENSATION)
 //#define SYNCOUT_HALF_DURATION (((uint32_t(TRIWAVE_DURATION * 1.0e+8f) * MOD_INDEX_MF)/2)-DEADTIME_COMPENSATION)
 //-----------------------------------------------
 
-void configure_dma_for_pio(PIO pio_spwm, uint sm_spwm, int dc, dma_channel_config *dc_cfg, uint32_t *data_array){
-    
-    /*
-    //Shall the PIO & SM be disabled?
-    pio_sm_set_enabled(pio, sm, false);
-
-    //Shall the FIFO be cleared?
-    // Need to clear _input shift counter_, as well as FIFO, because there may be
-    // partial ISR contents left over from a previous run. sm_restart does this.
-    pio_sm_clear_fifos(pio, sm);
-    pio_sm_restart(pio, sm);
-    */
-   
-    //The default configuration for the DMA channel is received in dc_cfg. Modify it
-    channel_config_set_transfer_data_size(dc_cfg, DMA_SIZE_32); //32-bit transfers
-    channel_config_set_read_increment(dc_cfg, true);            //Inc read address (data array)
-    channel_config_set_write_increment(dc_cfg, false);          //Don't inc write address (PIO FIFO)
-    
-    //The third param is 'size_bits'. It holds the ring_buffer size (in bytes) in a different way.
-    //e.g. if address wrap-up is to take place for 512 values of 32 bits each, 
-    //then ring buffer will have 512 x 4 = 2048 bytes. 
-    //And as 2^11 = 2048,  therefore the size_bits = 11 0r 0x0B;
-    channel_config_set_ring(dc_cfg, false, BUFFER_SIZE_BITS);    //2^11 = 2048 bytes = 512 words of 4 bytes each              
-    channel_config_set_dreq(dc_cfg, pio_get_dreq(pio_spwm, sm_spwm, true));   //Pace to PIO DREQ
-    
-    dma_channel_configure(
-        dc,                         // Channel to be configured
-        dc_cfg,                    // The configuration just created
-        &pio_spwm->txf[sm_spwm],    // Write address (PIO FIFO)
-        data_array,                 // Adress of 1st value in SPWM lookup table
-        -1,                         // -1 = 0xFFFF FFFF for TRANS_COUNT register of DMA
-                                    // Bits 31:28 sets the mode, Bits 27:0 are the transfer_count
-                                    // Set bits 31:28 = 0xf to let DMA channel Run endlessly.
-                                    // In this mode the transfer_count never decrements
-        true                        // Start immediately.
-    );
-    
-    //channel_config_set_enable (&dc_cfg0, true);    //DMA Enabled by Default
+//Freq modulation index selected at boot. 
+uint16_t spwm_mf = MOD_INDEX_MF;
+
+//Signal freq & amplitude modulation index of the tables being played. (see spwm_update_ma())
+uint8_t spwm_signal_freq = SIGNAL_FREQ;
+double spwm_ma = MOD_INDEX_MA;
+
+//Time of the last table computation on core0 (us)
+uint32_t spwm_gen_time_us = 0;
+
+//The values in the lookup tables are corrected for DEADTIME & execution delays by the LUT generator.
+//DEAD_TIME is required prevent shoot through during the time when one switch is turning OFF 
+//while other is turning ON. 
+//Execution delay is the delay introduced by the assembly instructions in PIO program.
+#if SPWM_CONST_TABLES
+constexpr spwm_corrections_t spwm_corr = {DEAD_TIME, IE_DELAY_COMPENSATION, MIN_PULSE_COUNT, SHORT_PULSE_MODE};
+#else
+//The DEAD_TIME can be changed through the USB link, with a restart. (see spwm_link_restart())
+spwm_corrections_t spwm_corr = {DEAD_TIME, IE_DELAY_COMPENSATION, MIN_PULSE_COUNT, SHORT_PULSE_MODE};
+#endif
+
+#if SPWM_CONST_TABLES && (SPWM_PHASES != 2)
+    #error "Flash tables (SPWM_CONST_TABLES) are available only for the H bridge (SPWM_PHASES = 2)"
+#endif
+#if SPWM_CONST_TABLES && SPWM_PACKED_TABLES
+    #error "Flash tables (SPWM_CONST_TABLES) are not packed. Build without SPWM_PACKED_TABLES"
+#endif
+#if SPWM_QUARTER_TABLES && ((SPWM_PHASES != 2) || SPWM_PACKED_TABLES || SPWM_CONST_TABLES)
+    #error "Quarter wave tables (SPWM_QUARTER_TABLES) are only for unpacked RAM tables of the H bridge (SPWM_PHASES = 2)"
+#endif
+#if SPWM_SYNC_IN_LOCK && ((SPWM_PHASES != 2) || !SPWM_FREQ_TRACKING)
+    #error "Phase lock (SPWM_SYNC_IN_LOCK) needs the 4th SM of the PIO (SPWM_PHASES = 2) and SPWM_FREQ_TRACKING"
+#endif
+#if SPWM_FREQ_TRACKING && (SPWM_CONST_TABLES || SPWM_QUARTER_TABLES)
+    #error "Freq tracking (SPWM_FREQ_TRACKING) pads the full RAM tables. Build without SPWM_CONST_TABLES & SPWM_QUARTER_TABLES"
+#endif
+#if SPWM_INCREMENTAL_PATCH && (SPWM_CONST_TABLES || SPWM_PACKED_TABLES || SPWM_QUARTER_TABLES || SPWM_FREQ_TRACKING || SPWM_MULTICORE)
+    #error "Incremental patch (SPWM_INCREMENTAL_PATCH) rewrites the unpacked RAM tables of the only bank on core0. Build it alone"
+#endif
+#if SPWM_SOFT_START && (SPWM_CONST_TABLES || SPWM_INCREMENTAL_PATCH)
+    #error "Soft start (SPWM_SOFT_START) steps 'ma' by swaps of the spare bank. Build without SPWM_CONST_TABLES & SPWM_INCREMENTAL_PATCH"
+#endif
+#if SPWM_STREAMING && (SPWM_CONST_TABLES || SPWM_PACKED_TABLES || SPWM_QUARTER_TABLES || SPWM_FREQ_TRACKING || SPWM_MULTICORE || \
+                    SPWM_INCREMENTAL_PATCH || SPWM_SOFT_START || SPWM_VOLTAGE_LOOP)
+    #error "Streaming (SPWM_STREAMING) plays DMA rings refilled from a reference callback, not the tables. Build without the table options"
+#endif
+#if (SPWM_STRATEGY == SPWM_STRATEGY_BIPOLAR) && ((SPWM_PHASES != 2) || SPWM_QUARTER_TABLES)
+    #error "Bipolar SPWM (SPWM_STRATEGY = 1) is for the full tables of the H bridge (SPWM_PHASES = 2). Build without SPWM_QUARTER_TABLES"
+#endif
+#if (SPWM_STRATEGY == SPWM_STRATEGY_MIN_MAX) && (SPWM_PHASES != 3)
+    #error "Min-max zero sequence (SPWM_STRATEGY = 2) is only for the 3 phase build (SPWM_PHASES = 3)"
+#endif
+#if (SPWM_STRATEGY != SPWM_STRATEGY_UNIPOLAR) && SPWM_STREAMING
+    #error "Streaming (SPWM_STREAMING) takes its references from the callback. Build it with SPWM_STRATEGY = 0"
+#endif
+#if SPWM_EDGE_DITHER && SPWM_INCREMENTAL_PATCH
+    #error "Edge dithering (SPWM_EDGE_DITHER) carries the rounding error through the whole table. Build without SPWM_INCREMENTAL_PATCH"
+#endif
+#if SPWM_HEALTH_MONITOR && (SPWM_QUARTER_TABLES || SPWM_STREAMING)
+    #error "Health monitor (SPWM_HEALTH_MONITOR) counts the words of full tables. Build without SPWM_QUARTER_TABLES & SPWM_STREAMING"
+#endif
+#if SPWM_TABLE_CACHE && (SPWM_CONST_TABLES || SPWM_STREAMING || SPWM_INCREMENTAL_PATCH || SPWM_FREQ_TRACKING || SPWM_MULTICORE)
+    #error "Table cache (SPWM_TABLE_CACHE) holds unpadded RAM tables filled on core0. Build without the other table options"
+#endif
+#if SPWM_TABLE_CACHE && SPWM_HEALTH_MONITOR
+    #error "Table cache (SPWM_TABLE_CACHE) erases flash with the IRQs held off, which stalls the timer IRQ of the health checks. Build without SPWM_HEALTH_MONITOR"
+#endif
+#if SPWM_TABLE_CACHE && SPWM_USB_LINK
+//The link is not served during an erase (nor is the USB IRQ taken). The host must wait that long for a reply.
+static_assert((SPWM_CACHE_ERASE_MS + 1) <= SPWM_LINK_REPLY_MS_MAX, "Table cache erase stalls the link longer than SPWM_LINK_REPLY_MS_MAX");
+#endif
+#if SPWM_TABLE_CACHE && SPWM_VOLTAGE_LOOP
+//A pass of the idle loop (100 ms) with an erase in it must still poll the RMS ring before DMA laps it
+static_assert((100 + SPWM_CACHE_ERASE_MS) <= SPWM_RMS_POLL_MS_MAX, "Table cache erase delays the RMS poll too much");
+#endif
+#if SPWM_VOLTAGE_LOOP && SPWM_CONST_TABLES
+    #error "Voltage loop (SPWM_VOLTAGE_LOOP) changes 'ma' by swaps. Build without SPWM_CONST_TABLES"
+#endif
+static_assert(MOD_INDEX_MA < SPWM_MA_LIMIT, "MOD_INDEX_MA is over the limit of the strategy (SPWM_MA_LIMIT)");
+#if SPWM_VOLTAGE_LOOP
+static_assert(((uint64_t)VOUT_SAMPLES_PER_CARRIER * SPWM_MF_MAX * SIGNAL_FREQ * SPWM_RMS_POLL_MS_MAX) <=
+              ((uint64_t)(SPWM_RMS_RING - SPWM_RMS_RING_GUARD) * 1000), "ADC ring of the voltage loop is too small for the polls");
+#endif
+#if (SPWM_INTERLEAVE != 1) && ((SPWM_INTERLEAVE != 2) || (SPWM_PHASES != 2) || (SPWM_STRATEGY != SPWM_STRATEGY_UNIPOLAR) || \
+                               SPWM_QUARTER_TABLES || SPWM_STREAMING)
+    #error "Interleaved legs (SPWM_INTERLEAVE = 2) are for the full unipolar tables of the H bridge (SPWM_PHASES = 2)"
+#endif
+#if SPWM_MULTI_PIO && ((NUM_PIOS < 3) || SPWM_STREAMING)
+    #error "Multi-PIO legs (SPWM_MULTI_PIO) need the 3 PIOs of RP2350 and the swaps of full tables. Build without SPWM_STREAMING"
+#endif
+#if !SPWM_MULTI_PIO && ((SPWM_LEGS + 1 + SPWM_SYNC_IN_LOCK) > 4)
+    #error "The legs & SYNC_OUT (& SYNC_IN) take more than the 4 SMs of one PIO. Build with SPWM_MULTI_PIO"
+#endif
+static_assert((SPWM_PHASES >= 2) && (SPWM_PHASES <= SPWM_TABLES_MAX), "SPWM_PHASES must be 2 or 3");
+#if !SPWM_CONST_TABLES && !SPWM_STREAMING
+static_assert(MOD_INDEX_MF <= SPWM_MF_MAX, "MOD_INDEX_MF is over SPWM_MF_MAX of the table pool (cmake -DSPWM_MF_MAX)");
+#endif
+
+#if SPWM_CONST_TABLES
+//Tables for the fixed SIGNAL_FREQ, MOD_INDEX_MF & MOD_INDEX_MA, computed by the compiler and placed in flash.
+//No time is spent on table computation at boot and the tables take no SRAM. (The table pool is not linked in)
+static constexpr spwm_const_tables_t<MOD_INDEX_MF> spwm_flash_tables = 
+                        spwm_make_const_tables<MOD_INDEX_MF>(SIGNAL_FREQ, MOD_INDEX_MA, &spwm_corr, SPWM_STRATEGY,
+                                                                    SPWM_SAMPLING);
+static_assert(spwm_flash_tables.signal_duration != 0, "MOD_INDEX_MF must be a multiple of 4");
+#endif
+
+#if SPWM_STREAMING
+/**
+ * @brief Reference of each leg for the streaming mode. (see spwm_stream_ref_t)
+ *
+ * A sine wave of SIGNAL_FREQ (2 * mf samples per cycle) at MOD_INDEX_MA, shifted by (360 / SPWM_PHASES) deg 
+ * for each leg. In the 3 phase build a 3rd harmonic of (1 / 6) is added. It is the same in all the phases, so 
+ * it cancels in the line voltages, and a MOD_INDEX_MA upto 1.15 can be used without over modulation.
+ * Replace it for other waveforms, e.g. from a sample buffer passed through p_ctx.
+ */
+static double stream_reference(uint8_t leg, uint32_t sample, void* p_ctx){
+    (void)p_ctx;
+    double theta = ((2.0 * M_PI * sample) / (2.0 * spwm_mf)) - ((2.0 * M_PI * leg) / SPWM_PHASES);
+    double ref = MOD_INDEX_MA * sin(theta);
+#if SPWM_PHASES == 3
+    ref += (MOD_INDEX_MA / 6.0) * sin(3.0 * theta);
+#endif
+    return ref;
+}
+#endif
+
+/**
+ * @brief Changes the amplitude modulation index without stopping PIO & DMA.
+ * 
+ * The spare bank is filled with the tables for new 'ma' and it is played from the start of next 
+ * fundamental cycle. 
+ * 
+ * @returns false if the previous change is still pending. Try again later.
+ * Always false with SPWM_CONST_TABLES, as the link at the end of a flash table can not be rewritten for a swap.
+ * 
+ * With SPWM_MULTICORE the new 'ma' is only sent to core1, which computes & publishes the tables. (see spwm_core1.cpp)
+ * It returns false if the inter-core FIFO is full.
+ *
+ * With SPWM_INCREMENTAL_PATCH the tables being played are patched in place from the next carrier cycle, and 
+ * the new 'ma' is played within a few carrier cycles. (see spwm_patch.cpp)
+ *
+ * With SPWM_TABLE_CACHE the tables of an operating point used before are copied from flash. (see spwm_cache.cpp)
+ *
+ * Always false with SPWM_STREAMING, as the amplitude comes from the reference callback.
+ *
+ * The tables are computed for spwm_signal_freq. spwm_ma is set to 'ma' once the change is accepted.
+ */
+bool spwm_update_ma(double ma){
+#if SPWM_CONST_TABLES || SPWM_STREAMING
+    (void)ma;
+    return false;
+#else
+    bool success = false;
+#if SPWM_INCREMENTAL_PATCH
+    success = spwm_patch_set_ma(ma);
+#elif SPWM_MULTICORE
+    success = spwm_core1_request(spwm_signal_freq, spwm_mf, ma);
+#else
+    spwm_bank_t* p_bank = spwm_swap_get_spare();
+    if(p_bank == NULL){
+        return false;
+    }
     
-    /*
-    //Was the PIO & SM was disabled for configuring the DMA? then enable again.
-    pio_sm_set_enabled(pio, sm, true);
-    */
+    uint64_t start_time = time_us_64();
+#if SPWM_TABLE_CACHE
+    //Copied from flash if this operating point was used before
+    if(spwm_cache_fill_bank(p_bank, SPWM_PHASES, spwm_signal_freq, spwm_mf, ma, &spwm_corr) == 0){
+#else
+    if(spwm_fill_bank(p_bank, SPWM_PHASES, spwm_signal_freq, spwm_mf, ma, &spwm_corr) == 0){
+#endif
+        return false;
+    }
+    spwm_gen_time_us = (uint32_t)(time_us_64() - start_time);
+    success = spwm_swap_publish();
+#endif
+    if(success){
+        spwm_ma = ma;
+    }
+    return success;
+#endif
+}
+
+#if SPWM_FREQ_TRACKING
+/**
+ * @brief Changes the output frequency (e.g. by the fine trim of a grid PLL) without computing the tables again.
+ *
+ * The present tables are copied into the spare bank with new pads (see spwm_track.cpp) and played from
+ * the start of next fundamental cycle. Later changes of 'ma' are also padded for this freq.
+ *
+ * @param freq_uhz  Output frequency in micro Hz. Within SPWM_TRACK_MAX_PPM of SIGNAL_FREQ.
+ *
+ * @returns false if the previous change is still pending (try again later) or the freq is out of range.
+ * With SPWM_MULTICORE the retrim is only sent to core1. It returns false if the inter-core FIFO is full.
+ */
+bool spwm_update_freq(uint32_t freq_uhz){
+    spwm_track_set_freq(freq_uhz);
+#if SPWM_MULTICORE
+    return spwm_core1_retrim();
+#else
+    return spwm_track_retrim(SPWM_PHASES, spwm_mf, &spwm_corr);
+#endif
+}
+#endif
+
+#if SPWM_MULTICORE
+/**
+ * @brief Hands the table generation & swaps over to core1. (after the soft start with SPWM_SOFT_START)
+ */
+static void multicore_start(void){
+    spwm_core1_start(spwm_mf, SPWM_PHASES, &spwm_corr);
+    printf("Table generation started on core1....\n");
+}
+#endif
+
+#if SPWM_USB_LINK
+#define LINK_IDLE_PASSES 100        //Passes (of 1 ms) of the idle loop for each pass of the other loops in it
+#define LINK_DEAD_TIME_MAX 1000     //Max DEAD_TIME given through the link (T_STEP)
+#if SPWM_QUARTER_TABLES
+    #define LINK_TABLE_WORDS(mf) SPWM_QUARTER_WORDS(mf)    //All the legs share the quarter wave layout
+#else
+    #define LINK_TABLE_WORDS(mf) SPWM_TABLE_WORDS(mf)
+#endif
+
+static const PIO* p_link_pio = NULL;        //PIO & SM of each leg (for the DMA underruns in telemetry)
+static const uint* p_link_sm = NULL;
+static uint32_t link_vout_rms = 0;          //Last RMS from the voltage loop
+
+/**
+ * @brief Takes the settings of this boot from the link, if it has restarted the firmware. (see spwm_link_restart())
+ */
+static void link_boot(void){
+#if !SPWM_CONST_TABLES
+    spwm_link_config_t config;
+    if(spwm_link_boot_config(&config)){
+        //Settings of a firmware with a larger table pool are not taken
+        if(config.mf > SPWM_MF_MAX){
+            printf("Restart by the link ignored: mf = %d is over SPWM_MF_MAX (%d)\n", config.mf, SPWM_MF_MAX);
+            return;
+        }
+        spwm_mf = config.mf;
+        spwm_corr.dead_time = config.dead_time;
+        spwm_signal_freq = config.signal_freq;
+        spwm_ma = config.ma_x10000 / 10000.0;
+        printf("Restarted by the link: mf = %d, DEAD_TIME = %d\n", spwm_mf, config.dead_time);
+    }
+#endif
+}
+
+/**
+ * @brief Duration of one fundamental cycle being played.
+ */
+static uint32_t link_signal_duration(void){
+#if SPWM_STREAMING
+    return spwm_bank[0].signal_duration;
+#else
+    return spwm_swap_get_active()->signal_duration;
+#endif
+}
+
+/**
+ * @brief Legs whose SM has found its TX FIFO empty since the last call, i.e. DMA was late. (sticky TXSTALL of FDEBUG)
+ */
+static uint8_t link_stall_mask(void){
+    uint8_t mask = 0;
+#if SPWM_HEALTH_MONITOR
+    //The flags are taken (and cleared) by the health checks. New stalls in their counters.
+    static uint32_t stalls_seen[SPWM_LEGS_MAX];
+    spwm_health_t health;
+    spwm_health_get(&health);
+    for(uint8_t leg = 0; leg < SPWM_LEGS; leg++){
+        if(health.stalls[leg] != stalls_seen[leg]){
+            mask |= (uint8_t)(1u << leg);
+            stalls_seen[leg] = health.stalls[leg];
+        }
+    }
+#else
+    for(uint8_t leg = 0; leg < SPWM_LEGS; leg++){
+        uint32_t bit = 1u << (PIO_FDEBUG_TXSTALL_LSB + p_link_sm[leg]);
+        if(p_link_pio[leg]->fdebug & bit){
+            mask |= (uint8_t)(1u << leg);
+            p_link_pio[leg]->fdebug = bit;      //Write 1 to clear
+        }
+    }
+#endif
+    return mask;
+}
+
+/**
+ * @brief Changes the freq & 'ma' of the tables being played, from the next fundamental cycle. (see spwm_update_ma())
+ */
+static uint8_t link_update(uint8_t signal_freq, double ma){
+#if SPWM_CONST_TABLES || SPWM_STREAMING
+    (void)signal_freq;
+    (void)ma;
+    return SPWM_LINK_NOT_SUPPORTED;
+#else
+#if SPWM_INCREMENTAL_PATCH || SPWM_FREQ_TRACKING || SPWM_VOLTAGE_LOOP
+    //The patch & the freq tracking keep the freq of the boot tables. (The ADC samples of the voltage loop are
+    //locked to the cycle of the boot tables)
+    if(signal_freq != spwm_signal_freq){
+        return SPWM_LINK_NOT_SUPPORTED;
+    }
+#endif
+    //'ma' is bounded by the strategy. (see SPWM_MA_LIMIT)
+    if((signal_freq == 0) || (ma < 0.0) || (ma >= SPWM_MA_LIMIT)){
+        return SPWM_LINK_BAD_ARG;
+    }
+#if SPWM_SOFT_START
+    //The swaps of the ramp come first
+    if(spwm_ramp_active()){
+        return SPWM_LINK_BUSY;
+    }
+#endif
+    uint8_t old_freq = spwm_signal_freq;
+    spwm_signal_freq = signal_freq;
+    if(spwm_update_ma(ma)){
+        return SPWM_LINK_OK;
+    }
+    spwm_signal_freq = old_freq;
+#if SPWM_INCREMENTAL_PATCH
+    //The patch never waits, so the crossings (or the min pulse) failed for this 'ma'
+    return SPWM_LINK_BAD_ARG;
+#elif !SPWM_MULTICORE
+    //Not waiting for a swap, so the tables could not be computed for this freq
+    if(!spwm_swap_pending()){
+        return SPWM_LINK_BAD_ARG;
+    }
+#endif
+    return SPWM_LINK_BUSY;
+#endif
+}
+
+/**
+ * @brief Prints the active tables of all the legs on UART, one value per line. (the old boot dump, on demand)
+ * The link & the idle loop wait till it is printed.
+ */
+static uint8_t link_dump_tables(void){
+#if SPWM_STREAMING
+    return SPWM_LINK_NOT_SUPPORTED;
+#else
+    const spwm_bank_t* p_bank = spwm_swap_get_active();
+    printf("Sync:");
+    for(uint8_t leg = 0; leg < SPWM_PHASES; leg++){
+        printf(" %d", p_bank->sync[leg]);
+    }
+    printf("\n");
+    for(uint8_t leg = 0; leg < SPWM_PHASES; leg++){
+        for(uint16_t i = 0; i < LINK_TABLE_WORDS(spwm_mf); i++){
+            printf("Leg%d[%4d] : %d\n", leg, i, p_bank->p_table[leg][i]);
+        }
+    }
+    return SPWM_LINK_OK;
+#endif
+}
+
+/**
+ * @brief Present state for the replies & the telemetry of the link.
+ */
+static void link_get_state(spwm_link_state_t* p_state){
+    p_state->legs = SPWM_PHASES;
+    p_state->signal_freq = spwm_signal_freq;
+    p_state->mf = spwm_mf;
+    p_state->ma = spwm_ma;
+    p_state->dead_time = (uint16_t)spwm_corr.dead_time;
+    p_state->signal_duration = link_signal_duration();
+    p_state->gen_time_us = spwm_gen_time_us;
+    p_state->vout_rms = link_vout_rms;
+}
+
+/**
+ * @brief Checks the mf & dead time staged for a restart. Same limits as spwm_alloc_banks() & spwm_phase_arrays().
+ */
+static uint8_t link_check_config(const spwm_link_config_t* p_config){
+#if SPWM_CONST_TABLES
+    (void)p_config;
+    return SPWM_LINK_NOT_SUPPORTED;
+#else
+    uint16_t mf = p_config->mf;
+    if((mf == 0) || ((mf % 4) != 0) || ((mf % SPWM_PHASES) != 0) || (mf > SPWM_MF_MAX)){
+        return SPWM_LINK_BAD_ARG;
+    }
+    if((p_config->dead_time <= DEADTIME_COMPENSATION) || (p_config->dead_time > LINK_DEAD_TIME_MAX)){
+        return SPWM_LINK_BAD_ARG;
+    }
+    return SPWM_LINK_OK;
+#endif
+}
+
+/**
+ * @brief Active table of a leg & its number of words, for SPWM_LINK_CMD_READ_TABLE.
+ */
+static uint8_t link_get_table(uint8_t leg, const uint32_t** pp_table, uint16_t* p_words){
+#if SPWM_STREAMING
+    (void)leg;
+    (void)pp_table;
+    (void)p_words;
+    return SPWM_LINK_NOT_SUPPORTED;
+#else
+    if(leg >= SPWM_PHASES){
+        return SPWM_LINK_BAD_ARG;
+    }
+    *pp_table = spwm_swap_get_active()->p_table[leg];
+    *p_words = LINK_TABLE_WORDS(spwm_mf);
+    return SPWM_LINK_OK;
+#endif
+}
+
+/**
+ * @brief Text dump on UART for SPWM_LINK_CMD_DUMP.
+ */
+static uint8_t link_dump(uint8_t what){
+    if(what == SPWM_LINK_DUMP_TABLES){
+        return link_dump_tables();
+    }
+#if SPWM_PROFILE
+    if(what == SPWM_LINK_DUMP_PROFILE){
+        spwm_prof_dump();
+        return SPWM_LINK_OK;
+    }
+#endif
+    return SPWM_LINK_BAD_ARG;
+}
+
+static const spwm_link_app_t link_app = {link_get_state, link_update, link_check_config, link_get_table,
+                                         link_stall_mask, link_dump};
+
+/**
+ * @brief Starts serving the link once the SMs are running. (see spwm_link_start())
+ */
+static void link_start(const PIO* p_pio, const uint* p_sm){
+    p_link_pio = p_pio;
+    p_link_sm = p_sm;
+    spwm_link_start(&link_app);
+}
+#endif
+
+/**
+ * @brief Starts the console (USB CDC & UART) and the link on the USB CDC.
+ */
+static void boot_console(void){
+    stdio_init_all();
+#if SPWM_USB_LINK
+    //The USB CDC carries the frames of the link. Text goes only to the UART, so there is no wait for a console.
+    spwm_link_init();
+#endif
 }
 
+#if SPWM_FAST_BOOT
+//Times of the startup path, on the timer. (It counts from the runtime init just after the clocks are started, so
+//the boot ROM & the clock start before it are not in these times)
+static uint32_t boot_entry_us = 0;      //Time at the entry of main()
+static uint32_t boot_off_us = 0;        //Time at which the leg pins were driven OFF
+static uint32_t boot_tables_us = 0;     //Time taken by the tables (computed or taken from flash)
+static uint32_t boot_setup_us = 0;      //Time at which the tables were ready (then PIO, DMA & SYNC_OUT setup)
+static uint32_t boot_start_us = 0;      //Time at which the SMs were started
+
+/**
+ * @brief Drives both switches of each leg OFF (0b00) through plain GPIO. First thing at boot.
+ *
+ * The pins are inputs from the reset. They are held OFF here till the leg program init hands them to the PIO,
+ * whose SM already drives them OFF as outputs at that time, till its first edge. (see spwm_leg_program_init())
+ */
+static void boot_legs_off(void){
+    for(uint8_t leg = 0; leg < SPWM_LEGS; leg++){
+        for(uint pin = spwm_leg_pin[leg]; pin < spwm_leg_pin[leg] + 2; pin++){
+            gpio_init(pin);
+            gpio_put(pin, GATE_ACTIVE_LOW);     //OFF level of the gate driver input
+            gpio_set_dir(pin, GPIO_OUT);
+        }
+    }
+}
+
+/**
+ * @brief Prints the times of the startup path & checks it against BOOT_BUDGET_US. At the end of the boot (UART) &
+ * again whenever a USB console is opened.
+ *
+ * @note The budget is for the path in main(), from its entry to the start of the SMs: legs OFF, tables, PIO, DMA
+ * & SYNC_OUT setup. The runtime init before main() is shown, but not in the budget.
+ */
+static void boot_report(void){
+    uint32_t path_us = boot_start_us - boot_entry_us;
+    printf("Fast boot: main() at %u us. Legs OFF +%u us, tables %u us, PIO & DMA setup %u us, SMs started +%u us"
+           " (budget %u us)\n", boot_entry_us, boot_off_us - boot_entry_us, boot_tables_us, boot_start_us - boot_setup_us,
+            path_us, BOOT_BUDGET_US);
+    if(path_us > BOOT_BUDGET_US) {printf("Startup path is %u us longer than BOOT_BUDGET_US..\n", path_us - BOOT_BUDGET_US);}
+}
+#endif
 
 int main()
 {
-    stdio_init_all();
-    sleep_ms(10000);
+#if SPWM_FAST_BOOT
+    //Legs OFF before anything else. The console is started only after the SMs, so that neither the USB
+    //enumeration nor the text on UART delays the switching. (printf before it is dropped)
+    boot_entry_us = time_us_32();
+    boot_legs_off();
+    boot_off_us = time_us_32();
+#else
+    boot_console();
+#endif
+#if SPWM_DMA_PRIORITY
+    //DMA ahead of the CPUs on the bus fabric (the table channels are also high priority among the DMA channels)
+    bus_ctrl_hw->priority = BUSCTRL_BUS_PRIORITY_DMA_W_BITS | BUSCTRL_BUS_PRIORITY_DMA_R_BITS;
+#endif
+#if SPWM_USB_LINK
+    link_boot();
+#elif !SPWM_FAST_BOOT && !SPWM_CONST_TABLES && !SPWM_SOFT_START
+    sleep_ms(10000);    //Time to open the USB console. (With soft start the switching starts at once instead)
+#endif
+#if SPWM_PROFILE
+    //Cycles of each startup phase & of each table computation are recorded in RAM. Send 'p' over USB to print them.
+    spwm_prof_init();
+#endif
     
     //-----------------------------------------------------------------------------------
     //Added only to get idea about how much time it takes to calulate the array elements.
@@ -106,149 +660,439 @@ int main()
     uint64_t start_time, end_time;
     start_time = time_us_64();
 
-    //Compute SPWM lookup table values
-    uint32_t signal_duration = spwm_unipolar_arrays(SIGNAL_FREQ, MOD_INDEX_MF, MOD_INDEX_MA, spwm_h1_high_table, spwm_h2_high_table, 
-                        &h1_sync_count, &h2_sync_count);
+    spwm_bank_t* p_bank = &spwm_bank[0];
+    bool success = false;
+#if SPWM_CONST_TABLES
+    //DMA plays the tables straight from flash. The spare bank stays empty, as no swap is done.
+    uint ring_size_bits = spwm_ring_size_bits(spwm_mf);
+    p_bank->p_table[SPWM_LEG_H1] = (uint32_t*)spwm_flash_tables.h1_high;
+    p_bank->p_table[SPWM_LEG_H2] = (uint32_t*)spwm_flash_tables.h2_high;
+    p_bank->sync[SPWM_LEG_H1] = spwm_flash_tables.h1_sync;
+    p_bank->sync[SPWM_LEG_H2] = spwm_flash_tables.h2_sync;
+    p_bank->signal_duration = spwm_flash_tables.signal_duration;
+    uint32_t signal_duration = p_bank->signal_duration;
+#elif SPWM_STREAMING
+    //No tables. The 1st carrier cycles are computed into the DMA rings, the rest are computed in the DMA IRQ.
+    uint32_t carrier_duration = spwm_stream_init(SPWM_PHASES, spwm_signal_freq, spwm_mf, stream_reference, NULL, 
+                                                &spwm_corr, p_bank->sync);
+    if(carrier_duration == 0) {printf("Streaming is not possible for mf = %d..\n", spwm_mf);}
+    hard_assert(carrier_duration != 0);
+    //SYNC_OUT marks every (mf) carrier cycles, i.e. SIGNAL_FREQ of the default reference
+    p_bank->signal_duration = carrier_duration * spwm_mf;
+    uint32_t signal_duration = p_bank->signal_duration;
+#else
+    //Get the tables of correct size & alignment for the selected mf
+    if(spwm_mf > SPWM_MF_MAX) {printf("mf = %d is over SPWM_MF_MAX (%d) of the table pool. Build with cmake -DSPWM_MF_MAX=..\n", spwm_mf, SPWM_MF_MAX);}
+    hard_assert(spwm_mf <= SPWM_MF_MAX);
+    uint ring_size_bits = 0;
+    success = spwm_alloc_banks(spwm_mf, SPWM_PHASES, &spwm_bank[0], &spwm_bank[1], &ring_size_bits);
+    if(!success) {printf("mf = %d is not supported..\n", spwm_mf);}
+    hard_assert(success);
+    SPWM_PROF_MARK(SPWM_PROF_ALLOC);
+
+#if SPWM_FREQ_TRACKING
+    //The tables are padded to exactly SIGNAL_FREQ, till a trim comes with spwm_update_freq()
+    spwm_track_set_freq(SIGNAL_FREQ * SPWM_TRACK_UHZ_PER_HZ);
+#endif
+#if SPWM_SOFT_START
+    //Switching starts at 'ma' = 0. The ramp to MOD_INDEX_MA is played after the SMs are started.
+    double boot_ma = spwm_ramp_ma(0, SOFT_START_CYCLES, spwm_ma);
+#else
+    double boot_ma = spwm_ma;
+#endif
+#if SPWM_TABLE_CACHE
+    //Tables of the operating points used before are copied from flash. The new ones are written when idle.
+    if(!spwm_cache_init()) {printf("No room in flash for the table cache. Tables are always computed..\n");}
+#endif
+#if SPWM_TABLE_CACHE && !SPWM_SOFT_START
+    uint32_t signal_duration = spwm_cache_fill_bank(p_bank, SPWM_PHASES, spwm_signal_freq, spwm_mf, boot_ma, &spwm_corr);
+#else
+    //Compute SPWM lookup table values (one table per leg, with one crossing search for all of them)
+    uint32_t signal_duration = spwm_fill_bank(p_bank, SPWM_PHASES, spwm_signal_freq, spwm_mf, boot_ma, &spwm_corr);
+#endif
+    if(signal_duration == 0) {printf("Lookup table computation failed for mf = %d..\n", spwm_mf);}
+    hard_assert(signal_duration != 0);
+#if SPWM_INCREMENTAL_PATCH
+    //The crossings are kept for patching the tables in place. (there is no spare bank)
+    success = spwm_patch_init(p_bank, SPWM_PHASES, spwm_signal_freq, spwm_mf, spwm_ma, &spwm_corr);
+    if(!success) {printf("Incremental patch is not possible for mf = %d..\n", spwm_mf);}
+    hard_assert(success);
+#endif
+#endif
     
     end_time = time_us_64();
     uint32_t diff_time = (uint32_t)(end_time - start_time);
     printf("Exec Time : %d\n", diff_time);
+#if SPWM_FAST_BOOT
+    boot_tables_us = diff_time;
+    boot_setup_us = time_us_32();
+#endif
     
-    //The values in the lookup tables must be corrected for DEADTIME & execution delays.
-    //DEAD_TIME is required prevent shoot through during the time when one switch is turning OFF 
-    //while other is turning ON. 
-    //Execution delay is the delay introduced by the assembly instructions in PIO program.
-    printf("%3d SPWM1: %5d", -1, h1_sync_count);
-    h1_sync_count = h1_sync_count - DEAD_TIME - IE_DELAY_COMPENSATION;
-    printf(" : %5d", h1_sync_count);
-    
-    printf(" SPWM2: %5d", h2_sync_count);
-    h2_sync_count = h2_sync_count - DEAD_TIME - IE_DELAY_COMPENSATION;
-    printf(" : %5d\n", h2_sync_count);
-
-    for(uint16_t i=0; i<(MOD_INDEX_MF*2); i++){
-        printf("%3d SPWM1: %5d", i, spwm_h1_high_table[i]);
-        spwm_h1_high_table[i] = spwm_h1_high_table[i] - DEAD_TIME - IE_DELAY_COMPENSATION;
-        printf(" : %5d",spwm_h1_high_table[i]);
-        printf(" SPWM2: %5d", spwm_h2_high_table[i]);
-        spwm_h2_high_table[i] = spwm_h2_high_table[i] - DEAD_TIME - IE_DELAY_COMPENSATION;
-        printf(" : %5d\n",spwm_h2_high_table[i]);
-    }
-    
-    //The sync_out_half_duration is the corrected value for half duration of the main signal i.e. The 50Hz
-    uint32_t sync_out_half_duration = ((signal_duration/2)-DEADTIME_COMPENSATION);
-
     printf("Lookup table computation complete....\n");
     
     //-----------------------------------------------------------------------------------
     
     printf("Preparing to start SPWM switching. Setting up PIO....\n");
 
-    PIO pio;
-    uint sm[3];         //Using all 4 SM from same PIO
-    uint offset[3];     //all 4 SM have independent programs to run
+    PIO pio;                        //PIO of SYNC_OUT (& SYNC_IN)
+    PIO leg_pio[SPWM_LEGS_MAX];     //PIO of each leg. All the same one without SPWM_MULTI_PIO.
+    uint sm[SPWM_LEGS_MAX + 2];     //One SM for each leg + one for SYNC_OUT (+ one for SYNC_IN)
+    uint offset[SPWM_LEGS_MAX + 2]; //Program offset of each SM
     float clkdiv = 1.5f;  // (fsys / 1.5) = 150Mhz / 1.5 = 100MHz clk to PIO     
     //Each PIO instruction takes One clk or 1/ 100MHZ = 10ns for execution
 
-    //Array to hold dma channels and their configurations
-    int dma_ch0, dma_ch1, dma_ch2, dma_ch3;
-    dma_channel_config dma_cfg0, dma_cfg1, dma_cfg2, dma_cfg3;
-
     //----------------------------------------------------------------
-    //Setting up the PIO and the first SM in it for H1 half bridge (h1_hi & h1_lo output)
-    // Find a free pio and state machine
-    bool success = pio_claim_free_sm_and_add_program_for_gpio_range(&spwm_h1_program, &pio, &sm[0], &offset[0], PICO2_PIN_GP14, 2, true); 
-    if(!success) {printf("NO PIO or SM for H1 halfbridge..\n");}
-    hard_assert(success);
-    
-    // Configure pio to run the assembley program, and start it, using the helper function in .pio file.
-    spwm_h1_program_init(pio, sm[0], offset[0], clkdiv, PICO2_PIN_GP14, 2); 
-    printf("SPWM Output on pico2 board -> H1_hi:GP%d H1_lo:GP%d\n", PICO2_PIN_GP14, PICO2_PIN_GP15); 
-    
-    //Load the "DEAD_TIME' into ISR PIO,  it will be inserted while changing the hi & lo side swiches
-    pio_sm_clear_fifos (pio, sm[0]);    //Clear TX & RX FIFO
-    pio_sm_put (pio, sm[0], NET_DEADTIME_COUNT);    //Put a 'NET_DEADTIME_COUNT' into TX FIFO
-    pio_sm_exec(pio, sm[0], pio_encode_pull(false, false)); // Pull the count into OSR
-    pio_sm_exec(pio, sm[0], pio_encode_out(pio_isr, 32));   // Copy OSR contents into ISR
-    pio_sm_put (pio, sm[0], h1_sync_count);    //Put synchronization count into TX_FIFO , it is required at startup.
-    //The pio and SM ready but not enabled yet.
+    //Setting up one SM for each leg (hi & lo output of each half bridge)
+    //The spwm_leg program is loaded only once in each PIO (10 of 32 instruction slots, 8 for spwm_leg16). 
+    //All the legs of a PIO run it from same offset.
+    for(uint8_t leg = 0; leg < SPWM_LEGS; leg++){
+        uint pin = spwm_leg_pin[leg];
+        int free_sm = (leg == SPWM_LEG_H1) ? -1 : pio_claim_unused_sm(leg_pio[leg - 1], false);
+        if(free_sm >= 0){
+            //Next SM of the PIO of last leg
+            leg_pio[leg] = leg_pio[leg - 1];
+            sm[leg] = (uint)free_sm;
+            offset[leg] = offset[leg - 1];
+        }else{
+#if !SPWM_MULTI_PIO
+            success = (leg == SPWM_LEG_H1);
+            if(!success) {printf("NO SM for leg %d..\n", leg);}
+            hard_assert(success);
+#endif
+            // Find a free pio and state machine, which can reach all the pins
+            success = pio_claim_free_sm_and_add_program_for_gpio_range(&SPWM_LEG_PROGRAM, &leg_pio[leg], &sm[leg], &offset[leg], 
+                                                                    SPWM_PIN_RANGE_BASE, SPWM_PIN_RANGE_COUNT, true); 
+            if(!success) {printf("NO PIO or SM for leg %d..\n", leg);}
+            hard_assert(success);
+        }
+        PIO leg_pio_now = leg_pio[leg];
+        uint8_t table = SPWM_LEG_TABLE(leg, SPWM_PHASES);
 
-    // Now get and set a DMA channel to assit PIO, panic() if there are none
-    dma_ch0 = dma_claim_unused_channel(true);
-    dma_cfg0 = dma_channel_get_default_config(dma_ch0);
-    configure_dma_for_pio(pio, sm[0], dma_ch0, &dma_cfg0, &spwm_h1_high_table[0]);
-    printf("1st DMA assigned to PIO:SM[0]....\n");
-    
-    //--------------------------------------------
-    //setting up second SM in same PIO for H2 half bridge (h2_hi & H2_lo output)
-    success = pio_claim_free_sm_and_add_program_for_gpio_range(&spwm_h2_program, &pio, &sm[1], &offset[1], PICO2_PIN_GP16, 2, false);
-    if(!success) {printf("NO PIO or SM for H2 halfbridge..\n");}
-    hard_assert(success);
-    
-    // Configure pio to run the assembley program, and start it, using the helper function in .pio file.
-    spwm_h2_program_init(pio, sm[1], offset[1], clkdiv, PICO2_PIN_GP16, 2);
-    printf("SPWM Output on pico2 board -> H2_hi:GP%d H2_lo:GP%d\n", PICO2_PIN_GP16, PICO2_PIN_GP17);
-
-    //Load the "DEAD_TIME'into ISR, to be inserted while changing the state of hi & lo side swiches
-    pio_sm_clear_fifos (pio, sm[1]);    //Clear TX & RX FIFO
-    pio_sm_put (pio, sm[1], NET_DEADTIME_COUNT);    //Put a 'NET_DEADTIME_COUNT' into TX FIFO
-    pio_sm_exec(pio, sm[1], pio_encode_pull(false, false)); // Pull the count into OSR
-    pio_sm_exec(pio, sm[1], pio_encode_out(pio_isr, 32));   // Copy OSR contents into ISR
-    pio_sm_put (pio, sm[1], h2_sync_count);    //Put synchronization count into TX_FIFO , it is required at startup.
-    //The pio and SM ready but not enabled yet.
+        // Configure pio to run the assembley program, using the helper function in .pio file.
+        SPWM_LEG_PROGRAM_INIT(leg_pio_now, sm[leg], offset[leg], clkdiv, pin, 2, GATE_ACTIVE_LOW); 
+        printf("SPWM Output on pico2 board -> Leg%d_hi:GP%d Leg%d_lo:GP%d (PIO%d)\n", leg, pin, leg, pin + 1,
+                pio_get_index(leg_pio_now)); 
 
-    // Now get and set a DMA channel to assit PIO, panic() if there are none
-    dma_ch1 = dma_claim_unused_channel(true);
-    dma_cfg1 = dma_channel_get_default_config(dma_ch1);
-    configure_dma_for_pio(pio, sm[1], dma_ch1, &dma_cfg1, &spwm_h2_high_table[0]);
-    printf("2nd DMA assigned to PIO:SM[1]..\n");
+        //Load the "DEAD_TIME' into ISR PIO,  it will be inserted while changing the hi & lo side swiches
+        pio_sm_clear_fifos (leg_pio_now, sm[leg]);    //Clear TX & RX FIFO
+        pio_sm_put (leg_pio_now, sm[leg], NET_DEADTIME_COUNT);    //Put a 'NET_DEADTIME_COUNT' into TX FIFO
+        pio_sm_exec(leg_pio_now, sm[leg], pio_encode_pull(false, false)); // Pull the count into OSR
+        pio_sm_exec(leg_pio_now, sm[leg], pio_encode_out(pio_isr, 32));   // Copy OSR contents into ISR
+#if SPWM_PACKED_TABLES
+        //Synchronization count is preloaded into lower half of OSR. The SM starts with it (at low_half).
+        //The next out takes the 1st word from DMA through autopull.
+        pio_sm_put (leg_pio_now, sm[leg], (p_bank->sync[table] << 16));
+        pio_sm_exec(leg_pio_now, sm[leg], pio_encode_pull(false, false));   // Pull the count into OSR
+        pio_sm_exec(leg_pio_now, sm[leg], pio_encode_out(pio_null, 16));    // Shift it into lower half. (16 bits left)
+#else
+        pio_sm_put (leg_pio_now, sm[leg], p_bank->sync[table]);    //Put synchronization count into TX_FIFO , it is required at startup.
+#endif
+#if SPWM_STRATEGY == SPWM_STRATEGY_BIPOLAR
+        //H2 plays the table of H1 from its HIGH side, i.e. it is the complement of H1. (same sync)
+        if(leg == SPWM_LEG_H2){
+            pio_sm_exec(leg_pio_now, sm[leg], pio_encode_jmp(offset[leg] + SPWM_LEG_HIGH_HALF));
+        }
+#endif
+#if SPWM_INTERLEAVE > 1
+        //A parallel leg plays the table of the other leg from its HIGH side: H1' = NOT H2 & H2' = NOT H1,
+        //i.e. both legs with the carrier shifted by half its period. (same sync as that table)
+        if(leg >= SPWM_PHASES){
+            pio_sm_exec(leg_pio_now, sm[leg], pio_encode_jmp(offset[leg] + SPWM_LEG_HIGH_HALF));
+        }
+#endif
+        //The pio and SM ready but not enabled yet.
+    }
+    SPWM_PROF_MARK(SPWM_PROF_PIO_SETUP);
+
+    // Now get and set 2 DMA channels (data & re-arm) for each SM, panic() if there are none
+    // The tables in spwm_bank[1] can be refilled & swapped in later without stopping the DMA. (see spwm_update_ma())
+#if SPWM_STREAMING
+    //The rings are refilled by DMA IRQ, a few carrier cycles ahead of DMA (see spwm_stream.cpp)
+    spwm_stream_start(leg_pio[SPWM_LEG_H1], sm);
+    uint32_t stream_overruns = 0;
+#else
+    spwm_swap_init(leg_pio, sm, SPWM_LEGS, spwm_mf, ring_size_bits, &spwm_bank[0], &spwm_bank[1]);
+#endif
+    printf("DMA assigned to PIO:SM of %d legs..\n", SPWM_LEGS);
+    SPWM_PROF_MARK(SPWM_PROF_DMA_SETUP);
     
     //--------------------------------------------
-    //setting up 3rd SM for 50HZ SYNC_OUT
-    success = pio_claim_free_sm_and_add_program_for_gpio_range(&sync_out_program, &pio, &sm[2], &offset[2], SYNC_OUT_50HZ, 1, false);
+    //setting up next SM for 50HZ SYNC_OUT
+    uint sm_sync = SPWM_LEGS;
+    success = pio_claim_free_sm_and_add_program_for_gpio_range(&sync_out_program, &pio, &sm[sm_sync], &offset[sm_sync], SYNC_OUT_50HZ, 1, false);
     
     if(!success) {printf("NO PIO or SM for LED flashing..\n");}
     hard_assert(success);
     printf("50Hz SYNC_OUT on PICO-2: GP %d\n", SYNC_OUT_50HZ);
-    sync_out_program_init(pio, sm[2], offset[2], clkdiv, SYNC_OUT_50HZ, 1);
+    sync_out_program_init(pio, sm[sm_sync], offset[sm_sync], clkdiv, SYNC_OUT_50HZ, 1);
     //The pio and SM ready but not enabled yet.
     
-    //Load the "Duration' required for producing 50HC SYNC_OUT
-    pio_sm_clear_fifos (pio, sm[2]);    //Clear TX & RX FIFO
-    pio_sm_put (pio, sm[2], sync_out_half_duration);    //Put a 'Half Duration of SYNC_OUT' into TX FIFO
-    pio_sm_exec(pio, sm[2], pio_encode_pull(false, false)); // Pull the 'Duration' into OSR
-    pio_sm_exec(pio, sm[2], pio_encode_out(pio_isr, 32));   // Copy OSR contents into ISR
+    //Load the "Duration' required for producing 50HC SYNC_OUT. It is pulled at the start of 1st cycle.
+    pio_sm_clear_fifos (pio, sm[sm_sync]);    //Clear TX & RX FIFO
+    pio_sm_put (pio, sm[sm_sync], sync_out_duration_word(signal_duration));    //Put the 'Duration of SYNC_OUT' into TX FIFO
     //Now PIO and SM can be eanbled to run the assembly program.
+
+#if !SPWM_STREAMING
+    //Each swap pushes the duration of new tables, so SYNC_OUT stays in step with them.
+    if(!spwm_swap_set_sync_out(pio, sm[sm_sync])) {printf("SYNC_OUT keeps the duration of boot tables..\n");}
+#endif
     
-    printf("PIO & SM2 started. No DMA required here...\n");
+    printf("PIO & SM%d started. No DMA required here...\n", sm[sm_sync]);
+    SPWM_PROF_MARK(SPWM_PROF_SYNC_OUT_SETUP);
+
+#if SPWM_SYNC_IN_LOCK
+    //--------------------------------------------
+    //setting up the last SM for SYNC_IN (same PIO, as it watches SYNC_OUT)
+    uint sm_sync_in = sm_sync + 1;
+    int free_sm = pio_claim_unused_sm(pio, false);
+    success = (free_sm >= 0) && pio_can_add_program(pio, &sync_in_program);
+    if(!success) {printf("NO SM or program space for SYNC_IN..\n");}
+    hard_assert(success);
+    sm[sm_sync_in] = (uint)free_sm;
+    offset[sm_sync_in] = pio_add_program(pio, &sync_in_program);
+    sync_in_program_init(pio, sm[sm_sync_in], offset[sm_sync_in], clkdiv, SYNC_OUT_50HZ, SYNC_IN_PIN);
+    spwm_sync_in_start(pio, sm[sm_sync_in]);
+    printf("SYNC_IN on PICO-2: GP %d\n", SYNC_IN_PIN);
+#else
+    uint sm_sync_in = sm_sync;
+#endif
+
+#if SPWM_FAULT_TRIP
+    //--------------------------------------------
+    //setting up a free SM (of any PIO) for FAULT_IN. It is armed before the legs start switching.
+    PIO pio_trip;
+    uint sm_trip, offset_trip;
+    success = pio_claim_free_sm_and_add_program_for_gpio_range(&fault_trip_program, &pio_trip, &sm_trip, &offset_trip, 
+                                                            FAULT_IN_PIN, 1, true);
+    if(!success) {printf("NO PIO or SM for FAULT_IN..\n");}
+    hard_assert(success);
+    fault_trip_program_init(pio_trip, sm_trip, offset_trip, FAULT_IN_PIN, FAULT_ACTIVE_LOW);
+#if SPWM_STREAMING
+    uint32_t trip_dma_mask = spwm_stream_dma_mask();
+#else
+    uint32_t trip_dma_mask = spwm_swap_dma_mask();
+#endif
+    success = spwm_trip_arm(pio_trip, sm_trip, spwm_leg_pin, SPWM_LEGS, trip_dma_mask);
+    if(!success) {printf("Leg pins are too far apart for the trip..\n");}
+    hard_assert(success);
+    printf("FAULT_IN on PICO-2: GP %d\n", FAULT_IN_PIN);
+    bool trip_reported = false;
+#endif
 
     //------------------------------------------------------------------------
 
-    //Noew start all the SM in same PIO synchronusly.
-    pio_enable_sm_mask_in_sync( pio, ( (1 << sm[0]) | (1 << sm[1]) | (1 << sm[2]) ) );  
+    //Noew start all the SM synchronusly. (the SMs of each PIO)
+    uint32_t pio_mask[NUM_PIOS] = {0};
+    for(uint8_t leg = 0; leg < SPWM_LEGS; leg++){
+        pio_mask[pio_get_index(leg_pio[leg])] |= (1u << sm[leg]);
+    }
+    for(uint i = sm_sync; i <= sm_sync_in; i++){
+        pio_mask[pio_get_index(pio)] |= (1u << sm[i]);
+    }
+#if SPWM_SYNC_IN_LOCK
+    //Start in phase with SYNC_IN (if it is present). The phase lock takes care of the rest.
+    if(!spwm_sync_in_wait_edge(SYNC_IN_PIN, 2 * (signal_duration / 100))) {printf("No SYNC_IN edge. Free running..\n");}
+#endif
+#if SPWM_MULTI_PIO
+    //The clock dividers of all the SMs of PIO0, PIO1 & PIO2 are restarted in the same cycle.
+    //(PIO0 is the one before PIO1 & PIO2 the one after it)
+    pio_enable_sm_multi_mask_in_sync(pio1, pio_mask[0], pio_mask[1], pio_mask[2]);
+#else
+    pio_enable_sm_mask_in_sync(pio, pio_mask[pio_get_index(pio)]);  
+#endif
+    SPWM_PROF_MARK(SPWM_PROF_PIO_START);
+#if SPWM_FAST_BOOT
+    boot_start_us = time_us_32();
+    boot_console();
+    boot_report();
+#if !SPWM_USB_LINK
+    bool console_open = false;
+#endif
+#endif
+#if SPWM_USB_LINK
+    link_start(leg_pio, sm);
+    uint16_t idle_passes = 0;
+#endif
+#if SPWM_HEALTH_MONITOR
+    //TX FIFO & DMA of each leg are checked every ms. The counters are printed every few seconds.
+    spwm_health_start(leg_pio, sm, SPWM_LEGS);
+    uint16_t health_passes = 0;
+#if SPWM_HEALTH_LOAD_TEST
+    //Bus load for testing. The stalls must stay 0 under it.
+    if(!spwm_health_load(true)) {printf("NO DMA channel for the load test..\n");}
+#endif
+#endif
+
+#if SPWM_SOFT_START
+    //One step of 'ma' in each fundamental cycle, by swaps. It limits the inrush into the output transformer.
+    //The steps are taken by the idle loop, which runs every ms till the ramp ends. The other changes of the
+    //tables (and core1) wait for it.
+    spwm_ramp_start(SPWM_PHASES, spwm_signal_freq, spwm_mf, spwm_ma, SOFT_START_CYCLES, &spwm_corr);
+    bool ramp_running = true;
+#if !SPWM_USB_LINK
+    uint16_t ramp_passes = 0;
+#endif
+#else
+    const bool ramp_running = false;    //The changes of the tables below never wait
+    (void)ramp_running;
+#endif
+
+#if SPWM_VOLTAGE_LOOP
+    //Output voltage is sampled by DMA in sync with the carrier. One RMS value comes for each fundamental cycle.
+    adc_gpio_init(VOUT_SENSE_PIN);
+    success = spwm_rms_start(VOUT_SENSE_ADC, (uint32_t)(signal_duration * clkdiv), VOUT_SAMPLES_PER_CARRIER, spwm_mf);
+    if(!success) {printf("Voltage sampling is not possible for mf = %d..\n", spwm_mf);}
+    hard_assert(success);
+    spwm_rms_regulator_init(spwm_ma);
+    uint32_t vout_laps = 0;
+    printf("Voltage loop on PICO-2: GP %d (ADC%d), sampling %s (%.2f ppm)\n", VOUT_SENSE_PIN, VOUT_SENSE_ADC,
+            spwm_rms_exact() ? "locked to the carrier" : "approximated", spwm_rms_drift_ppm());
+#endif
+
+#if SPWM_MULTICORE
+    //From now on core1 owns the table generation & swaps. Core0 is free for protection & control loops.
+    if(!ramp_running) {multicore_start();}
+#endif
     
     // press a key to exit. 
     //while (getchar_timeout_us(0) == PICO_ERROR_TIMEOUT) {
     while (true) {
         //pio_sm_put_blocking(pio, sm, 100000000); //OFF period
+#if SPWM_SOFT_START
+        //One step whenever the spare bank is free, i.e. once in each fundamental cycle
+        if(ramp_running && !spwm_ramp_poll()){
+            ramp_running = false;
+            if(!spwm_ramp_reached()) {printf("Soft start stopped before MOD_INDEX_MA..\n");}
+            printf("Soft start: late steps %u of %u\n", spwm_ramp_late(), SOFT_START_CYCLES);
+#if SPWM_MULTICORE
+            multicore_start();
+#endif
+        }
+#endif
+#if SPWM_USB_LINK
+        //The link is served every ms, the rest of this loop every LINK_IDLE_PASSES ms
+        spwm_link_serve();
+        sleep_ms(1);
+        if(++idle_passes < LINK_IDLE_PASSES){
+            continue;
+        }
+        idle_passes = 0;
+#elif SPWM_SOFT_START
+        //Every ms during the ramp. The rest of this loop still every 100 ms.
+        if(ramp_running){
+            sleep_ms(1);
+            if(++ramp_passes < 100){
+                continue;
+            }
+        }else{
+            sleep_ms(100);
+        }
+        ramp_passes = 0;
+#else
         sleep_ms(100);
+#endif
+#if SPWM_SYNC_IN_LOCK
+        //Trim the freq to slew SYNC_OUT (and tables) towards SYNC_IN
+        int32_t phase_error = 0;
+        uint32_t duration = spwm_swap_get_active()->signal_duration;
+        if(!ramp_running && spwm_sync_in_error(duration, &phase_error)){
+            spwm_update_freq(spwm_sync_in_lock(phase_error, duration, SIGNAL_FREQ * SPWM_TRACK_UHZ_PER_HZ));
+        }
+#endif
+#if SPWM_VOLTAGE_LOOP
+        //Trim 'ma' to hold the RMS of output voltage: one regulator step for each cycle completed since the last pass.
+        //A pending swap only delays the new 'ma'.
+        uint32_t vout_rms = 0;
+        bool vout_new = false;
+        double vout_ma = spwm_ma;
+        while(spwm_rms_poll(&vout_rms)){
+            if(!ramp_running){
+                vout_ma = spwm_rms_regulate(vout_rms, VOUT_RMS_TARGET);    //The RMS of the ramp is not regulated
+                vout_new = true;
+            }
+        }
+        if(vout_new){
+            spwm_update_ma(vout_ma);
+#if SPWM_USB_LINK
+            link_vout_rms = vout_rms;
+#endif
+        }
+        if(spwm_rms_laps() != vout_laps){
+            vout_laps = spwm_rms_laps();
+            printf("Voltage samples lost (%u laps of the ring)..\n", vout_laps);
+        }
+#endif
+#if SPWM_FAULT_TRIP
+        //The switching is already stopped by DMA. Only reported here.
+        if(!trip_reported && spwm_trip_tripped()){
+            printf("Fault trip. Leg outputs are OFF till reboot..\n");
+            trip_reported = true;
+        }
+#endif
+#if SPWM_STREAMING
+        //A refill held off for longer than the ring lets DMA play stale words (tripped with SPWM_FAULT_TRIP)
+        if(spwm_stream_overruns() != stream_overruns){
+            stream_overruns = spwm_stream_overruns();
+            printf("Stream overruns: %u%s..\n", stream_overruns, spwm_stream_tripped() ? ", TRIPPED" : "");
+        }
+#endif
+#if SPWM_TABLE_CACHE
+        //New tables are written to flash once they have stayed for a while, a sector or a few pages per pass
+        if(!ramp_running && spwm_cache_service()){
+            spwm_cache_stats_t cache;
+            spwm_cache_get_stats(&cache);
+            printf("Tables cached in flash: hits %u, misses %u, written %u\n", cache.hits, cache.misses, cache.written);
+        }
+#endif
+#if SPWM_HEALTH_MONITOR
+        if(++health_passes >= HEALTH_REPORT_PASSES){
+            health_passes = 0;
+            spwm_health_t health;
+            spwm_health_get(&health);
+            printf("Health: checks %u, skew %u (max %u), bad run %u%s\n", health.checks, health.skewed, health.skew_max,
+                    health.bad_run_max, health.tripped ? ", TRIPPED" : "");
+            for(uint8_t leg = 0; leg < SPWM_LEGS; leg++){
+                printf("  Leg%d: edges %llu, cycles %u, stalls %u, DMA stopped %u\n", leg, health.edges[leg],
+                        health.cycles[leg], health.stalls[leg], health.dma_stopped[leg]);
+            }
+        }
+#endif
+#if SPWM_FAST_BOOT && !SPWM_USB_LINK
+        //The USB console may be opened at any time. It gets the boot report when it is opened.
+        bool console = stdio_usb_connected();
+        if(console && !console_open){
+            boot_report();
+        }
+        console_open = console;
+#endif
+#if SPWM_PROFILE
+        if(getchar_timeout_us(0) == 'p'){
+            spwm_prof_dump();
+        }
+#endif
     }
 
     //Time to stop DMA PIO SM etc and free the resources.
 
-    //Disable DMA
-    channel_config_set_enable (&dma_cfg0, false);
-    channel_config_set_enable (&dma_cfg1, false);
-    printf("DMA Disabled ....\n");
-
     //Disable SM in PIO being used.
     //pio_sm_set_enabled(pio, sm[0], false);
     //pio_sm_set_enabled(pio, sm[0], false);
-    pio_enable_sm_mask_in_sync(pio, ( (0 << sm[0]) | (0 << sm[1]) | (0 << sm[2]) )); // | (0 << sm[3])
+    for(uint i = 0; i < NUM_PIOS; i++){
+        pio_set_sm_mask_enabled(pio_get_instance(i), pio_mask[i], false);
+    }
     printf("PIO Disabled ....\n");
 
     // This will free resources and unload our program
-    pio_remove_program_and_unclaim_sm(&spwm_h1_program, pio, sm[0], offset[0]);
-    pio_remove_program_and_unclaim_sm(&spwm_h2_program, pio, sm[1], offset[1]);
-    pio_remove_program_and_unclaim_sm(&sync_out_program, pio, sm[2], offset[2]);
+    for(uint8_t leg = SPWM_LEGS; leg > 0; leg--){
+        PIO leg_pio_now = leg_pio[leg - 1];
+        if((leg > 1) && (leg_pio[leg - 2] == leg_pio_now)){
+            pio_sm_unclaim(leg_pio_now, sm[leg - 1]);   //Shares the spwm_leg program of the leg before it
+        }else{
+            pio_remove_program_and_unclaim_sm(&SPWM_LEG_PROGRAM, leg_pio_now, sm[leg - 1], offset[leg - 1]);
+        }
+    }
+    pio_remove_program_and_unclaim_sm(&sync_out_program, pio, sm[sm_sync], offset[sm_sync]);
+#if SPWM_SYNC_IN_LOCK
+    pio_remove_program_and_unclaim_sm(&sync_in_program, pio, sm[sm_sync_in], offset[sm_sync_in]);
+#endif
 }//main()
@@ -0,0 +1,130 @@
+#include "spwm_alloc.h"
+
+#if SPWM_QUARTER_TABLES
+//Quarter wave layout of each bank, shared by both legs. No ring is used. (see spwm_swap.cpp)
+static uint32_t spwm_quarter_pool[2][SPWM_QUARTER_WORDS(SPWM_MF_MAX)];
+#else
+//Pool holding all the lookup tables. (SRAM size: see SPWM_MF_MAX)
+//It is aligned to the largest table size, so every power of two sized table inside it can also be aligned.
+static uint32_t __attribute__ ((aligned(SPWM_TABLE_BYTES_MAX))) spwm_table_pool[(SPWM_POOL_TABLES * SPWM_TABLE_BYTES_MAX)/4];
+#endif
+
+#if SPWM_PACKED_TABLES
+//Unpacked tables of 1st phase & its 180 deg phase, used only while a bank is being filled. (not read by DMA)
+static uint32_t spwm_scratch[4 * SPWM_MF_MAX];
+#endif
+
+/**
+ * @brief DMA ring size for a table of (2 * mf) values. (SPWM_TABLE_WORDS(mf) words)
+ *
+ * @returns size_bits for DMA ring (table size in bytes = 1 << size_bits). 0 if table size is not a power of two.
+ */
+uint spwm_ring_size_bits(uint16_t mf){
+    uint32_t table_bytes = SPWM_TABLE_WORDS(mf) * 4;
+    uint ring_size_bits = 0;
+
+    //A power of two has only one bit set
+    if((table_bytes & (table_bytes - 1)) == 0){
+        while((1u << ring_size_bits) < table_bytes){
+            ring_size_bits++;
+        }
+    }
+    return ring_size_bits;
+}
+
+/**
+ * @brief Carves the lookup tables of both banks out of the table pool for the selected mf.
+ *
+ * @param mf    Freq modulation index. Must be a multiple of 4 and not more than SPWM_MF_MAX (set by the build).
+ *
+ * @param legs  Number of legs (tables in each bank). Not more than SPWM_TABLES_MAX.
+ *
+ * @param p_bank_a  Bank to receive the pointers to 1st set of tables.
+ *
+ * @param p_bank_b  Bank to receive the pointers to 2nd set of tables.
+ *
+ * @param p_ring_size_bits  Receives the size_bits for DMA ring (table size in bytes = 1 << size_bits).
+ * It is 0 if the table size is not a power of two.
+ *
+ * @returns false if mf is not supported.
+ *
+ * @note
+ * If the table size in bytes is a power of two (e.g. mf = 64, 128, 256, 512 or 1024) each table is aligned to
+ * its own size and the DMA address wrap-up (ring) is used.
+ *
+ * Otherwise (e.g. mf = 200) tables are only word aligned and the ring is not used. The DMA then relies
+ * only on the re-arm by its control channel at the end of each cycle. (see spwm_swap.cpp)
+ *
+ * With SPWM_QUARTER_TABLES each bank holds one quarter wave layout (SPWM_QUARTER_WORDS(mf) words) shared by 
+ * both legs, and the ring is never used.
+ *
+ * With SPWM_INCREMENTAL_PATCH the pool holds only one bank. The tables of p_bank_b are NULL.
+ */
+bool spwm_alloc_banks(uint16_t mf, uint8_t legs, spwm_bank_t* p_bank_a, spwm_bank_t* p_bank_b, uint* p_ring_size_bits){
+    if( (mf == 0) || ((mf % 4) != 0) || (mf > SPWM_MF_MAX) || (legs > SPWM_TABLES_MAX) ){
+        return false;
+    }
+
+#if SPWM_QUARTER_TABLES
+    //Both legs read the same storage through their own DMA control blocks
+    for(uint8_t leg = 0; leg < legs; leg++){
+        p_bank_a->p_table[leg] = spwm_quarter_pool[0];
+        p_bank_b->p_table[leg] = spwm_quarter_pool[1];
+    }
+    *p_ring_size_bits = 0;
+    return true;
+#else
+    uint32_t table_bytes = SPWM_TABLE_WORDS(mf) * 4;
+    uint ring_size_bits = spwm_ring_size_bits(mf);
+
+    //The pool starts at aligned address. So each table starting at a multiple of its own size is also aligned.
+    uint32_t table_words = table_bytes / 4;
+    for(uint8_t leg = 0; leg < legs; leg++){
+        p_bank_a->p_table[leg] = &spwm_table_pool[leg * table_words];
+#if SPWM_INCREMENTAL_PATCH
+        p_bank_b->p_table[leg] = NULL;     //Never played, as no swap is done
+#else
+        p_bank_b->p_table[leg] = &spwm_table_pool[(legs + leg) * table_words];
+#endif
+    }
+
+    *p_ring_size_bits = ring_size_bits;
+    return true;
+#endif
+}
+
+/**
+ * @brief Fills the tables & sync counts of a bank with the LUT generator, in the format played by DMA.
+ *
+ * @param legs  Number of legs (phases). 2 for the H bridge.
+ *
+ * @returns signal_duration Actual duration of main signal. 0 if the tables could not be filled.
+ * (With SPWM_PACKED_TABLES also when a value does not fit in 16 bits, with SPWM_QUARTER_TABLES if legs is not 2,
+ * with SPWM_FREQ_TRACKING if the tables can not be padded to the target freq)
+ *
+ * @note The bank duration is also updated. Only one bank may be filled at a time. (The packed format uses a 
+ * common scratch area). With SPWM_FREQ_TRACKING the duration includes the pads of spwm_track_apply().
+ */
+uint32_t spwm_fill_bank(spwm_bank_t* p_bank, uint8_t legs, uint8_t signal_freq, uint16_t mf, double ma,
+                        const spwm_corrections_t* p_corr){
+#if SPWM_QUARTER_TABLES
+    if(legs != 2){
+        return 0;
+    }
+    p_bank->signal_duration = spwm_quarter_arrays(signal_freq, mf, ma, p_bank->p_table[SPWM_LEG_H1], 
+                                                &p_bank->sync[SPWM_LEG_H1], &p_bank->sync[SPWM_LEG_H2], p_corr);
+#elif SPWM_PACKED_TABLES
+    p_bank->signal_duration = spwm_packed_phase_arrays(signal_freq, mf, ma, legs, p_bank->p_table, p_bank->sync, 
+                                                        spwm_scratch, p_corr);
+#else
+    p_bank->signal_duration = spwm_phase_arrays(signal_freq, mf, ma, legs, p_bank->p_table, p_bank->sync, p_corr);
+#endif
+    p_bank->track_pad = 0;
+#if SPWM_FREQ_TRACKING
+    //Padded to the target freq, in place of the truncated carrier duration of generator
+    if( (p_bank->signal_duration != 0) && !spwm_track_apply(p_bank, legs, mf, p_corr) ){
+        p_bank->signal_duration = 0;
+    }
+#endif
+    return p_bank->signal_duration;
+}
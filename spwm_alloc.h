@@ -0,0 +1,38 @@
+#ifndef SPWM_ALLOC
+    #define SPWM_ALLOC
+
+    #include "pico/stdlib.h"
+    #include "spwm_lut.h"
+    #include "spwm_swap.h"
+    #include "spwm_track.h"
+    #include "spwm_patch.h"
+
+    //Max freq modulation index supported by the table pool. Pass cmake -DSPWM_MF_MAX=256 (a power of two, as the pool
+    //is aligned to its largest table) for a build whose mf at boot is never more than that.
+    //Typical values of mf are 64, 128, 256, 512 or 1024. Any multiple of 4 upto SPWM_MF_MAX is allowed.
+    //SRAM taken by the tables (SPWM_POOL_TABLES = 6 tables of SPWM_TABLE_WORDS(SPWM_MF_MAX) words):
+    //  SPWM_MF_MAX   1024    512    256    128     64
+    //  unpacked     48 KB  24 KB  12 KB   6 KB   3 KB
+    //  packed       24 KB  12 KB   6 KB   3 KB 1.5 KB  (+ scratch of 4 x SPWM_MF_MAX words, e.g. 16 KB at 1024)
+    //(SPWM_INCREMENTAL_PATCH halves the pool. SPWM_QUARTER_TABLES takes 2 x (SPWM_MF_MAX + 3) words in place of it)
+    #ifndef SPWM_MF_MAX
+        #define SPWM_MF_MAX 1024
+    #endif
+    static_assert((SPWM_MF_MAX >= 4) && ((SPWM_MF_MAX & (SPWM_MF_MAX - 1)) == 0), "SPWM_MF_MAX must be a power of two");
+
+    //Number of tables in the pool = 2 banks x SPWM_TABLES_MAX tables (the parallel legs of SPWM_INTERLEAVE have none)
+    //(SPWM_INCREMENTAL_PATCH: only one bank, which is patched in place)
+    #if SPWM_INCREMENTAL_PATCH
+        #define SPWM_POOL_TABLES SPWM_TABLES_MAX
+    #else
+        #define SPWM_POOL_TABLES (2 * SPWM_TABLES_MAX)
+    #endif
+
+    //Size of largest table in bytes (= SPWM_TABLE_WORDS(SPWM_MF_MAX) words of 4 bytes each). It is a power of two.
+    #define SPWM_TABLE_BYTES_MAX (SPWM_TABLE_WORDS(SPWM_MF_MAX) * 4)
+
+    uint spwm_ring_size_bits(uint16_t mf);
+    bool spwm_alloc_banks(uint16_t mf, uint8_t legs, spwm_bank_t* p_bank_a, spwm_bank_t* p_bank_b, uint* p_ring_size_bits);
+    uint32_t spwm_fill_bank(spwm_bank_t* p_bank, uint8_t legs, uint8_t signal_freq, uint16_t mf, double ma,
+                            const spwm_corrections_t* p_corr);
+#endif
@@ -0,0 +1,450 @@
+#include <string.h>
+#include "pico/flash.h"
+#include "hardware/regs/addressmap.h"
+#include "spwm_cache.h"
+
+#define CACHE_MAGIC 0x53504D43          //"SPMC"
+
+#define CACHE_STR2(x) #x
+#define CACHE_STR(x) CACHE_STR2(x)
+
+/// Header page of an entry. It is programmed last, so an entry is valid only when all its tables are in flash.
+typedef struct {
+    uint32_t magic;
+    spwm_cache_key_t key;
+    uint32_t sequence;                  //Order of the writes (the oldest entry is replaced)
+    uint32_t tables;                    //Tables stored (legs, or 1 shared quarter wave layout)
+    uint32_t table_words;               //Words of each table
+    uint32_t sync[SPWM_TABLES_MAX];
+    uint32_t signal_duration;
+    uint32_t table_sum;                 //Checksum of the tables (see words_sum())
+    uint32_t check;                     //Checksum of the words above
+} cache_header_t;
+
+static_assert(sizeof(cache_header_t) <= SPWM_CACHE_TABLE_OFFSET, "Header of an entry must fit in its page");
+
+/// One flash operation done by flash_safe_execute()
+typedef struct {
+    uint32_t offset;                    //Offset in flash
+    const uint8_t* p_page;              //Page to be programmed. NULL to erase the sector.
+} cache_flash_op_t;
+
+extern char __flash_binary_end;         //End of the firmware in flash (linker script)
+
+/**
+ * @brief FNV-1a hash of a text.
+ */
+static constexpr uint32_t fnv1a(const char* p_text, uint32_t hash = 0x811C9DC5u){
+    return (*p_text == 0) ? hash : fnv1a(p_text + 1, (hash ^ (uint8_t)*p_text) * 0x01000193u);
+}
+
+//Options which change the tables (or the layout of the slots). (see probe_version())
+static constexpr uint32_t cache_options = fnv1a(CACHE_STR(SPWM_CACHE_GEN_VERSION) " " CACHE_STR(SPWM_PACKED_TABLES) " "
+                                                CACHE_STR(SPWM_QUARTER_TABLES) " " CACHE_STR(SPWM_STRATEGY) " "
+                                                CACHE_STR(SPWM_SAMPLING) " " CACHE_STR(SPWM_EDGE_DITHER) " "
+                                                CACHE_STR(SPWM_SINE_FIXED_POINT) " " CACHE_STR(SPWM_CROSSING_SOLVER) " "
+                                                CACHE_STR(SPWM_MF_MAX));
+
+//Probe tables computed by spwm_cache_init(), whose hash is the version of the generator. (Multiple of 4 & 3 for
+//all the layouts, and upto 16 bit values for the packed tables at 50Hz) The min pulse makes some pulses short.
+#define CACHE_PROBE_FREQ 50
+#define CACHE_PROBE_MF 36
+#define CACHE_PROBE_MA (0.95 * SPWM_MA_LIMIT)
+#define CACHE_PROBE_MIN_PULSE 2000
+#define CACHE_PROBE_PHASES ((SPWM_STRATEGY == SPWM_STRATEGY_MIN_MAX) ? 3 : 2)
+
+static uint32_t cache_version = 0;      //Hash of the options & the probe tables
+static uint32_t probe_table[SPWM_TABLES_MAX][2 * CACHE_PROBE_MF];
+#if SPWM_PACKED_TABLES
+static uint32_t probe_scratch[4 * CACHE_PROBE_MF];
+#endif
+
+static bool cache_ready = false;
+static int cache_dma_ch = -1;           //Copies the tables from XIP into the bank
+static uint32_t cache_sequence = 0;     //Sequence of the newest entry
+static spwm_cache_stats_t cache_stats;
+
+//Entry being written by spwm_cache_service()
+static bool write_pending = false;
+static cache_header_t write_header;
+static const uint32_t* p_write_table[SPWM_TABLES_MAX];   //Tables of the bank (played by DMA meanwhile)
+static uint8_t write_slot = 0;
+static uint32_t write_step = 0;         //Sectors erased + pages programmed
+static uint32_t write_sectors = 0;      //Sectors of the entry
+static uint32_t write_pages = 0;        //Pages of each table
+static absolute_time_t write_after;     //End of SPWM_CACHE_HOLD_MS
+static uint32_t write_page[FLASH_PAGE_SIZE / 4];
+
+/**
+ * @brief Header of a slot, read through XIP.
+ */
+static const cache_header_t* slot_header(uint8_t slot){
+    return (const cache_header_t*)(XIP_BASE + SPWM_CACHE_FLASH_OFFSET + (slot * SPWM_CACHE_SLOT_BYTES));
+}
+
+/**
+ * @brief Table of a slot, read through XIP.
+ */
+static const uint32_t* slot_table(uint8_t slot, uint8_t table){
+    return (const uint32_t*)((const uint8_t*)slot_header(slot) + SPWM_CACHE_TABLE_OFFSET +
+                             (table * SPWM_TABLE_BYTES_MAX));
+}
+
+/**
+ * @brief Rotate & add checksum of some words. (position dependent)
+ */
+static uint32_t words_sum(const uint32_t* p_words, uint32_t count, uint32_t sum){
+    for(uint32_t i = 0; i < count; i++){
+        sum = ((sum << 5) | (sum >> 27)) + p_words[i];
+    }
+    return sum;
+}
+
+static uint32_t header_check(const cache_header_t* p_header){
+    return words_sum((const uint32_t*)p_header, offsetof(cache_header_t, check) / 4, CACHE_MAGIC);
+}
+
+static bool header_valid(const cache_header_t* p_header){
+    return (p_header->magic == CACHE_MAGIC) && (p_header->check == header_check(p_header));
+}
+
+/**
+ * @brief FNV-1a hash of some bytes.
+ */
+static uint32_t fnv1a_bytes(const void* p_data, uint32_t count, uint32_t hash){
+    const uint8_t* p_byte = (const uint8_t*)p_data;
+    for(uint32_t i = 0; i < count; i++){
+        hash = (hash ^ p_byte[i]) * 0x01000193u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Version of the entries: the hash of the options & of the probe tables, computed by this generator in the
+ * layout of this build, in both short pulse modes. Any change of the generator which changes these tables gives
+ * a new version, so a new firmware never plays the tables of an older one, even if SPWM_CACHE_GEN_VERSION is not
+ * bumped. A rebuild of the same generator keeps the cache.
+ */
+static uint32_t probe_version(void){
+    uint32_t* p_tables[SPWM_TABLES_MAX];
+    uint32_t syncs[SPWM_TABLES_MAX] = {};
+    for(uint8_t table = 0; table < SPWM_TABLES_MAX; table++){
+        p_tables[table] = probe_table[table];
+    }
+    uint32_t version = cache_options;
+    for(uint8_t mode = SPWM_PULSE_STRETCH; mode <= SPWM_PULSE_DROP; mode++){
+        const spwm_corrections_t corr = {50, 3, CACHE_PROBE_MIN_PULSE, mode};
+        memset(probe_table, 0, sizeof(probe_table));
+#if SPWM_QUARTER_TABLES
+        uint32_t duration = spwm_quarter_arrays(CACHE_PROBE_FREQ, CACHE_PROBE_MF, CACHE_PROBE_MA, probe_table[0],
+                                                &syncs[0], &syncs[1], &corr);
+#elif SPWM_PACKED_TABLES
+        uint32_t duration = spwm_packed_phase_arrays(CACHE_PROBE_FREQ, CACHE_PROBE_MF, CACHE_PROBE_MA,
+                                                     CACHE_PROBE_PHASES, p_tables, syncs, probe_scratch, &corr);
+#else
+        uint32_t duration = spwm_phase_arrays(CACHE_PROBE_FREQ, CACHE_PROBE_MF, CACHE_PROBE_MA, CACHE_PROBE_PHASES,
+                                              p_tables, syncs, &corr);
+#endif
+        version = fnv1a_bytes(&duration, sizeof(duration), version);
+        version = fnv1a_bytes(syncs, sizeof(syncs), version);
+        version = fnv1a_bytes(probe_table, sizeof(probe_table), version);
+    }
+    return version;
+}
+
+/**
+ * @brief Tables of a bank & their length, in the format played by DMA.
+ */
+static void bank_layout(uint8_t legs, uint16_t mf, uint8_t* p_tables, uint32_t* p_words){
+#if SPWM_QUARTER_TABLES
+    (void)legs;
+    *p_tables = 1;          //Shared by both legs
+    *p_words = SPWM_QUARTER_WORDS(mf);
+#else
+    *p_tables = legs;
+    *p_words = SPWM_TABLE_WORDS(mf);
+#endif
+}
+
+static void make_key(spwm_cache_key_t* p_key, uint8_t legs, uint8_t signal_freq, uint16_t mf, double ma,
+                    const spwm_corrections_t* p_corr){
+    memset(p_key, 0, sizeof(*p_key));
+    p_key->mf = mf;
+    p_key->signal_freq = signal_freq;
+    p_key->legs = legs;
+    memcpy(p_key->ma, &ma, sizeof(p_key->ma));
+    if(p_corr != NULL){
+        p_key->dead_time = p_corr->dead_time;
+        p_key->pio_overhead = p_corr->pio_overhead;
+        p_key->min_pulse = p_corr->min_pulse;
+        p_key->short_pulse_mode = p_corr->short_pulse_mode;
+    }
+    //The corrections are hashed field by field (the struct has padding)
+    uint32_t version = cache_version;
+    version = fnv1a_bytes(&p_key->dead_time, sizeof(p_key->dead_time), version);
+    version = fnv1a_bytes(&p_key->pio_overhead, sizeof(p_key->pio_overhead), version);
+    version = fnv1a_bytes(&p_key->min_pulse, sizeof(p_key->min_pulse), version);
+    version = fnv1a_bytes(&p_key->short_pulse_mode, sizeof(p_key->short_pulse_mode), version);
+    p_key->version = version;
+}
+
+/**
+ * @returns Slot holding the tables of the key. -1 if none.
+ */
+static int find_slot(const spwm_cache_key_t* p_key){
+    for(uint8_t slot = 0; slot < SPWM_CACHE_SLOTS; slot++){
+        const cache_header_t* p_header = slot_header(slot);
+        if(header_valid(p_header) && (memcmp(&p_header->key, p_key, sizeof(*p_key)) == 0)){
+            return slot;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @returns An empty slot, else the one with the oldest entry.
+ */
+static uint8_t free_slot(void){
+    uint8_t oldest = 0;
+    uint32_t oldest_sequence = UINT32_MAX;
+    for(uint8_t slot = 0; slot < SPWM_CACHE_SLOTS; slot++){
+        const cache_header_t* p_header = slot_header(slot);
+        if(!header_valid(p_header)){
+            return slot;
+        }
+        if(p_header->sequence < oldest_sequence){
+            oldest_sequence = p_header->sequence;
+            oldest = slot;
+        }
+    }
+    return oldest;
+}
+
+/**
+ * @brief Copies one table from flash (XIP) into SRAM by DMA.
+ */
+static void copy_table(uint32_t* p_dst, const uint32_t* p_src, uint32_t words){
+    dma_channel_config cfg = dma_channel_get_default_config(cache_dma_ch);
+    channel_config_set_transfer_data_size(&cfg, DMA_SIZE_32);
+    channel_config_set_read_increment(&cfg, true);
+    channel_config_set_write_increment(&cfg, true);
+    dma_channel_configure(cache_dma_ch, &cfg, p_dst, p_src, words, true);
+    dma_channel_wait_for_finish_blocking(cache_dma_ch);
+}
+
+static void flash_op(void* p_param){
+    const cache_flash_op_t* p_op = (const cache_flash_op_t*)p_param;
+    if(p_op->p_page == NULL){
+        flash_range_erase(p_op->offset, FLASH_SECTOR_SIZE);
+    }else{
+        flash_range_program(p_op->offset, p_op->p_page, FLASH_PAGE_SIZE);
+    }
+}
+
+/**
+ * @brief Erases one sector (p_page = NULL) or programs one page, with the IRQs (and the other core) held off.
+ * DMA & PIO keep playing the tables from SRAM meanwhile.
+ */
+static bool cache_flash(uint32_t offset, const void* p_page){
+    cache_flash_op_t op = {offset, (const uint8_t*)p_page};
+    return flash_safe_execute(flash_op, &op, UINT32_MAX) == PICO_OK;
+}
+
+/**
+ * @brief Queues the tables of a bank just computed, to be written once they have stayed for SPWM_CACHE_HOLD_MS.
+ *
+ * @param slot  Slot for the entry (a damaged one with the same key). -1 for a free (or the oldest) slot.
+ */
+static void queue_write(const spwm_bank_t* p_bank, const spwm_cache_key_t* p_key, uint8_t tables, uint32_t words,
+                        int slot){
+    memset(&write_header, 0, sizeof(write_header));
+    write_header.magic = CACHE_MAGIC;
+    write_header.key = *p_key;
+    write_header.sequence = cache_sequence + 1;
+    write_header.tables = tables;
+    write_header.table_words = words;
+    for(uint8_t leg = 0; leg < SPWM_TABLES_MAX; leg++){
+        write_header.sync[leg] = p_bank->sync[leg];
+    }
+    write_header.signal_duration = p_bank->signal_duration;
+    for(uint8_t table = 0; table < tables; table++){
+        p_write_table[table] = p_bank->p_table[table];
+        write_header.table_sum = words_sum(p_bank->p_table[table], words, write_header.table_sum);
+    }
+    write_header.check = header_check(&write_header);
+
+    write_slot = (slot >= 0) ? (uint8_t)slot : free_slot();
+    write_sectors = (SPWM_CACHE_TABLE_OFFSET + ((tables - 1) * SPWM_TABLE_BYTES_MAX) + (words * 4) +
+                     FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE;
+    write_pages = ((words * 4) + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE;
+    write_step = 0;
+    write_after = make_timeout_time_ms(SPWM_CACHE_HOLD_MS);
+    write_pending = true;
+}
+
+static void write_cancel(void){
+    write_pending = false;
+    cache_stats.cancelled++;
+}
+
+/**
+ * @brief Finds the newest entry, claims the DMA channel for the copies & computes the version of the entries from
+ * the probe tables. (see probe_version())
+ *
+ * @returns false if the entries would overlap the firmware or no DMA channel is free.
+ * spwm_cache_fill_bank() then only computes the tables.
+ *
+ * @note Call once at boot, before the first spwm_cache_fill_bank().
+ */
+bool spwm_cache_init(void){
+    if( ((uintptr_t)&__flash_binary_end - XIP_BASE) > SPWM_CACHE_FLASH_OFFSET ){
+        return false;
+    }
+    cache_dma_ch = dma_claim_unused_channel(false);
+    if(cache_dma_ch < 0){
+        return false;
+    }
+    cache_version = probe_version();
+    for(uint8_t slot = 0; slot < SPWM_CACHE_SLOTS; slot++){
+        const cache_header_t* p_header = slot_header(slot);
+        if(header_valid(p_header) && (p_header->sequence > cache_sequence)){
+            cache_sequence = p_header->sequence;
+        }
+    }
+    cache_ready = true;
+    return true;
+}
+
+/**
+ * @brief Fills the tables & sync counts of a bank from the cache in flash, else with spwm_fill_bank().
+ *
+ * The tables of a hit are copied by DMA straight from flash (XIP) into the bank, with no computation.
+ * The tables of a miss are queued to be written to flash by spwm_cache_service().
+ *
+ * @returns signal_duration Same as spwm_fill_bank().
+ *
+ * @note Same parameters as spwm_fill_bank(). Only from core0. A write still queued from the tables of this
+ * bank is given up, as they are overwritten now.
+ */
+uint32_t spwm_cache_fill_bank(spwm_bank_t* p_bank, uint8_t legs, uint8_t signal_freq, uint16_t mf, double ma,
+                            const spwm_corrections_t* p_corr){
+    if(write_pending && (p_write_table[0] == p_bank->p_table[0])){
+        write_cancel();
+    }
+    if(!cache_ready){
+        return spwm_fill_bank(p_bank, legs, signal_freq, mf, ma, p_corr);
+    }
+
+    spwm_cache_key_t key;
+    make_key(&key, legs, signal_freq, mf, ma, p_corr);
+    uint8_t tables = 0;
+    uint32_t words = 0;
+    bank_layout(legs, mf, &tables, &words);
+
+    int slot = find_slot(&key);
+    if(slot >= 0){
+        const cache_header_t* p_header = slot_header((uint8_t)slot);
+        if( (p_header->tables == tables) && (p_header->table_words == words) ){
+            uint32_t sum = 0;
+            for(uint8_t table = 0; table < tables; table++){
+                copy_table(p_bank->p_table[table], slot_table((uint8_t)slot, table), words);
+                sum = words_sum(p_bank->p_table[table], words, sum);
+            }
+            if(sum == p_header->table_sum){
+                for(uint8_t leg = 0; leg < SPWM_TABLES_MAX; leg++){
+                    p_bank->sync[leg] = p_header->sync[leg];
+                }
+                p_bank->signal_duration = p_header->signal_duration;
+                p_bank->track_pad = 0;
+                cache_stats.hits++;
+                return p_bank->signal_duration;
+            }
+        }
+        //A damaged entry is computed again & written over
+    }
+
+    cache_stats.misses++;
+    uint32_t signal_duration = spwm_fill_bank(p_bank, legs, signal_freq, mf, ma, p_corr);
+    if(signal_duration != 0){
+        queue_write(p_bank, &key, tables, words, slot);
+    }
+    return signal_duration;
+}
+
+/**
+ * @brief Writes the queued entry to flash, a little in each call. Call from the idle loop.
+ *
+ * Nothing is done till the queued tables have stayed for SPWM_CACHE_HOLD_MS. Then each call erases one sector
+ * or programs upto SPWM_CACHE_PAGES_PER_SERVICE pages. The header page is programmed last, only if the tables
+ * read back from flash are the queued ones.
+ *
+ * @returns true when an entry has been written.
+ *
+ * @note An erase holds off the IRQs (and core1) for the erase time of a sector (SPWM_CACHE_ERASE_MS). The tables
+ * are still played by DMA & PIO meanwhile, as the swaps, the fault trip & the ADC sampling take no IRQ.
+ * The builds with an IRQ of their own (health & trip checks, streaming) are refused by main.cpp.
+ */
+bool spwm_cache_service(void){
+    if(!write_pending || !time_reached(write_after)){
+        return false;
+    }
+    uint32_t slot_offset = SPWM_CACHE_FLASH_OFFSET + (write_slot * SPWM_CACHE_SLOT_BYTES);
+
+    //The old entry of the slot is gone with its 1st sector
+    if(write_step < write_sectors){
+        if(!cache_flash(slot_offset + (write_step * FLASH_SECTOR_SIZE), NULL)){
+            write_cancel();
+            return false;
+        }
+        write_step++;
+        return false;
+    }
+
+    uint32_t pages = write_header.tables * write_pages;
+    for(uint8_t count = 0; (count < SPWM_CACHE_PAGES_PER_SERVICE) && ((write_step - write_sectors) < pages); count++){
+        uint32_t page = write_step - write_sectors;
+        uint32_t table = page / write_pages;
+        uint32_t first = (page % write_pages) * (FLASH_PAGE_SIZE / 4);
+        uint32_t words = write_header.table_words - first;
+        if(words > (FLASH_PAGE_SIZE / 4)){
+            words = FLASH_PAGE_SIZE / 4;
+        }
+        memset(write_page, 0xFF, sizeof(write_page));
+        memcpy(write_page, p_write_table[table] + first, words * 4);
+        if(!cache_flash(slot_offset + SPWM_CACHE_TABLE_OFFSET + (table * SPWM_TABLE_BYTES_MAX) + (first * 4),
+                        write_page)){
+            write_cancel();
+            return false;
+        }
+        write_step++;
+    }
+    if((write_step - write_sectors) < pages){
+        return false;
+    }
+
+    uint32_t sum = 0;
+    for(uint8_t table = 0; table < write_header.tables; table++){
+        sum = words_sum(slot_table(write_slot, table), write_header.table_words, sum);
+    }
+    if(sum != write_header.table_sum){
+        write_cancel();
+        return false;
+    }
+    memset(write_page, 0xFF, sizeof(write_page));
+    memcpy(write_page, &write_header, sizeof(write_header));
+    write_pending = false;
+    if(!cache_flash(slot_offset, write_page)){
+        cache_stats.cancelled++;
+        return false;
+    }
+    cache_sequence = write_header.sequence;
+    cache_stats.written++;
+    return true;
+}
+
+/**
+ * @brief Copy of the counters.
+ */
+void spwm_cache_get_stats(spwm_cache_stats_t* p_stats){
+    *p_stats = cache_stats;
+}
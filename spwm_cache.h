@@ -0,0 +1,65 @@
+#ifndef SPWM_CACHE
+    #define SPWM_CACHE
+
+    #include "pico/stdlib.h"
+    #include "hardware/flash.h"
+    #include "spwm_lut.h"
+    #include "spwm_swap.h"
+    #include "spwm_alloc.h"
+
+    //Part of the version of the entries, with the hash of the probe tables computed at boot. (see probe_version()
+    //in spwm_cache.cpp) A change of the generator is caught by the probe tables. Bump this for a change which
+    //they do not show, e.g. a change at an operating point far from the probe.
+    #define SPWM_CACHE_GEN_VERSION 1
+
+    //Number of entries (operating points) kept in flash. The oldest one is replaced by a new one.
+    #ifndef SPWM_CACHE_SLOTS
+        #define SPWM_CACHE_SLOTS 8
+    #endif
+
+    //One entry: a header page & upto SPWM_TABLES_MAX tables, each at its own fixed offset. (whole sectors)
+    #define SPWM_CACHE_TABLE_OFFSET FLASH_PAGE_SIZE
+    #define SPWM_CACHE_SLOT_BYTES ((((SPWM_CACHE_TABLE_OFFSET + (SPWM_TABLES_MAX * SPWM_TABLE_BYTES_MAX)) + \
+                                    FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE) * FLASH_SECTOR_SIZE)
+
+    //The entries are kept at the end of flash, after the firmware. (checked by spwm_cache_init())
+    #define SPWM_CACHE_FLASH_BYTES (SPWM_CACHE_SLOTS * SPWM_CACHE_SLOT_BYTES)
+    #define SPWM_CACHE_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - SPWM_CACHE_FLASH_BYTES)
+
+    //Time for which the tables of a new operating point must stay in use before they are written to flash.
+    //A setpoint which keeps moving (e.g. the voltage loop) is not written, so the flash is not worn out.
+    #define SPWM_CACHE_HOLD_MS 5000
+
+    //Typical erase time of one flash sector, for which the IRQs are held off. (see spwm_cache_service())
+    #define SPWM_CACHE_ERASE_MS 50
+
+    //Flash pages programmed in one call of spwm_cache_service(). (One sector is erased in a call of its own)
+    #define SPWM_CACHE_PAGES_PER_SERVICE 16
+
+    /// Parameters of the tables in an entry (they are stored only if all match)
+    typedef struct {
+        uint32_t version;           //Hash of the table options, the probe tables & the corrections
+        uint16_t mf;
+        uint8_t signal_freq;
+        uint8_t legs;
+        uint32_t ma[2];             //Bits of the double 'ma'
+        uint32_t dead_time;         //spwm_corrections_t
+        uint32_t pio_overhead;
+        uint32_t min_pulse;
+        uint32_t short_pulse_mode;
+    } spwm_cache_key_t;
+
+    /// Counters of the cache (see spwm_cache_get_stats())
+    typedef struct {
+        uint32_t hits;              //Tables copied from flash
+        uint32_t misses;            //Tables computed
+        uint32_t written;           //Entries written to flash
+        uint32_t cancelled;         //Writes given up, as their tables were replaced before the write was over
+    } spwm_cache_stats_t;
+
+    bool spwm_cache_init(void);
+    uint32_t spwm_cache_fill_bank(spwm_bank_t* p_bank, uint8_t legs, uint8_t signal_freq, uint16_t mf, double ma,
+                                const spwm_corrections_t* p_corr);
+    bool spwm_cache_service(void);
+    void spwm_cache_get_stats(spwm_cache_stats_t* p_stats);
+#endif
@@ -0,0 +1,162 @@
+#include "pico/multicore.h"
+#include "spwm_core1.h"
+#include "spwm_swap.h"
+#include "spwm_alloc.h"
+
+static uint16_t core1_mf = 0;                           //mf of the tables being played (fixed at boot)
+static uint8_t core1_phases = 0;                        //Number of legs (2 for H bridge, 3 for 3 phase)
+static const spwm_corrections_t* p_core1_corr = NULL;   //Corrections applied to the tables
+
+static volatile uint32_t core1_published = 0;    //Number of tables published by core1
+static volatile uint32_t core1_rejected = 0;     //Number of setpoints which could not be played
+
+/**
+ * @brief Takes the latest setpoint from the inter-core FIFO. Waits if there is none.
+ *
+ * Older setpoints still waiting in the FIFO are skipped, as only the latest one is of interest.
+ * A retrim never replaces a setpoint, as the new tables are padded for the present target freq anyway.
+ */
+static uint32_t pop_latest_setpoint(void){
+    uint32_t setpoint = multicore_fifo_pop_blocking();
+    uint32_t next = 0;
+    while(multicore_fifo_rvalid()){
+        next = multicore_fifo_pop_blocking();
+        if( (next != SPWM_SETPOINT_RETRIM) || (setpoint == SPWM_SETPOINT_RETRIM) ){
+            setpoint = next;
+        }
+    }
+    return setpoint;
+}
+
+/**
+ * @brief Table generation loop running on core1.
+ *
+ * For each setpoint the corrected tables are computed into the spare bank and published for the swap at 
+ * the start of next fundamental cycle. (see spwm_swap.cpp)
+ */
+static void core1_main(void){
+    uint32_t setpoint = 0;
+    uint8_t signal_freq = 0;
+    uint16_t mf = 0;
+    double ma = 0;
+    spwm_bank_t* p_bank = NULL;
+
+    while(true){
+        setpoint = pop_latest_setpoint();
+
+        //Wait till the last published bank is picked by DMA
+        while((p_bank = spwm_swap_get_spare()) == NULL){
+            tight_loop_contents();
+        }
+
+        //A newer setpoint might have come while waiting
+        if(multicore_fifo_rvalid()){
+            setpoint = pop_latest_setpoint();
+        }
+
+#if SPWM_FREQ_TRACKING
+        //Only the pads of present tables are changed for the new target freq
+        if(setpoint == SPWM_SETPOINT_RETRIM){
+            if(spwm_track_retrim(core1_phases, core1_mf, p_core1_corr)){
+                core1_published++;
+            }else{
+                core1_rejected++;
+            }
+            continue;
+        }
+#endif
+
+        signal_freq = (uint8_t)(setpoint & 0xFF);
+        mf = (uint16_t)((((setpoint >> 8) & 0xFF) + 1) * 4);
+        ma = (double)(setpoint >> 16) / SPWM_SETPOINT_MA_ONE;
+
+        //The table length & DMA ring are fixed at boot. (see spwm_alloc.cpp)
+        if(mf != core1_mf){
+            core1_rejected++;
+            continue;
+        }
+
+        if((spwm_fill_bank(p_bank, core1_phases, signal_freq, mf, ma, p_core1_corr) == 0) || !spwm_swap_publish()){
+            core1_rejected++;
+            continue;
+        }
+        core1_published++;
+    }
+}
+
+/**
+ * @brief Starts core1 as the owner of table generation.
+ *
+ * @param mf    Freq modulation index of the tables being played. Setpoints with other mf are rejected.
+ * @param phases    Number of legs played. (2 for the H bridge, 3 for a 3 phase inverter)
+ * @param p_corr    Corrections for the PIO program, applied to every table. It must stay valid.
+ *
+ * @note
+ * Call after spwm_swap_init(). Thereafter only core1 may use spwm_swap_get_spare() & spwm_swap_publish().
+ * Core0 sends the setpoints with spwm_core1_request().
+ */
+void spwm_core1_start(uint16_t mf, uint8_t phases, const spwm_corrections_t* p_corr){
+    core1_mf = mf;
+    core1_phases = phases;
+    p_core1_corr = p_corr;
+    multicore_launch_core1(core1_main);
+}
+
+/**
+ * @brief Sends a new setpoint to core1. It never waits.
+ *
+ * @param signal_freq   Signal frequency. (e.g. 50 or 60Hz)
+ * @param mf    Freq modulation index. Must be same as the one given to spwm_core1_start().
+ * @param ma    Amplitude modulation index. 0 upto SPWM_MA_LIMIT of the strategy (not included). (Resolution is
+ * 1 / 32768)
+ *
+ * @returns false if the inter-core FIFO is full (try again later) or ma is out of range.
+ *
+ * @note
+ * The tables are played from start of the next fundamental cycle after core1 has computed them. 
+ * If setpoints come faster than that, core1 skips to the latest one.
+ */
+bool spwm_core1_request(uint8_t signal_freq, uint16_t mf, double ma){
+    if( (ma < 0) || (ma >= SPWM_MA_LIMIT) ){
+        return false;
+    }
+    if(!multicore_fifo_wready()){
+        return false;
+    }
+    multicore_fifo_push_blocking(spwm_setpoint_encode(signal_freq, mf, ma));
+    return true;
+}
+
+/**
+ * @brief Asks core1 to replay the present tables at the target freq of spwm_track_set_freq(). It never waits.
+ *
+ * @returns false if the inter-core FIFO is full (try again later) or SPWM_FREQ_TRACKING is not set.
+ *
+ * @note
+ * The tables are not computed again, only their pads are changed. (see spwm_track_retrim())
+ */
+bool spwm_core1_retrim(void){
+#if SPWM_FREQ_TRACKING
+    if(!multicore_fifo_wready()){
+        return false;
+    }
+    multicore_fifo_push_blocking(SPWM_SETPOINT_RETRIM);
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Number of tables computed & published by core1 since start.
+ */
+uint32_t spwm_core1_published(void){
+    return core1_published;
+}
+
+/**
+ * @brief Number of setpoints core1 could not play (unsupported mf or failed table generation).
+ */
+uint32_t spwm_core1_rejected(void){
+    return core1_rejected;
+}
@@ -0,0 +1,21 @@
+#ifndef SPWM_CORE1
+    #define SPWM_CORE1
+
+    #include "pico/stdlib.h"
+    #include "spwm_lut.h"
+
+    //A setpoint is sent to core1 as one 32 bit word through the inter-core FIFO, so it can never be split.
+    //[7:0] signal_freq, [15:8] (mf / 4) - 1, [31:16] ma in Q1.15 format (upto 1.99997, for SPWM_MA_LIMIT of min-max)
+    #define SPWM_SETPOINT_MA_ONE 32768   //ma = 1.0 in Q1.15 format
+    #define SPWM_SETPOINT_RETRIM 0       //Not a setpoint (signal_freq = 0). Retrim the present tables (spwm_track_retrim())
+
+    constexpr uint32_t spwm_setpoint_encode(uint8_t signal_freq, uint16_t mf, double ma){
+        return ((uint32_t)(ma * SPWM_SETPOINT_MA_ONE) << 16) | ((uint32_t)((mf / 4) - 1) << 8) | signal_freq;
+    }
+
+    void spwm_core1_start(uint16_t mf, uint8_t phases, const spwm_corrections_t* p_corr);
+    bool spwm_core1_request(uint8_t signal_freq, uint16_t mf, double ma);
+    bool spwm_core1_retrim(void);
+    uint32_t spwm_core1_published(void);
+    uint32_t spwm_core1_rejected(void);
+#endif
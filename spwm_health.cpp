@@ -0,0 +1,173 @@
+#include "hardware/structs/dma_debug.h"
+#include "spwm_health.h"
+#if SPWM_FAULT_TRIP
+    #include "spwm_trip.h"
+#endif
+
+//TRANS_COUNT of a DMA channel (RP2350 keeps the MODE in the upper bits)
+#define HEALTH_COUNT_MASK 0x0FFFFFFFu
+
+static PIO health_pio[SPWM_LEGS_MAX];              //PIO & SM of each leg
+static uint health_sm[SPWM_LEGS_MAX];
+static uint health_data_ch[SPWM_LEGS_MAX];          //Data channel of each leg (see spwm_swap_data_ch())
+static uint8_t health_legs = 0;
+static uint32_t health_count[SPWM_LEGS_MAX];        //TRANS_COUNT of each data channel at the last check
+static uint16_t health_bad_run = 0;                 //Consecutive checks with a stall or stopped DMA
+static volatile spwm_health_t health;
+static repeating_timer_t health_timer;
+
+static int health_load_ch = -1;                     //DMA channel of the load test
+static uint32_t __attribute__ ((aligned(SPWM_HEALTH_LOAD_BYTES))) health_load_buf[SPWM_HEALTH_LOAD_BYTES / 4];
+static uint32_t health_load_sink;
+
+/**
+ * @brief Words played by the data channel of a leg since the last check.
+ *
+ * TRANS_COUNT counts down to 0 through one table & is reloaded by the re-arm (DBG_TCR holds the reload value).
+ * A count above the last one means one re-arm since the last check.
+ */
+static uint32_t leg_words(uint8_t leg, bool* p_rearmed){
+    uint32_t count = dma_hw->ch[health_data_ch[leg]].transfer_count & HEALTH_COUNT_MASK;
+    uint32_t last = health_count[leg];
+    health_count[leg] = count;
+    *p_rearmed = (count > last);
+    if(!*p_rearmed){
+        return last - count;
+    }
+    uint32_t reload = dma_debug_hw->ch[health_data_ch[leg]].dbg_tcr & HEALTH_COUNT_MASK;
+    return last + (reload - count);
+}
+
+/**
+ * @brief One check of all the legs. (repeating timer IRQ)
+ */
+static bool health_check(repeating_timer_t* p_timer){
+    (void)p_timer;
+    bool bad = false;
+    uint64_t edges_min = UINT64_MAX;
+    uint64_t edges_max = 0;
+
+    for(uint8_t leg = 0; leg < health_legs; leg++){
+        bool rearmed = false;
+        uint32_t words = leg_words(leg, &rearmed);
+        health.edges[leg] += words;
+        if(rearmed){
+            health.cycles[leg]++;
+        }
+
+        uint32_t bit = 1u << (PIO_FDEBUG_TXSTALL_LSB + health_sm[leg]);
+        if(health_pio[leg]->fdebug & bit){
+            health.stalls[leg]++;
+            health_pio[leg]->fdebug = bit;  //Write 1 to clear
+            bad = true;
+        }
+        if( (words == 0) && !dma_channel_is_busy(health_data_ch[leg]) ){
+            health.dma_stopped[leg]++;
+            bad = true;
+        }
+
+        if(health.edges[leg] < edges_min){
+            edges_min = health.edges[leg];
+        }
+        if(health.edges[leg] > edges_max){
+            edges_max = health.edges[leg];
+        }
+    }
+    uint32_t skew = (uint32_t)(edges_max - edges_min);
+    if(skew > health.skew_max){
+        health.skew_max = skew;
+    }
+    if(skew > SPWM_HEALTH_SKEW_MAX){
+        health.skewed++;
+    }
+
+    health_bad_run = bad ? (health_bad_run + 1) : 0;
+    if(health_bad_run > health.bad_run_max){
+        health.bad_run_max = health_bad_run;
+    }
+#if SPWM_FAULT_TRIP
+    //Sustained underrun: the legs may be frozen in any state. Trip to both switches OFF.
+    if( (SPWM_HEALTH_TRIP_CHECKS > 0) && (health_bad_run >= SPWM_HEALTH_TRIP_CHECKS) && !health.tripped ){
+        spwm_trip_now();
+        health.tripped = true;
+    }
+#endif
+    health.checks++;
+    return true;
+}
+
+/**
+ * @brief Starts the checks of the TX FIFO & DMA of each leg, every SPWM_HEALTH_PERIOD_US.
+ *
+ * Each check takes the TXSTALL flags of FDEBUG (the SM found its TX FIFO empty at a 'pull', i.e. DMA was late)
+ * and the TRANS_COUNT & busy state of the data channel of each leg. The leg pulls with stall, so a late
+ * DMA holds the leg in its present state. With SPWM_FAULT_TRIP, SPWM_HEALTH_TRIP_CHECKS bad checks in a row
+ * trip the legs OFF. (see spwm_trip_now())
+ *
+ * @param p_pio PIO of each leg SM.
+ * @param p_sm  SM of each leg.
+ * @param legs  Number of legs.
+ *
+ * @note Only for full (or packed) tables played by spwm_swap.cpp. Call after the SMs are started.
+ */
+void spwm_health_start(const PIO* p_pio, const uint* p_sm, uint8_t legs){
+    health_legs = legs;
+    for(uint8_t leg = 0; leg < legs; leg++){
+        health_pio[leg] = p_pio[leg];
+        health_sm[leg] = p_sm[leg];
+        health_data_ch[leg] = spwm_swap_data_ch(leg);
+        health_count[leg] = dma_hw->ch[health_data_ch[leg]].transfer_count & HEALTH_COUNT_MASK;
+        //The sync count & the 1st words were taken long ago. Only the stalls from now on.
+        p_pio[leg]->fdebug = 1u << (PIO_FDEBUG_TXSTALL_LSB + p_sm[leg]);
+    }
+    add_repeating_timer_us(-SPWM_HEALTH_PERIOD_US, health_check, NULL, &health_timer);
+}
+
+/**
+ * @brief Copy of the counters.
+ */
+void spwm_health_get(spwm_health_t* p_health){
+    uint32_t irq_status = save_and_disable_interrupts();
+    *p_health = *(const spwm_health_t*)&health;
+    restore_interrupts(irq_status);
+}
+
+/**
+ * @brief Starts (or stops) a bus load for testing: one DMA channel reads a buffer again & again without pacing.
+ *
+ * With SPWM_DMA_PRIORITY the table channels must still show no stalls under it (and the CPUs under their own load).
+ *
+ * @returns false if no DMA channel is free.
+ */
+bool spwm_health_load(bool on){
+    if(!on){
+        if(health_load_ch >= 0){
+            dma_channel_abort(health_load_ch);
+            dma_channel_unclaim(health_load_ch);
+            health_load_ch = -1;
+        }
+        return true;
+    }
+    if(health_load_ch >= 0){
+        return true;
+    }
+    health_load_ch = dma_claim_unused_channel(false);
+    if(health_load_ch < 0){
+        return false;
+    }
+    dma_channel_config load_cfg = dma_channel_get_default_config(health_load_ch);
+    channel_config_set_transfer_data_size(&load_cfg, DMA_SIZE_32);
+    channel_config_set_read_increment(&load_cfg, true);
+    channel_config_set_write_increment(&load_cfg, false);
+    channel_config_set_ring(&load_cfg, false, SPWM_HEALTH_LOAD_BITS);   //Wrap-up within the buffer
+
+    dma_channel_configure(
+        health_load_ch,
+        &load_cfg,
+        &health_load_sink,                      // Write address (one word)
+        health_load_buf,                        // Read address
+        dma_encode_endless_transfer_count(),    // Never ends
+        true                                    // Start immediately
+    );
+    return true;
+}
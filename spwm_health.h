@@ -0,0 +1,43 @@
+#ifndef SPWM_HEALTH
+    #define SPWM_HEALTH
+
+    #include "pico/stdlib.h"
+    #include "hardware/dma.h"
+    #include "hardware/pio.h"
+    #include "spwm_swap.h"
+
+    //Period of the checks (repeating timer on core0). Shorter than the DMA transfers of one table, so that
+    //at most one re-arm of a data channel is seen between two checks.
+    #define SPWM_HEALTH_PERIOD_US 1000
+
+    //Consecutive checks which find a leg stalled (or its DMA stopped) before the trip, with SPWM_FAULT_TRIP.
+    //0 : only counted, never tripped.
+    #ifndef SPWM_HEALTH_TRIP_CHECKS
+        #define SPWM_HEALTH_TRIP_CHECKS 3
+    #endif
+
+    //Words by which the legs may differ at a check. (All the tables have the same length, and DMA keeps the
+    //TX FIFO & OSR of each leg full, so a larger difference means that DMA was late for a leg)
+    #define SPWM_HEALTH_SKEW_MAX SPWM_SWAP_LEAD
+
+    //Buffer read again & again by the DMA load test (bytes, power of two for the read ring)
+    #define SPWM_HEALTH_LOAD_BITS 12
+    #define SPWM_HEALTH_LOAD_BYTES (1u << SPWM_HEALTH_LOAD_BITS)
+
+    /// Counters of the checks (see spwm_health_get())
+    typedef struct {
+        uint64_t edges[SPWM_LEGS_MAX];      //Words played by DMA into the TX FIFO of each leg (one per edge)
+        uint32_t cycles[SPWM_LEGS_MAX];     //Re-arms of the data channel of each leg (fundamental cycles)
+        uint32_t stalls[SPWM_LEGS_MAX];     //Checks which found the SM waiting at 'pull' on empty TX FIFO (TXSTALL)
+        uint32_t dma_stopped[SPWM_LEGS_MAX];//Checks which found neither DMA channel busy & no word played
+        uint32_t skewed;                    //Checks which found the legs apart by more than SPWM_HEALTH_SKEW_MAX
+        uint32_t skew_max;                  //Largest difference of edges between the legs (words)
+        uint32_t checks;                    //Number of checks
+        uint16_t bad_run_max;               //Longest run of consecutive checks with a stall or stopped DMA
+        bool tripped;                       //Tripped for a sustained underrun
+    } spwm_health_t;
+
+    void spwm_health_start(const PIO* p_pio, const uint* p_sm, uint8_t legs);
+    void spwm_health_get(spwm_health_t* p_health);
+    bool spwm_health_load(bool on);
+#endif
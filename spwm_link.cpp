@@ -0,0 +1,347 @@
+#include "pico/stdio_usb.h"
+#include "hardware/watchdog.h"
+#include "tusb.h"
+#include "spwm_link.h"
+
+//Receiver states
+#define RX_SOF 0
+#define RX_CMD 1
+#define RX_LEN 2
+#define RX_PAYLOAD 3
+#define RX_CRC 4
+
+//Watchdog scratch registers holding spwm_link_config_t through a restart. (4 to 7 are used by the SDK)
+#define LINK_SCRATCH_MAGIC 0x53504D4C   //"SPML"
+#define LINK_RESTART_DELAY_MS 10        //Time for the last reply to leave the USB buffer
+
+static uint8_t rx_buf[64];              //Bytes taken from the USB CDC, not parsed yet
+static int rx_count = 0;
+static int rx_pos = 0;
+static uint8_t rx_state = RX_SOF;
+static uint8_t rx_index = 0;            //Payload bytes received
+static uint8_t rx_crc = 0;
+static spwm_link_frame_t rx_frame;
+static uint32_t link_bad_frames = 0;
+
+static const spwm_link_app_t* p_link_app = NULL;    //Callbacks of the application (see spwm_link_start())
+static spwm_link_config_t link_staged;      //mf & DEAD_TIME, held till SPWM_LINK_CMD_APPLY
+static uint64_t link_start_us = 0;          //Start of the SMs
+static bool link_telemetry = false;
+static uint32_t link_cycle = 0;             //Fundamental cycle of the last telemetry
+static uint16_t link_dropped = 0;           //Telemetry frames dropped
+
+/**
+ * @brief Adds one byte to a CRC-8. (SPWM_LINK_CRC_POLY)
+ */
+static uint8_t crc8_update(uint8_t crc, uint8_t byte){
+    crc ^= byte;
+    for(uint8_t bit = 0; bit < 8; bit++){
+        crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ SPWM_LINK_CRC_POLY) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+/**
+ * @brief Takes the USB CDC from stdio. From now on printf goes only to the UART, so that the text never
+ * mixes with the frames. (The SDK keeps servicing the USB in the background)
+ */
+void spwm_link_init(void){
+    stdio_set_driver_enabled(&stdio_usb, false);
+    rx_state = RX_SOF;
+    rx_count = 0;
+    rx_pos = 0;
+}
+
+/**
+ * @brief Parses the bytes received so far. Never waits.
+ *
+ * @param p_frame   Receives the next complete frame.
+ * @returns true if a frame was received. Call it again, as more frames may be waiting.
+ */
+bool spwm_link_receive(spwm_link_frame_t* p_frame){
+    while(true){
+        if(rx_pos >= rx_count){
+            int count = stdio_usb.in_chars((char*)rx_buf, sizeof(rx_buf));
+            if(count <= 0){
+                return false;
+            }
+            rx_count = count;
+            rx_pos = 0;
+        }
+        uint8_t byte = rx_buf[rx_pos++];
+
+        switch(rx_state){
+            case RX_SOF:
+                if(byte == SPWM_LINK_SOF){
+                    rx_crc = 0;
+                    rx_state = RX_CMD;
+                }
+                break;
+            case RX_CMD:
+                rx_frame.cmd = byte;
+                rx_crc = crc8_update(rx_crc, byte);
+                rx_state = RX_LEN;
+                break;
+            case RX_LEN:
+                if(byte > SPWM_LINK_PAYLOAD_MAX){
+                    link_bad_frames++;
+                    rx_state = RX_SOF;
+                    break;
+                }
+                rx_frame.len = byte;
+                rx_crc = crc8_update(rx_crc, byte);
+                rx_index = 0;
+                rx_state = (byte == 0) ? RX_CRC : RX_PAYLOAD;
+                break;
+            case RX_PAYLOAD:
+                rx_frame.payload[rx_index++] = byte;
+                rx_crc = crc8_update(rx_crc, byte);
+                if(rx_index >= rx_frame.len){
+                    rx_state = RX_CRC;
+                }
+                break;
+            default:
+                rx_state = RX_SOF;
+                if(byte != rx_crc){
+                    link_bad_frames++;
+                    break;
+                }
+                *p_frame = rx_frame;
+                return true;
+        }
+    }
+}
+
+/**
+ * @brief Sends one frame if it fits in the USB buffer. Never waits.
+ *
+ * @returns false if the host is not connected or there is no room. (the frame is dropped)
+ */
+bool spwm_link_send(uint8_t cmd, const void* p_payload, uint8_t len){
+    if( (len > SPWM_LINK_PAYLOAD_MAX) || !tud_cdc_connected() ||
+        (tud_cdc_write_available() < (uint32_t)(len + SPWM_LINK_OVERHEAD)) ){
+        return false;
+    }
+    uint8_t frame[SPWM_LINK_PAYLOAD_MAX + SPWM_LINK_OVERHEAD];
+    const uint8_t* p_bytes = (const uint8_t*)p_payload;
+    frame[0] = SPWM_LINK_SOF;
+    frame[1] = cmd;
+    frame[2] = len;
+    uint8_t crc = crc8_update(crc8_update(0, cmd), len);
+    for(uint8_t i = 0; i < len; i++){
+        frame[3 + i] = p_bytes[i];
+        crc = crc8_update(crc, p_bytes[i]);
+    }
+    frame[3 + len] = crc;
+    stdio_usb.out_chars((const char*)frame, len + SPWM_LINK_OVERHEAD);
+    return true;
+}
+
+/**
+ * @brief Number of frames dropped for a wrong CRC or length.
+ */
+uint32_t spwm_link_bad_frames(void){
+    return link_bad_frames;
+}
+
+/**
+ * @brief Takes the settings left by spwm_link_restart(). They are used only once.
+ *
+ * @returns false after a power-on or any other reset. (p_config is not changed)
+ */
+bool spwm_link_boot_config(spwm_link_config_t* p_config){
+    uint32_t word1 = watchdog_hw->scratch[1];
+    uint32_t word2 = watchdog_hw->scratch[2];
+    bool valid = (watchdog_hw->scratch[0] == LINK_SCRATCH_MAGIC) &&
+                 (watchdog_hw->scratch[3] == ~(LINK_SCRATCH_MAGIC ^ word1 ^ word2));
+    watchdog_hw->scratch[0] = 0;
+    if(!valid){
+        return false;
+    }
+    p_config->mf = (uint16_t)word1;
+    p_config->dead_time = (uint16_t)(word1 >> 16);
+    p_config->signal_freq = (uint8_t)word2;
+    p_config->ma_x10000 = (uint16_t)(word2 >> 16);
+    return true;
+}
+
+/**
+ * @brief Restarts the firmware with new settings. (mf & dead time are fixed at boot: table sizes, DMA rings &
+ * the dead time held by the leg SMs)
+ *
+ * The leg outputs stop at the reset. Never returns.
+ */
+void spwm_link_restart(const spwm_link_config_t* p_config){
+    uint32_t word1 = p_config->mf | ((uint32_t)p_config->dead_time << 16);
+    uint32_t word2 = p_config->signal_freq | ((uint32_t)p_config->ma_x10000 << 16);
+    watchdog_hw->scratch[1] = word1;
+    watchdog_hw->scratch[2] = word2;
+    watchdog_hw->scratch[3] = ~(LINK_SCRATCH_MAGIC ^ word1 ^ word2);
+    watchdog_hw->scratch[0] = LINK_SCRATCH_MAGIC;
+    watchdog_reboot(0, 0, LINK_RESTART_DELAY_MS);
+    while(true){
+        tight_loop_contents();
+    }
+}
+
+static uint16_t link_get_u16(const uint8_t* p){
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static void link_put_u32(uint8_t* p, uint32_t value){
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+static uint16_t link_ma_x10000(double ma){
+    return (uint16_t)((ma * 10000.0) + 0.5);
+}
+
+/**
+ * @brief Starts serving the commands once the SMs are running. The telemetry counts the cycles from now.
+ *
+ * @param p_app Callbacks of the application for the commands. It must stay valid.
+ */
+void spwm_link_start(const spwm_link_app_t* p_app){
+    spwm_link_state_t state;
+    p_link_app = p_app;
+    p_app->get_state(&state);
+    link_staged.mf = state.mf;
+    link_staged.dead_time = state.dead_time;
+    link_telemetry = false;
+    link_start_us = time_us_64();
+}
+
+/**
+ * @brief Executes one command from the link & sends its reply. (see spwm_link.h)
+ */
+static void link_command(const spwm_link_frame_t* p_frame){
+    uint8_t reply[SPWM_LINK_PAYLOAD_MAX];
+    uint8_t len = 1;
+    uint8_t status = SPWM_LINK_OK;
+    const uint8_t* p_args = p_frame->payload;
+    spwm_link_state_t state;
+    p_link_app->get_state(&state);
+
+    switch(p_frame->cmd){
+        case SPWM_LINK_CMD_STATUS: {
+            spwm_link_status_t info = {SPWM_LINK_OK, state.legs, state.signal_freq, state.mf, link_ma_x10000(state.ma),
+                                       state.dead_time, state.signal_duration, link_bad_frames};
+            spwm_link_send(p_frame->cmd | SPWM_LINK_REPLY, &info, sizeof(info));
+            return;
+        }
+        case SPWM_LINK_CMD_SET_MA:
+            status = (p_frame->len != 2) ? SPWM_LINK_BAD_ARG :
+                                           p_link_app->update(state.signal_freq, link_get_u16(p_args) / 10000.0);
+            break;
+        case SPWM_LINK_CMD_SET_FREQ:
+            status = (p_frame->len != 1) ? SPWM_LINK_BAD_ARG : p_link_app->update(p_args[0], state.ma);
+            break;
+        case SPWM_LINK_CMD_SET_MF:
+        case SPWM_LINK_CMD_SET_DEAD_TIME: {
+            if(p_frame->len != 2){
+                status = SPWM_LINK_BAD_ARG;
+                break;
+            }
+            spwm_link_config_t config = link_staged;
+            if(p_frame->cmd == SPWM_LINK_CMD_SET_MF){
+                config.mf = link_get_u16(p_args);
+            }else{
+                config.dead_time = link_get_u16(p_args);
+            }
+            status = p_link_app->check_config(&config);
+            if(status == SPWM_LINK_OK){
+                link_staged = config;
+            }
+            break;
+        }
+        case SPWM_LINK_CMD_APPLY:
+            if((link_staged.mf != state.mf) || (link_staged.dead_time != state.dead_time)){
+                //Table sizes, DMA rings & the dead time in the leg SMs are set up at boot
+                link_staged.signal_freq = state.signal_freq;
+                link_staged.ma_x10000 = link_ma_x10000(state.ma);
+                reply[0] = SPWM_LINK_OK;
+                spwm_link_send(p_frame->cmd | SPWM_LINK_REPLY, reply, 1);
+                spwm_link_restart(&link_staged);
+            }
+            status = p_link_app->update(state.signal_freq, state.ma);
+            break;
+        case SPWM_LINK_CMD_READ_TABLE: {
+            //The payload is read only after its length is checked
+            if(p_frame->len != 4){
+                status = SPWM_LINK_BAD_ARG;
+                break;
+            }
+            uint8_t leg = p_args[0];
+            uint16_t index = link_get_u16(&p_args[1]);
+            uint8_t count = p_args[3];
+            const uint32_t* p_table = NULL;
+            uint16_t words = 0;
+            status = p_link_app->get_table(leg, &p_table, &words);
+            if(status != SPWM_LINK_OK){
+                break;
+            }
+            if((count > SPWM_LINK_READ_WORDS_MAX) || ((index + count) > words)){
+                status = SPWM_LINK_BAD_ARG;
+                break;
+            }
+            for(uint8_t i = 0; i < 4; i++){
+                reply[1 + i] = p_args[i];
+            }
+            for(uint8_t i = 0; i < count; i++){
+                link_put_u32(&reply[5 + (4 * i)], p_table[index + i]);
+            }
+            len = 5 + (4 * count);
+            break;
+        }
+        case SPWM_LINK_CMD_TELEMETRY:
+            if(p_frame->len != 1){
+                status = SPWM_LINK_BAD_ARG;
+                break;
+            }
+            link_telemetry = (p_args[0] != 0);
+            link_dropped = 0;
+            p_link_app->stall_mask();       //Only the underruns from now on
+            break;
+        case SPWM_LINK_CMD_DUMP:
+            status = (p_frame->len != 1) ? SPWM_LINK_BAD_ARG : p_link_app->dump(p_args[0]);
+            break;
+        default:
+            status = SPWM_LINK_UNKNOWN_CMD;
+            break;
+    }
+    reply[0] = status;
+    spwm_link_send(p_frame->cmd | SPWM_LINK_REPLY, reply, len);
+}
+
+/**
+ * @brief Serves the link from the idle loop: the waiting commands, then the telemetry of a new fundamental cycle.
+ * Never waits for the USB. (A frame which does not fit is dropped)
+ *
+ * @note Call only after spwm_link_start().
+ */
+void spwm_link_serve(void){
+    spwm_link_frame_t frame;
+    while(spwm_link_receive(&frame)){
+        link_command(&frame);
+    }
+    if(!link_telemetry){
+        return;
+    }
+
+    //1 T_STEP = 10 ns
+    spwm_link_state_t state;
+    p_link_app->get_state(&state);
+    uint32_t cycle = (uint32_t)(((time_us_64() - link_start_us) * 100) / state.signal_duration);
+    if(cycle == link_cycle){
+        return;
+    }
+    link_cycle = cycle;
+    spwm_link_telemetry_t telemetry = {cycle, state.gen_time_us, p_link_app->stall_mask(), link_ma_x10000(state.ma),
+                                       state.vout_rms, link_dropped};
+    if(!spwm_link_send(SPWM_LINK_MSG_TELEMETRY, &telemetry, sizeof(telemetry))){
+        link_dropped++;
+    }
+}
@@ -0,0 +1,116 @@
+#ifndef SPWM_LINK
+    #define SPWM_LINK
+
+    #include "pico/stdlib.h"
+
+    //Frame on USB CDC (both ways): SOF, cmd, len, payload (len bytes), CRC-8 of cmd, len & payload.
+    //Multi byte fields are little endian. A reply has the cmd of its request with SPWM_LINK_REPLY set &
+    //a status byte (SPWM_LINK_OK ...) as its 1st payload byte.
+    #define SPWM_LINK_SOF 0xA5
+    #define SPWM_LINK_PAYLOAD_MAX 60        //A frame fits in one USB full speed packet (64 bytes)
+    #define SPWM_LINK_OVERHEAD 4            //SOF, cmd, len & CRC
+    #define SPWM_LINK_CRC_POLY 0x07         //CRC-8 (x^8 + x^2 + x + 1), initial value 0
+    #define SPWM_LINK_REPLY 0x80
+
+    //Longest time for which the host must wait for a reply. The link is served every ms from the idle loop, but not
+    //while it is held (e.g. during a flash erase of SPWM_TABLE_CACHE). Requests sent meanwhile are NAKed by the
+    //USB controller, not lost.
+    #define SPWM_LINK_REPLY_MS_MAX 100
+
+    //Commands from the host
+    #define SPWM_LINK_CMD_STATUS 0x01       //() -> spwm_link_status_t
+    #define SPWM_LINK_CMD_SET_MA 0x02       //(u16 ma x 10000) Played in the next fundamental cycle
+    #define SPWM_LINK_CMD_SET_FREQ 0x03     //(u8 Hz) Played in the next fundamental cycle
+    #define SPWM_LINK_CMD_SET_MF 0x04       //(u16 mf) Held till SPWM_LINK_CMD_APPLY
+    #define SPWM_LINK_CMD_SET_DEAD_TIME 0x05//(u16 T_STEP) Held till SPWM_LINK_CMD_APPLY
+    #define SPWM_LINK_CMD_APPLY 0x06        //() Computes the tables again. Restarts if mf or dead time is changed.
+    #define SPWM_LINK_CMD_READ_TABLE 0x07   //(u8 leg, u16 index, u8 count) -> (u8 leg, u16 index, u8 count, u32 words)
+    #define SPWM_LINK_CMD_TELEMETRY 0x08    //(u8 on) Sends spwm_link_telemetry_t in each fundamental cycle
+    #define SPWM_LINK_CMD_DUMP 0x09         //(u8 what) Text dump on UART: SPWM_LINK_DUMP_xxx
+
+    //Frame sent by the firmware without a request
+    #define SPWM_LINK_MSG_TELEMETRY 0x40    //spwm_link_telemetry_t
+
+    //Status byte of a reply
+    #define SPWM_LINK_OK 0
+    #define SPWM_LINK_BUSY 1                //Previous change still pending. Try again later.
+    #define SPWM_LINK_BAD_ARG 2             //Value out of range or wrong payload length
+    #define SPWM_LINK_NOT_SUPPORTED 3       //Not possible in this build
+    #define SPWM_LINK_UNKNOWN_CMD 4
+
+    //What is printed by SPWM_LINK_CMD_DUMP
+    #define SPWM_LINK_DUMP_TABLES 0         //Active tables of all the legs (one value per line)
+    #define SPWM_LINK_DUMP_PROFILE 1        //Profiler records (SPWM_PROFILE)
+
+    //Max words in one reply of SPWM_LINK_CMD_READ_TABLE
+    #define SPWM_LINK_READ_WORDS_MAX ((SPWM_LINK_PAYLOAD_MAX - 5) / 4)
+
+    /// One frame, without SOF & CRC
+    typedef struct {
+        uint8_t cmd;
+        uint8_t len;
+        uint8_t payload[SPWM_LINK_PAYLOAD_MAX];
+    } spwm_link_frame_t;
+
+    /// Settings kept through a restart by the link. (held in the watchdog scratch registers)
+    typedef struct {
+        uint16_t mf;
+        uint16_t dead_time;
+        uint8_t signal_freq;
+        uint16_t ma_x10000;
+    } spwm_link_config_t;
+
+    /// Reply to SPWM_LINK_CMD_STATUS
+    typedef struct __attribute__ ((packed)) {
+        uint8_t status;             //SPWM_LINK_OK
+        uint8_t legs;
+        uint8_t signal_freq;
+        uint16_t mf;
+        uint16_t ma_x10000;
+        uint16_t dead_time;
+        uint32_t signal_duration;   //Duration of one fundamental cycle of the active tables (T_STEP)
+        uint32_t bad_frames;        //Frames dropped for a wrong CRC or length
+    } spwm_link_status_t;
+
+    /// Sent in each fundamental cycle after SPWM_LINK_CMD_TELEMETRY
+    typedef struct __attribute__ ((packed)) {
+        uint32_t cycle;             //Fundamental cycles since the SMs were started
+        uint32_t gen_time_us;       //Time of the last table computation on core0 (0 if none)
+        uint8_t stall_mask;         //Legs whose SM found its TX FIFO empty since the last frame (DMA underrun)
+        uint16_t ma_x10000;
+        uint32_t vout_rms;          //Last RMS of the output voltage (SPWM_VOLTAGE_LOOP, else 0)
+        uint16_t dropped;           //Telemetry frames dropped for lack of room in the USB buffer
+    } spwm_link_telemetry_t;
+
+    /// State of the application, for the replies & the telemetry. (see spwm_link_app_t)
+    typedef struct {
+        uint8_t legs;               //Legs whose tables can be read
+        uint8_t signal_freq;
+        uint16_t mf;
+        double ma;
+        uint16_t dead_time;
+        uint32_t signal_duration;   //Duration of one fundamental cycle being played (T_STEP)
+        uint32_t gen_time_us;       //Time of the last table computation on core0 (0 if none)
+        uint32_t vout_rms;          //Last RMS of the output voltage (0 if none)
+    } spwm_link_state_t;
+
+    /// Callbacks of the application, through which spwm_link_serve() executes the commands. Each one that returns
+    /// a uint8_t gives the status of the reply. (SPWM_LINK_OK ...)
+    typedef struct {
+        void (*get_state)(spwm_link_state_t* p_state);
+        uint8_t (*update)(uint8_t signal_freq, double ma);              //Freq & 'ma' from the next fundamental cycle
+        uint8_t (*check_config)(const spwm_link_config_t* p_config);    //mf & dead time, to be applied by a restart
+        uint8_t (*get_table)(uint8_t leg, const uint32_t** pp_table, uint16_t* p_words);   //Active table of a leg
+        uint8_t (*stall_mask)(void);                                    //Legs with a DMA underrun since the last call
+        uint8_t (*dump)(uint8_t what);                                  //Text dump on UART (SPWM_LINK_DUMP_xxx)
+    } spwm_link_app_t;
+
+    void spwm_link_init(void);
+    bool spwm_link_receive(spwm_link_frame_t* p_frame);
+    bool spwm_link_send(uint8_t cmd, const void* p_payload, uint8_t len);
+    uint32_t spwm_link_bad_frames(void);
+    bool spwm_link_boot_config(spwm_link_config_t* p_config);
+    void spwm_link_restart(const spwm_link_config_t* p_config);
+    void spwm_link_start(const spwm_link_app_t* p_app);
+    void spwm_link_serve(void);
+#endif
@@ -1,11 +1,104 @@
 #ifndef SPWM_LUT
     #define SPWM_LUT
 
-    #include <math.h>
-    #include <stdio.h>
-    #include "pico/stdlib.h"
+    #include <stdint.h>
+    #include <stdbool.h>
+    #include <stddef.h>
+
+    //Methods available for finding the crossing points of sine & triangular carrier waves
+    #define SPWM_SOLVER_SCAN 0          //Advance one T_STEP at a time till the sine crosses the carrier
+    #define SPWM_SOLVER_BRACKETED 1     //Bracketed secant (regula falsi) search. Few sin() evaluations per crossing.
+
+    //Select the crossing solver before compilation. Both produce the same tables.
+    #ifndef SPWM_CROSSING_SOLVER
+        #define SPWM_CROSSING_SOLVER SPWM_SOLVER_BRACKETED
+    #endif
+
+    //Rounding of the edges to whole PIO clk (T_STEP)
+    //0 : each edge is at the first T_STEP at (or after) the crossing.
+    //1 : each edge is rounded to nearest T_STEP after adding the rounding error of the previous edge of its signal
+    //    (error feedback). The mean edge position is then exact to a fraction of T_STEP and the rounding noise moves
+    //    to high freq, away from the low order harmonics. The total duration of a cycle stays exact.
+    #ifndef SPWM_EDGE_DITHER
+        #define SPWM_EDGE_DITHER 0
+    #endif
+
+    //Sine evaluation used while searching the crossing points
+    //0 : double precision sin() from math library.
+    //1 : Q31 fixed point quarter wave table with linear interpolation. (see spwm_sine.h)
+    #ifndef SPWM_SINE_FIXED_POINT
+        #define SPWM_SINE_FIXED_POINT 0
+    #endif
+    
+    //Handling of a pulse which is shorter than min_pulse after correction.
+    //The time added to (or removed from) the short pulse is taken from (or given to) its neighbours,
+    //so that the total duration of a cycle stays exact.
+    #define SPWM_PULSE_STRETCH 0    //Stretch the pulse upto min_pulse.
+    #define SPWM_PULSE_DROP 1       //Drop the pulse to the shortest one PIO can produce (value 0) & merge its time into the neighbours.
+
+    //Modulation strategies. All use the same carrier, crossing solver & table format.
+    #define SPWM_STRATEGY_UNIPOLAR 0    //Each leg compares its own sine wave with the carrier. On a H bridge (s1 & s2 = -s1)
+                                        //the output has 3 levels & its ripple is at twice the carrier freq.
+    #define SPWM_STRATEGY_BIPOLAR 1     //H bridge only. H2 is the complement of H1. (H1 table, its SM starts on the HIGH side)
+                                        //The output has 2 levels & its ripple is at the carrier freq. Both legs switch at each edge.
+    #define SPWM_STRATEGY_MIN_MAX 2     //3 phase only. The min-max zero sequence (-(max + min) / 2 of the 3 sine waves) is
+                                        //added to each phase. Same line voltages as space vector PWM. ma upto 1.15.
+
+    //Select the strategy before compilation. (pass cmake -DSPWM_STRATEGY=1 for bipolar)
+    #ifndef SPWM_STRATEGY
+        #define SPWM_STRATEGY SPWM_STRATEGY_UNIPOLAR
+    #endif
+
+    //'ma' must be less than this for the strategy, so that the peak of the reference stays below the carrier peak.
+    //(The min-max zero sequence lowers the peak of each phase by sqrt(3) / 2, so upto 2 / sqrt(3) = 1.1547)
+    #if SPWM_STRATEGY == SPWM_STRATEGY_MIN_MAX
+        #define SPWM_MA_LIMIT 1.1547
+    #else
+        #define SPWM_MA_LIMIT 1.0
+    #endif
+
+    //Sampling of the sine wave. The edges of each carrier cycle are found by:
+    #define SPWM_SAMPLING_NATURAL 0     //The crossing solver, at the true sine/carrier crossings. (natural sampling)
+    #define SPWM_SAMPLING_SYMMETRIC 1   //One sample at the middle (negative peak) of each carrier cycle, held for both edges.
+    #define SPWM_SAMPLING_ASYMMETRIC 2  //One sample at the middle of each ramp (carrier at 0), held for the edge on that ramp.
+    //The regular sampled edges have a closed form (ON duration = (T / 2) x (1 + ma x sin(wt_k)) for the carrier period T),
+    //so there is no search. Each sample is at the centre of the time it is held for (not at a carrier peak as is
+    //usual), so there is no delay & the tables keep the quarter wave symmetry of the sine wave.
+
+    //Select the sampling before compilation. (pass cmake -DSPWM_SAMPLING=1 for symmetric regular sampling)
+    #ifndef SPWM_SAMPLING
+        #define SPWM_SAMPLING SPWM_SAMPLING_NATURAL
+    #endif
+
+    /// Corrections applied to each ON & OFF duration, so that the PIO program reproduces the exact durations.
+    typedef struct {
+        uint32_t dead_time;         //DEAD_TIME inserted by PIO program at each change of logic levels.
+        uint32_t pio_overhead;      //Delay added by the PIO instructions while creating the pulse.
+        uint32_t min_pulse;         //Min value stored after correction.
+        uint8_t short_pulse_mode;   //SPWM_PULSE_STRETCH or SPWM_PULSE_DROP
+    } spwm_corrections_t;
     
     uint32_t spwm_unipolar_arrays(uint8_t signal_freq, uint16_t mf, double ma, 
                             uint32_t* p_h1_high, uint32_t* p_h2_high,
-                            uint32_t* h1_sync, uint32_t* h2_sync);
-#endif
\ No newline at end of file
+                            uint32_t* h1_sync, uint32_t* h2_sync, const spwm_corrections_t* p_corr = NULL);
+
+    //Packed tables hold two 16 bit durations in each 32 bit word. (see spwm_packed_phase_arrays())
+    #define SPWM_PACKED_VALUE_MAX 0xFFFF
+
+    //Quarter wave layout (see spwm_quarter_arrays()): (mf / 2) values of s1, (mf / 2) values of s2 and then
+    //these values (offset from mf)
+    #define SPWM_QUARTER_MID 0          //OFF duration between the two half cycles (same for both tables)
+    #define SPWM_QUARTER_LINK_H1 1      //Link of H1 table into next cycle (rewritten during swaps)
+    #define SPWM_QUARTER_LINK_H2 2      //Link of H2 table into next cycle (rewritten during swaps)
+    #define SPWM_QUARTER_WORDS(mf) ((mf) + 3)
+
+    uint32_t spwm_phase_arrays(uint8_t signal_freq, uint16_t mf, double ma, uint8_t phases,
+                            uint32_t* const* pp_tables, uint32_t* p_syncs, const spwm_corrections_t* p_corr = NULL);
+
+    uint32_t spwm_packed_phase_arrays(uint8_t signal_freq, uint16_t mf, double ma, uint8_t phases,
+                            uint32_t* const* pp_packed, uint32_t* p_syncs, uint32_t* p_scratch, 
+                            const spwm_corrections_t* p_corr = NULL);
+
+    uint32_t spwm_quarter_arrays(uint8_t signal_freq, uint16_t mf, double ma, uint32_t* p_quarter,
+                            uint32_t* h1_sync, uint32_t* h2_sync, const spwm_corrections_t* p_corr = NULL);
+#endif
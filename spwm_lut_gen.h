@@ -0,0 +1,1098 @@
+#ifndef SPWM_LUT_GEN
+    #define SPWM_LUT_GEN
+
+    #include <stdint.h>
+    #include <stddef.h>
+    #include <math.h>
+    #include "spwm_lut.h"
+    #include "spwm_sine.h"
+
+    //Constants used in this generator (removed again at the end of this file)
+    #define PI 3.141592654f
+    #define T_STEP 1.0e-8f      //Time increment = 10ns
+    #define scaling_factor 1000000  //Multiplication factor used for amplitudes of the carrier and signal waves.
+
+    //Set SPWM_PROFILE = 1 to record the cycles spent in each carrier quarter on target (see spwm_prof.cpp).
+    #ifndef SPWM_PROFILE
+        #define SPWM_PROFILE 0
+    #endif
+
+    //Set SPWM_LUT_STATS = 1 to count the work done by the generator (used by the host bench, see bench/).
+    //The counters (spwm_lut_stats) must then be defined by the application. Not for compile time tables.
+    //The profiler also needs these counters, except in the firmware with compile time tables (SPWM_CONST_TABLES).
+    #ifndef SPWM_LUT_STATS
+        #if SPWM_PROFILE && !SPWM_CONST_TABLES
+            #define SPWM_LUT_STATS 1
+        #else
+            #define SPWM_LUT_STATS 0
+        #endif
+    #endif
+
+    #if SPWM_LUT_STATS
+        typedef struct {
+            uint32_t sine_evals;    //Number of sine amplitude evaluations
+            uint32_t crossings;     //Number of crossing searches (one per edge)
+            uint32_t iterations;    //Number of inner loop iterations of crossing searches (scan steps or bisections)
+        } spwm_lut_stats_t;
+
+        extern spwm_lut_stats_t spwm_lut_stats;
+        #define SPWM_LUT_COUNT(counter) (spwm_lut_stats.counter++)
+        #define SPWM_LUT_CONSTEXPR inline       //Counting is not possible at compile time
+    #else
+        #define SPWM_LUT_COUNT(counter)
+        #define SPWM_LUT_CONSTEXPR constexpr
+    #endif
+
+    #if SPWM_PROFILE && SPWM_LUT_STATS
+        #include "spwm_prof.h"
+        #define SPWM_LUT_MARK(event) spwm_prof_mark(event)
+    #else
+        #define SPWM_LUT_MARK(event)
+    #endif
+
+    /// Details of the carrier & signal waves required while searching for their crossing points.
+    typedef struct {
+        bool fixed_point;                   //true: Q31 sine table (spwm_sine.h) is used, false: double precision sin()
+        bool zero_sequence;                 //true: min-max zero sequence is added to the sine wave (SPWM_STRATEGY_MIN_MAX)
+        uint8_t sampling;                   //SPWM_SAMPLING_NATURAL (crossing solver) or regular sampling (closed form edges)
+        uint64_t phase_step;                //Phase increment of signal wave for one T_STEP. (Q32.32, only for fixed_point)
+        double omega;                       //Angular freq of signal wave. (w = 2 * PI / signal_duration)
+        uint32_t ma_scaled;                 //ma * carrier_peak
+        int32_t carrier_peak;               //Amplitude of carrier wave. (carrier_slope * quarter duration count)
+        int32_t carrier_slope;              //Slope of triangular carrier wave. (scaling_factor / quarter duration count)
+        int32_t sine_step;                  //Max change in sine amplitude in one T_STEP. (ma_scaled * omega, rounded up)
+        uint32_t carrier_duration_half;     //Duration the carrier takes to ramp from +1V to -1V.
+        uint32_t estimate_slack;            //Time by which an estimated crossing may be late. (0 for a sine wave)
+    } spwm_crossing_params_t;
+
+    /// sqrt(3) / 2 in Q31, for the sine waves of other phases (sin(wt -/+ 120 deg) = -sin(wt) / 2 -/+ (sqrt(3) / 2) cos(wt))
+    #define SPWM_SQRT3_HALF_Q31 1859775393
+
+    /**
+     * @brief Median of 3 values. For a balanced 3 phase set it is -(max + min), as the 3 values add up to 0.
+     */
+    template <typename T>
+    constexpr T spwm_median3(T a, T b, T c){
+        if(a > b){
+            return (b > c) ? b : ((a > c) ? c : a);
+        }
+        return (a > c) ? a : ((b > c) ? c : b);
+    }
+
+    /**
+     * @brief Amplitude of the sinusoidal signal (s1 or its inverse s2) at any instance of time.
+     * 
+     * @param cp    Carrier & signal wave details.
+     * @param time_counter  Time instance (1 count = 1 T_STEP) from the start of signal wave.
+     * @param s2    true for the complementary sine wave s2, false for the main sine wave s1.
+     */
+    SPWM_LUT_CONSTEXPR int32_t spwm_signal_amplitude(const spwm_crossing_params_t* cp, uint32_t time_counter, bool s2){
+        SPWM_LUT_COUNT(sine_evals);
+        if(cp->zero_sequence){
+            //s1 + (median of the 3 phases / 2) = s1 - (max + min) / 2. The other phases are made of sin & cos of s1.
+            int32_t s_amplitude = 0;
+            if(cp->fixed_point){
+                uint32_t phase = spwm_phase(cp->phase_step, time_counter);
+                int64_t sin_a = spwm_sin_q31(phase);
+                int64_t cos_a = spwm_sin_q31(phase + (1u << SPWM_PHASE_QUADRANT_BITS));
+                int64_t sin_b = (-sin_a / 2) - ((cos_a * SPWM_SQRT3_HALF_Q31) >> 31);
+                int64_t sin_c = (-sin_a / 2) + ((cos_a * SPWM_SQRT3_HALF_Q31) >> 31);
+                int32_t ref = (int32_t)(sin_a + (spwm_median3(sin_a, sin_b, sin_c) / 2));
+                s_amplitude = spwm_scale_q31(cp->ma_scaled, ref);
+            }else{
+                double sin_a = sin( cp->omega * time_counter );
+                double cos_a = cos( cp->omega * time_counter );
+                double sin_b = (-0.5 * sin_a) - (0.8660254037844386 * cos_a);
+                double sin_c = (-0.5 * sin_a) + (0.8660254037844386 * cos_a);
+                s_amplitude = cp->ma_scaled * (sin_a + (0.5 * spwm_median3(sin_a, sin_b, sin_c)));
+            }
+            return s2 ? (-1 * s_amplitude) : s_amplitude;
+        }
+        if(cp->fixed_point){
+            int32_t s_amplitude = spwm_scale_q31(cp->ma_scaled, spwm_sin_q31(spwm_phase(cp->phase_step, time_counter)));
+            return s2 ? (-1 * s_amplitude) : s_amplitude;
+        }
+        if(s2){
+            return -1 * (cp->ma_scaled * sin( cp->omega * time_counter ));
+        }
+        return cp->ma_scaled * sin( cp->omega * time_counter );
+    }
+
+    /**
+     * @brief How far the signal wave has gone past the carrier wave at a time instance.
+     * 
+     * @param carrier_start Start time of the present carrier wave cycle.
+     * @param tri_time_counter  Time instance w.r.t. the start of present carrier wave cycle.
+     * @param carrier_rising    false while carrier ramps down from +1V to -1V, true while it ramps back to +1V.
+     * 
+     * @returns A value >= 0 once the signal has crossed the carrier. Negative before the crossing.
+     */
+    SPWM_LUT_CONSTEXPR int32_t spwm_crossing_margin(const spwm_crossing_params_t* cp, uint32_t carrier_start, uint32_t tri_time_counter,
+                                        bool s2, bool carrier_rising){
+        int32_t s_amplitude = spwm_signal_amplitude(cp, carrier_start + tri_time_counter, s2);
+        int32_t carrier_amplitude = 0;
+        if(!carrier_rising){
+            //Sine wave goes above the falling carrier wave
+            carrier_amplitude = cp->carrier_peak - (cp->carrier_slope * (int32_t)tri_time_counter);
+            return s_amplitude - carrier_amplitude;
+        }
+        //Rising carrier wave goes above the sine wave
+        carrier_amplitude = (-1 * cp->carrier_peak) + (cp->carrier_slope * ((int32_t)tri_time_counter - (int32_t)cp->carrier_duration_half));
+        return carrier_amplitude - s_amplitude;
+    }
+
+    /**
+     * @brief Finds the first time instance (in the range tri_start to tri_end) where the signal crosses the carrier.
+     * 
+     * @param tri_start Estimated time of crossing. The crossing can not occur before this time.
+     * @param tri_end   End of present quarter of carrier wave + 1. (The quarter end itself is searched)
+     * 
+     * @returns tri_time_counter at the crossing. Any value >= tri_end means no crossing was found.
+     * 
+     * @note
+     * With SPWM_SOLVER_SCAN the time is advanced by one T_STEP till the crossing is found. 
+     * It needs one sin() evaluation for every T_STEP travelled from the estimated time.
+     * 
+     * With SPWM_SOLVER_BRACKETED the crossing equation is evaluated only once at the estimated time (tri_start).
+     * Then one Newton step is taken with the carrier slope as derivative of the crossing margin.
+     * From one T_STEP to the next, the carrier changes exactly by carrier_slope while the sine wave can not 
+     * change by more than sine_step (= ma_scaled * omega, rounded up). This gives a bracket (lo, hi]:
+     * - the signal is surely below the carrier till 'lo'.
+     * - the signal is surely above the carrier at 'hi'.
+     * Mostly lo & hi are just one T_STEP apart and the crossing is known without any further sin() evaluation.
+     * Otherwise the bracket is closed by bisection.
+     * 
+     * The crossing margin strictly increases with time inside a carrier quarter (the carrier slope is much 
+     * steeper than that of sine wave). So both solvers return exactly the same tri_time_counter.
+     */
+    SPWM_LUT_CONSTEXPR uint32_t spwm_find_crossing(const spwm_crossing_params_t* cp, uint32_t carrier_start, uint32_t tri_start, uint32_t tri_end,
+                                bool s2, bool carrier_rising){
+        SPWM_LUT_COUNT(crossings);
+    #if (SPWM_CROSSING_SOLVER == SPWM_SOLVER_SCAN)
+        uint32_t tri_time_counter = tri_start;
+        while(tri_time_counter < tri_end){
+            SPWM_LUT_COUNT(iterations);
+            if(spwm_crossing_margin(cp, carrier_start, tri_time_counter, s2, carrier_rising) >= 0){
+                break;
+            }
+            tri_time_counter++;     //advance time by T_STEP (i.e 10ns at 100MHz clk)
+        }
+        return tri_time_counter;
+    #else
+        if(tri_start >= tri_end){
+            return tri_end;
+        }
+
+        int32_t margin = spwm_crossing_margin(cp, carrier_start, tri_start, s2, carrier_rising);
+        if(margin >= 0){
+            return tri_start;           //Already crossed at the estimated time
+        }
+
+        //Truncation of the two sine amplitudes being compared can add up to 2 counts (+1 for rounding of sin())
+        int32_t deficit_max = (-margin) + 3;
+        int32_t deficit_min = (-margin) - 3;
+        
+        //Signal is surely below the carrier upto 'lo'.
+        uint32_t lo = tri_start;
+        if(deficit_min > 0){
+            lo += (uint32_t)((deficit_min - 1) / (cp->carrier_slope + cp->sine_step));
+        }
+        if(lo >= (tri_end - 1)){
+            return tri_end;             //No crossing in this quarter of carrier wave
+        }
+
+        //Signal is surely above the carrier at 'hi'. (or no crossing till tri_end)
+        uint32_t hi = tri_end;
+        if(cp->carrier_slope > cp->sine_step){
+            int32_t rise = cp->carrier_slope - cp->sine_step;
+            uint32_t hi_sure = tri_start + (uint32_t)((deficit_max + rise - 1) / rise);
+            if(hi_sure < tri_end){
+                hi = hi_sure;
+            }
+        }
+
+        //Close the bracket by bisection
+        uint32_t mid = 0;
+        while((hi - lo) > 1){
+            SPWM_LUT_COUNT(iterations);
+            mid = lo + ((hi - lo) / 2);
+            if(spwm_crossing_margin(cp, carrier_start, mid, s2, carrier_rising) >= 0){
+                hi = mid;
+            }else{
+                lo = mid;
+            }
+        }
+        return hi;
+    #endif
+    }
+
+    /**
+     * @brief Corrects a raw ON / OFF duration before it is stored in the lookup table.
+     * 
+     * The PIO program adds DEAD_TIME & its own instruction delays to each value loaded from the table. 
+     * These are subtracted here. 
+     * 
+     * @param p_short_count Counts the values which are shorter than min_pulse after correction. Such values are 
+     * returned as (duration - offset) which can be negative (if read as int32_t). These must be fixed by 
+     * spwm_limit_short_pulses() before the table is used.
+     */
+    SPWM_LUT_CONSTEXPR uint32_t spwm_correct_value(uint32_t duration, const spwm_corrections_t* p_corr, uint16_t* p_short_count){
+        if(p_corr == NULL){
+            return duration;
+        }
+        uint32_t offset = p_corr->dead_time + p_corr->pio_overhead;
+        if(duration < (offset + p_corr->min_pulse)){
+            (*p_short_count)++;
+        }
+        return (duration - offset);
+    }
+
+    /**
+     * @brief Gives the excess of a short value to its two neighbours, half each. A share which would make its
+     * neighbour short goes to the other neighbour instead, if that one stays long with all of it.
+     *
+     * @param p_left, p_right   The neighbours. The share of p_right is added right_weight times (the centre of a
+     * quarter is next to both copies of its neighbour).
+     */
+    SPWM_LUT_CONSTEXPR void spwm_split_excess(uint32_t* p_left, uint32_t* p_right, int32_t right_weight, int32_t excess,
+                                              int32_t min_pulse){
+        int32_t left_share = excess / 2;
+        int32_t right_share = excess - left_share;
+        int32_t left = (int32_t)*p_left;
+        int32_t right = (int32_t)*p_right;
+        if(((left + left_share) < min_pulse) && ((right + (right_weight * excess)) >= min_pulse)){
+            left_share = 0;
+            right_share = excess;
+        }else if(((right + (right_weight * right_share)) < min_pulse) && ((left + excess) >= min_pulse)){
+            left_share = excess;
+            right_share = 0;
+        }
+        *p_left += left_share;
+        *p_right += right_weight * right_share;
+    }
+
+    /**
+     * @brief Fixes the corrected values which are shorter than min_pulse without changing the total duration of table.
+     * 
+     * @param p_table   Table with corrected values. Short values may be negative (if read as int32_t).
+     * @param len   Number of values in table. (= 2 * mf)
+     * @param p_corr    Corrections used for the table.
+     * 
+     * @note
+     * SPWM_PULSE_STRETCH: The short pulse is set to min_pulse. 
+     * SPWM_PULSE_DROP: The short pulse is set to 0. (The PIO then drives it only for its own instruction delay)
+     * 
+     * The difference is taken from (or given to) the previous & next values, which are of opposite logic level.
+     * i.e. The neighbouring OFF periods of a dropped ON pulse are merged with it. 
+     * A neighbour can be made short in turn (e.g. two adjacent short values, or time taken by a negative value),
+     * so the table is passed again till no value is short. A dropped value (0) stays as it is. (see spwm_split_excess())
+     * 
+     * The last value of table (the link into next cycle) is never changed, as it is rewritten during table swaps. 
+     */
+    SPWM_LUT_CONSTEXPR void spwm_limit_short_pulses(uint32_t* p_table, uint16_t len, const spwm_corrections_t* p_corr){
+        int32_t min_pulse = (int32_t)p_corr->min_pulse;
+        int32_t target = (p_corr->short_pulse_mode == SPWM_PULSE_DROP) ? 0 : min_pulse;
+        uint16_t link = len - 1;
+        int32_t value = 0;
+        int32_t excess = 0;     //+ve: given to neighbours, -ve: taken from neighbours
+        bool changed = true;
+
+        //Each pass moves the time taken from the neighbours at least one value further, so len passes are enough
+        for(uint16_t pass = 0; changed && (pass < len); pass++){
+            changed = false;
+            for(uint16_t i = 0; i < link; i++){
+                value = (int32_t)p_table[i];
+                if((value >= min_pulse) || (value == target)){
+                    continue;
+                }
+                excess = value - target;
+                p_table[i] = (uint32_t)target;
+                changed = true;
+
+                if(i == 0){
+                    p_table[i + 1] += excess;
+                }else if(i == (link - 1)){
+                    p_table[i - 1] += excess;
+                }else{
+                    spwm_split_excess(&p_table[i - 1], &p_table[i + 1], 1, excess, min_pulse);
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Same as spwm_limit_short_pulses(), for a quarter of the quarter wave layout. (see spwm_quarter_arrays())
+     * 
+     * @param p_quarter The (mf / 2) values of one quarter. The last one is the centre of mirror image (played 
+     * once per cycle). All others are played twice (forward & reverse). The first one is next to a link, which
+     * is never changed.
+     * @param len   Number of values. (= mf / 2)
+     * 
+     * @note
+     * A change of a value is same in both of its copies, so the mirror image is kept. The time given to (or taken 
+     * from) the centre value counts twice. An odd excess of a short centre value stays in it (as 1 count), so that
+     * the total duration of cycle stays exact. As in spwm_limit_short_pulses(), the quarter is passed again till 
+     * no value is short.
+     */
+    SPWM_LUT_CONSTEXPR void spwm_limit_quarter_pulses(uint32_t* p_quarter, uint16_t len, const spwm_corrections_t* p_corr){
+        int32_t min_pulse = (int32_t)p_corr->min_pulse;
+        int32_t target = (p_corr->short_pulse_mode == SPWM_PULSE_DROP) ? 0 : min_pulse;
+        uint16_t centre = len - 1;
+        int32_t value = 0;
+        int32_t excess = 0;     //+ve: given to neighbours, -ve: taken from neighbours
+        int32_t half = 0;
+        bool changed = true;
+
+        for(uint16_t pass = 0; changed && (pass < len); pass++){
+            changed = false;
+            for(uint16_t i = 0; i < len; i++){
+                value = (int32_t)p_quarter[i];
+                if((value >= min_pulse) || (value == target)){
+                    continue;
+                }
+                excess = value - target;
+
+                if(i == centre){
+                    //Both neighbours are the copies of previous value
+                    half = (excess >= 0) ? (excess / 2) : -((1 - excess) / 2);
+                    p_quarter[i] = (uint32_t)(target + (excess - (2 * half)));
+                    p_quarter[i - 1] += half;
+                    changed = changed || (half != 0);
+                }else if(i == 0){
+                    p_quarter[i] = (uint32_t)target;
+                    p_quarter[i + 1] += (i + 1 == centre) ? (2 * excess) : excess;
+                    changed = true;
+                }else{
+                    p_quarter[i] = (uint32_t)target;
+                    spwm_split_excess(&p_quarter[i - 1], &p_quarter[i + 1], (i + 1 == centre) ? 2 : 1, excess, min_pulse);
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Computes the carrier & signal wave details used while searching the crossing points.
+     * 
+     * @param ma    Amplitude modulation index. (see spwm_unipolar_arrays() for the other parameters)
+     * @param sine_fixed_point  true for the Q31 sine table, false for double precision sin().
+     * @param strategy  SPWM_STRATEGY_MIN_MAX adds the zero sequence to the sine wave. (others use the sine wave)
+     * @param sampling  SPWM_SAMPLING_NATURAL, SPWM_SAMPLING_SYMMETRIC or SPWM_SAMPLING_ASYMMETRIC.
+     * @param cp    Receives the details.
+     * 
+     * @returns Duration of a quarter of the carrier cycle. 0 if mf is not a multiple of 4.
+     * (The signal duration is (4 * mf) times of it)
+     */
+    SPWM_LUT_CONSTEXPR uint32_t spwm_crossing_setup(uint8_t signal_freq, uint16_t mf, double ma, bool sine_fixed_point,
+                                uint8_t strategy, uint8_t sampling, spwm_crossing_params_t* cp){
+        /// Each quarter of the sine wave must hold complete cycles of carrier wave.
+        if( (mf < 4) || ((mf % 4) != 0) ){
+            return 0;
+        }
+
+        /// Duration for one full cycle of triangular carrier wave where ach count = 1 T_STEP.
+        uint32_t carrier_duration_quarter = (uint32_t)(1.0f/(T_STEP * (double)(signal_freq * mf * 4 )));
+        uint32_t carrier_duration_half = (2 * carrier_duration_quarter); 
+        uint32_t carrier_duration = (4 * carrier_duration_quarter);
+       
+        /// Slope of triangular carrier wave which ramps from 1v to -1V and back to 1V.
+        /// Slope = deta_Y / delta_X = ( 0-1 ) / ( 0 - Quarter carrier wave duration )
+        ///       = 1 / Quarter carrier wave duration
+        ///       = 1 / ( quarter duration count * T_STEP )
+        /// For reducing the speed of calculation in subsequent steps, the formula arrived is as-
+        /// Slope = ( scaling_factor * T_STEP ) / ( quarter duration count * T_STEP )
+        ///       = scaling_factor  / quarter duration count
+        int32_t carrier_slope = scaling_factor / carrier_duration_quarter; 
+
+        /// The slope is truncated to an integer, so the carrier would not reach exactly 0V at the quarter end.
+        /// (e.g. for mf = 1024 it is still at 88 counts). A small signal crossing in that gap was missed and 
+        /// the table had holes. Therefore the carrier amplitude (1V) is taken as slope x quarter duration count.
+        /// Now the carrier is exactly 0V at the 1st & 3rd quarter ends and +/-1V at the half & full cycle.
+        int32_t carrier_peak = carrier_slope * (int32_t)carrier_duration_quarter;
+
+        ///Duration for one full cycle of signal (i.e. signal where each count = 1 T_STEP.
+        uint32_t signal_duration = (carrier_duration * mf);
+        
+        /// omega = w = 2 * PI * signal_frequency 
+        ///  = 2 * PI * ( 1 / ( signal_duration count * T_STEP ) )
+        /// The T_STEP is also to be mutipilied in numerator to speed up the calculations in subsequent steps
+        /// w = ( 2 * PI * T_STEP ) / ( signal_duration count * T_STEP )
+        /// After removing T_STEP, finally -
+        /// w = ( 2 * PI ) / signal_duration
+        double omega = (2.0f * PI) / (double)signal_duration;
+
+        /// The ma is used to scale the signal sine wave. In addition the sine wave itself is 
+        /// required to scaled up to the carrier amplitude. Therfore -
+        /// ma_scaled = ma * carrier_peak.
+        uint32_t ma_scaled = (ma * carrier_peak); 
+
+        cp->fixed_point = sine_fixed_point;
+        cp->ma_scaled = ma_scaled;
+        cp->carrier_peak = carrier_peak;
+        cp->carrier_slope = carrier_slope;
+        cp->omega = omega;
+        if(sine_fixed_point){
+            cp->phase_step = spwm_phase_step(signal_duration);
+            /// sine_step = ma_scaled * (2 * PI / signal_duration), rounded up. (+1 for the interpolation in sine table)
+            cp->sine_step = (int32_t)(((uint64_t)ma_scaled * 6283186u) / ((uint64_t)scaling_factor * signal_duration)) + 2;
+        }else{
+            cp->sine_step = (int32_t)ceil(ma_scaled * omega);
+        }
+        cp->carrier_duration_half = carrier_duration_half;
+        cp->sampling = sampling;
+
+        /// The zero sequence changes upto 1.5 times faster than the sine wave (at the zero crossing of a phase), and
+        /// its Q31 terms add upto 4 counts of rounding. It is not monotonic within the 1st quarter (it peaks at 60 deg),
+        /// so the crossing estimated from the amplitude at a quarter end can be late by upto one quarter x 
+        /// (sine_step / carrier_slope).
+        cp->zero_sequence = (strategy == SPWM_STRATEGY_MIN_MAX);
+        cp->estimate_slack = 0;
+        if(cp->zero_sequence){
+            cp->sine_step = ((3 * cp->sine_step) / 2) + 1 + 4;
+            cp->estimate_slack = (((uint32_t)cp->sine_step * carrier_duration_quarter) / (uint32_t)carrier_slope) + 1;
+        }
+        return carrier_duration_quarter;
+    }
+
+    /**
+     * @brief Earliest time of a crossing, from its estimate at a quarter end. (see spwm_carrier_crossings())
+     * 
+     * @param estimate  Crossing time estimated from the signal amplitude at the quarter end.
+     * @param earliest  Time before which the signal can not cross the carrier. (start of its quarter for a signal
+     * of opposite sign, else start of the ramp)
+     * 
+     * @note
+     * Within each quarter of the sine wave, its amplitude moves only one way. So a crossing can not be before
+     * its estimate. The zero sequence is not monotonic, so its estimate is moved back by estimate_slack.
+     */
+    SPWM_LUT_CONSTEXPR uint32_t spwm_crossing_estimate(const spwm_crossing_params_t* cp, uint32_t estimate, uint32_t earliest){
+        if(cp->estimate_slack == 0){
+            return estimate;
+        }
+        return (estimate > (earliest + cp->estimate_slack)) ? (estimate - cp->estimate_slack) : earliest;
+    }
+
+    /**
+     * @brief Half width of a regular sampled pulse: (Q x sample / carrier_peak), rounded to nearest & limited to Q.
+     * 
+     * @param amplitude Sample of the signal. (same scale as the carrier)
+     * @param carrier_duration_quarter  Duration of a quarter of the carrier cycle (Q).
+     */
+    constexpr int32_t spwm_sampled_offset(const spwm_crossing_params_t* cp, int32_t amplitude, uint32_t carrier_duration_quarter){
+        int32_t half_slope = cp->carrier_slope / 2;
+        int32_t offset = (amplitude >= 0) ? ((amplitude + half_slope) / cp->carrier_slope) 
+                                          : -(((-amplitude) + half_slope) / cp->carrier_slope);
+        int32_t limit = (int32_t)carrier_duration_quarter;
+        return (offset > limit) ? limit : ((offset < -limit) ? -limit : offset);
+    }
+
+    /**
+     * @brief Same as spwm_carrier_crossings(), for regular sampling. The 4 crossings have a closed form.
+     * 
+     * @note
+     * With a sample r held on the falling ramp (1 - t / Q) and r' on the rising ramp (-3 + t / Q), the edges are
+     * Q x (1 - r) & Q x (1 + r) for s1 & s2 (= -s1), and Q x (3 - r') & Q x (3 + r'). So the ON duration of s1 is 
+     * Q x (2 + r + r'), i.e. (T / 2) x (1 + ma x sin(wt_k)) for r = r'. No crossing search is needed.
+     * - SPWM_SAMPLING_SYMMETRIC : r = r' = sample at the middle of carrier cycle. (1 sine evaluation)
+     * - SPWM_SAMPLING_ASYMMETRIC : r & r' are samples at the middle of each ramp. (2 sine evaluations)
+     */
+    SPWM_LUT_CONSTEXPR void spwm_sampled_crossings(const spwm_crossing_params_t* cp, uint32_t carrier_start,
+                                uint32_t carrier_duration_quarter, uint32_t* p_t, int32_t* p_lead){
+        uint32_t carrier_duration_half = (2 * carrier_duration_quarter);
+        uint32_t carrier_duration_3_quarter = (3 * carrier_duration_quarter);
+        int32_t falling_amplitude = 0;
+        int32_t rising_amplitude = 0;
+        if(cp->sampling == SPWM_SAMPLING_SYMMETRIC){
+            falling_amplitude = spwm_signal_amplitude(cp, carrier_start + carrier_duration_half, false);
+            rising_amplitude = falling_amplitude;
+        }else{
+            falling_amplitude = spwm_signal_amplitude(cp, carrier_start + carrier_duration_quarter, false);
+            rising_amplitude = spwm_signal_amplitude(cp, carrier_start + carrier_duration_3_quarter, false);
+        }
+        int32_t falling = spwm_sampled_offset(cp, falling_amplitude, carrier_duration_quarter);
+        int32_t rising = spwm_sampled_offset(cp, rising_amplitude, carrier_duration_quarter);
+        p_t[0] = carrier_duration_quarter - falling;
+        p_t[1] = carrier_duration_quarter + falling;
+        p_t[2] = carrier_duration_3_quarter - rising;
+        p_t[3] = carrier_duration_3_quarter + rising;
+
+        if(p_lead != NULL){
+            //Rounding of the offsets (Q16). None where an offset is limited to Q.
+            int32_t falling_lead = 0;
+            int32_t rising_lead = 0;
+            if((falling != (int32_t)carrier_duration_quarter) && (falling != -(int32_t)carrier_duration_quarter)){
+                falling_lead = (int32_t)((((int64_t)falling_amplitude * 0x10000) / cp->carrier_slope) - ((int64_t)falling * 0x10000));
+            }
+            if((rising != (int32_t)carrier_duration_quarter) && (rising != -(int32_t)carrier_duration_quarter)){
+                rising_lead = (int32_t)((((int64_t)rising_amplitude * 0x10000) / cp->carrier_slope) - ((int64_t)rising * 0x10000));
+            }
+            p_lead[0] = falling_lead;
+            p_lead[1] = -falling_lead;
+            p_lead[2] = rising_lead;
+            p_lead[3] = -rising_lead;
+        }
+    }
+
+    /**
+     * @brief Finds the 4 crossings of one carrier cycle in the 1st quarter of sine wave. (see spwm_generate_arrays())
+     * 
+     * @param carrier_start Start time of the carrier cycle. (= n * carrier_duration)
+     * @param carrier_duration_quarter  Duration of a quarter of the carrier cycle. (from spwm_crossing_setup())
+     * @param p_t   Receives the tri_time_counter (time from carrier_start) of 4 crossings:
+     * [0] s1 goes above the falling carrier, [1] s2 goes above the falling carrier,
+     * [2] rising carrier goes above s2, [3] rising carrier goes above s1.
+     * A value past the end of its quarter (of carrier cycle) means no crossing was found.
+     * @param p_lead    NULL, or receives the time (Q16 T_STEP) by which each true crossing is before its p_t.
+     * (0 upto 1 T_STEP for natural sampling, -0.5 upto 0.5 for regular sampling. See SPWM_EDGE_DITHER)
+     */
+    SPWM_LUT_CONSTEXPR void spwm_carrier_crossings(const spwm_crossing_params_t* cp, uint32_t carrier_start,
+                                uint32_t carrier_duration_quarter, uint32_t* p_t, int32_t* p_lead = NULL){
+        if(cp->sampling != SPWM_SAMPLING_NATURAL){
+            spwm_sampled_crossings(cp, carrier_start, carrier_duration_quarter, p_t, p_lead);
+            return;
+        }
+        uint32_t carrier_duration_half = (2 * carrier_duration_quarter);
+        uint32_t carrier_duration_3_quarter = (3 * carrier_duration_quarter);
+        uint32_t carrier_duration = (4 * carrier_duration_quarter);
+
+        //1st quarter of the carrier wave (s1 ON edge)
+        //Find the Sinewave amplitude at next known time (Here on 1 quarter end of carrier wave)
+        // = sin( w * t )
+        // = sin( ( 2.pi().Fs ) . ( T_COUNT.T_STEP ) )
+        // = sin( (2.pi() / ( T_fs.T_STEP ) ) . ( T_COUNT.T_STEP ) )
+        // Eliminating T_STEP from numerator & Denominator
+        // = sin( ( 2.pi() / T_fs ) . T_COUNT )
+        // omega is actualy pre-calulated this way
+        // = sin(w . T_COUNT)
+        int32_t s1_amplitude = spwm_signal_amplitude(cp, carrier_start + carrier_duration_quarter, false);
+        
+        // Estimates the time when carrier wave will reach to sin wave amplitude as calculated above
+        // for carrier wave 1V = 1,000,000 counts (i.e. = scaling_factor)
+        // at t= Tx the tri_time_counter = (Vinitial - Vslope@Tx) = s1_amplitude
+        // Vinitial - ( Slope . Tx) = s1_amplitude
+        // Vinitial - ( Slope . T_count . T_STEP) = s1_amplitude
+        // After Rearranging for T_count (note T_ count is tri_time_counter)
+        // T_Count  = Vinitial - s1_amplitude / (Slope . T_STEP)
+        //          = Vinitial - s1_amplitude / ( (1 / Quarter_duration . T_STEP) . T_STEP )
+        // After removing T_STEP from denominator
+        //  T_Count  = Vinitial - s1_amplitude / ( (1 / Quarter_duration ) )
+        // Divide numerator by scaling_factor as voltages are scaledup with the scaling_factor
+        // T_Count  = Vinitial - s1_amplitude / (scaling_factor . (1 / Quarter_duration ) )
+        // The calculation in denominator = slope and it is already implemented. Therefore finally
+        // T_Count  = Vinitial - s1_amplitude / carrier slope
+        // with Vinitial = 1v = carrier_peak (~1000000), final equation is:
+        uint32_t tri_time_counter = spwm_crossing_estimate(cp, (cp->carrier_peak - s1_amplitude) / cp->carrier_slope, 0);
+        
+        // Futher calculations are performed only between this estinated time and when the
+        // signal amplitude goes above carrier wave. 
+        // (In this quarterof tri wave carrier only s1 needs comparison s2 can be ignored)
+        // At the quarter end the carrier is at 0V. So a +ve s1 always crosses it at or before the quarter end. 
+        p_t[0] = spwm_find_crossing(cp, carrier_start, tri_time_counter, carrier_duration_quarter + 1, false, false);
+        SPWM_LUT_MARK(SPWM_PROF_QUARTER_1);
+
+        //2nd quarter of the carrier wave (s2 ON edge)
+        //s2 is the inverse of s1, so its amplitude at the same time instance is already known.
+        int32_t s2_amplitude = -1 * s1_amplitude;
+        tri_time_counter = spwm_crossing_estimate(cp, ((cp->carrier_peak - s2_amplitude) / cp->carrier_slope),
+                                                carrier_duration_quarter);
+        p_t[1] = spwm_find_crossing(cp, carrier_start, tri_time_counter, carrier_duration_half + 1, true, false);
+        SPWM_LUT_MARK(SPWM_PROF_QUARTER_2);
+
+        //3rd quarter of the carrier wave (s2 OFF edge)
+        s1_amplitude = spwm_signal_amplitude(cp, carrier_start + carrier_duration_3_quarter, false);
+        s2_amplitude = -1 * s1_amplitude;
+        tri_time_counter = spwm_crossing_estimate(cp, ((cp->carrier_peak + s2_amplitude) / cp->carrier_slope) + carrier_duration_half,
+                                                carrier_duration_half);
+        p_t[2] = spwm_find_crossing(cp, carrier_start, tri_time_counter, carrier_duration_3_quarter + 1, true, true);
+        SPWM_LUT_MARK(SPWM_PROF_QUARTER_3);
+
+        //4th quarter of the carrier wave (s1 OFF edge)
+        //The s1 amplitude at 3 quarter end of carrier wave is already known from above.
+        tri_time_counter = spwm_crossing_estimate(cp, ((cp->carrier_peak + s1_amplitude) / cp->carrier_slope) + carrier_duration_half,
+                                                carrier_duration_3_quarter);
+        p_t[3] = spwm_find_crossing(cp, carrier_start, tri_time_counter, carrier_duration + 1, false, true);
+        SPWM_LUT_MARK(SPWM_PROF_QUARTER_4);
+
+        if(p_lead != NULL){
+            //The margin grows by about carrier_slope in one T_STEP. (The sine wave moves much slower)
+            //So the margin at the crossing found gives its lead over the true crossing.
+            const bool s2[4] = {false, true, true, false};
+            for(uint8_t k = 0; k < 4; k++){
+                p_lead[k] = 0;
+                if(p_t[k] <= ((k + 1u) * carrier_duration_quarter)){
+                    int64_t margin = spwm_crossing_margin(cp, carrier_start, p_t[k], s2[k], (k >= 2));
+                    int64_t lead = (margin * 0x10000) / cp->carrier_slope;
+                    p_lead[k] = (lead < 0) ? 0 : ((lead > 0xFFFF) ? 0xFFFF : (int32_t)lead);
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Rounds an edge to the nearest T_STEP with error feedback. (SPWM_EDGE_DITHER)
+     * 
+     * @param time_counter  Edge found by the crossing search. (from the start of signal wave)
+     * @param lead  Time (Q16 T_STEP) by which the true crossing is before time_counter. (see spwm_carrier_crossings())
+     * @param p_error   Rounding error (Q16) carried from the previous edge of same signal. Updated for the next edge.
+     * @param previous  Previous edge of same signal. The edge is never moved before it.
+     * @param limit     The edge is never moved after it. (end of the quarter of signal wave)
+     * 
+     * @note The error left by each edge is added to the next one, so the sum of rounding errors stays within
+     * half a T_STEP. The durations are differences of these edges, so the total of a cycle is not changed.
+     */
+    constexpr uint32_t spwm_dither_edge(uint32_t time_counter, int32_t lead, int32_t* p_error, uint32_t previous,
+                                    uint32_t limit){
+        int64_t exact = ((int64_t)time_counter << 16) - lead + *p_error;
+        int64_t edge = (exact + 0x8000) >> 16;
+        if(edge < (int64_t)previous){
+            edge = previous;
+        }
+        if(edge > (int64_t)limit){
+            edge = limit;
+        }
+        int64_t error = exact - (edge << 16);
+        *p_error = (error > 0x10000) ? 0x10000 : ((error < -0x10000) ? -0x10000 : (int32_t)error);
+        return (uint32_t)edge;
+    }
+
+    /**
+     * @brief Core of spwm_unipolar_arrays(). Same parameters & results, see spwm_lut.cpp for the details.
+     * 
+     * @param sine_fixed_point  true for the Q31 sine table, false for double precision sin().
+     * 
+     * @param strategy  SPWM_STRATEGY_UNIPOLAR for s1 & s2 tables. SPWM_STRATEGY_BIPOLAR copies the s1 table (and its 
+     * sync) into H2, to be played with its HIGH & LOW sides swapped. SPWM_STRATEGY_MIN_MAX adds the zero sequence to s1 & s2. (only 
+     * the s1 table is used, as the 1st phase of 3 phase tables)
+     * 
+     * @param sampling  Sampling of the sine wave. (see SPWM_SAMPLING in spwm_lut.h)
+     * 
+     * @param quarter_layout    true to store only the unique values of both tables in p_h1_high (p_h2_high is not 
+     * used). See spwm_quarter_arrays() in spwm_lut.cpp for this layout. Not for SPWM_STRATEGY_BIPOLAR.
+     * 
+     * @note
+     * It is a constexpr function (unless SPWM_LUT_STATS is set). With sine_fixed_point = true the compiler can run it to fill const tables 
+     * (see spwm_make_const_tables()). The runtime generator uses the same code, so both give the same tables.
+     */
+    SPWM_LUT_CONSTEXPR uint32_t spwm_generate_arrays( uint8_t signal_freq, uint16_t mf, double ma,
+                                uint32_t* p_h1_high, uint32_t* p_h2_high,
+                                uint32_t* h1_sync, uint32_t* h2_sync, const spwm_corrections_t* p_corr,
+                                bool sine_fixed_point, uint8_t strategy, uint8_t sampling, bool quarter_layout = false ){
+        SPWM_LUT_MARK(SPWM_PROF_LUT_CALL);
+
+        /// Details of carrier & signal waves used while searching the crossing points.
+        spwm_crossing_params_t cp = {};
+        uint32_t carrier_duration_quarter = spwm_crossing_setup(signal_freq, mf, ma, sine_fixed_point, strategy, sampling, &cp);
+        if( (carrier_duration_quarter == 0) || (quarter_layout && (strategy == SPWM_STRATEGY_BIPOLAR)) ){
+            return 0;
+        }
+        uint32_t carrier_duration_half = (2 * carrier_duration_quarter); 
+        uint32_t carrier_duration_3_quarter = (3 * carrier_duration_quarter);
+        uint32_t carrier_duration = (4 * carrier_duration_quarter);
+
+        ///Duration for one full cycle of signal (i.e. signal where each count = 1 T_STEP.
+        uint32_t signal_duration = (carrier_duration * mf);
+        uint32_t signal_duration_quarter = (signal_duration / 4);
+        
+        /// Main sinusoidal signal
+        bool s1_sync_captured = false;
+        uint32_t h1_sync_raw = 0;
+        uint32_t h1_high_val_old = 0;
+
+        /// Complemetary sinusoidal signal (inverse of main signal)
+        bool s2_sync_captured = false;
+        uint32_t h2_sync_raw = 0;
+        uint32_t h2_high_val_old = 0;
+
+        /// Holds the running time of signal wave (max count = one complete cycle). 1 count = 1 T_STEP
+        uint32_t time_counter = 0;
+        /// Hold the running time of triangular carrier wave (max count = one complete cycle). 1 count = 1 T_STEP
+        uint32_t tri_time_counter = 0;
+
+        /// Pointer for accessing the array elements, initialised to different locations of the arrays
+        uint32_t* p_h1_ref1 = p_h1_high;
+        uint32_t* p_h1_ref2 = NULL;
+        uint32_t* p_h1_ref3 = NULL;
+        uint32_t* p_h1_ref4 = NULL;
+        uint32_t* p_h2_ref1 = NULL;
+        uint32_t* p_h2_ref2 = NULL;
+        uint32_t* p_h2_ref3 = NULL;
+        uint32_t* p_h2_ref4 = NULL;
+        if(quarter_layout){
+            //Only the 1st quarter of s1 & s2 is stored. (The mirrored & swapped copies are played by DMA)
+            p_h2_ref1 = p_h1_high + (mf/2);             //[128] first element of 1st quarter of s2
+        }else{
+            //Pointer to the elements of first array (First half of H Bridge)
+            p_h1_ref2 = p_h1_high + (mf-2);     //pointer to last-1 element of +ve half of sine wave s1 [254]
+            p_h1_ref3 = p_h1_high + mf;         //pointer to first element of -ve half of sine wave s1 [256]
+            p_h1_ref4 = p_h1_high + ((mf*2)-2); //pointer to last-1 element of -ve half of sine wave s1 [510]
+            
+            //Pointer to the elements of Second Array (Second half of H Bridge)
+            p_h2_ref1 = p_h2_high;              //pointer to first element of +ve half of sine wave s2 [0]
+            p_h2_ref2 = p_h2_high + (mf-2);     //pointer to last-1 element of +ve half of sine wave s2 [254]
+            p_h2_ref3 = p_h2_high + mf;         //pointer to first element of -ve half of sine wave s2 [256]
+            p_h2_ref4 = p_h2_high + ((mf*2)-2); //pointer to last-1 element of -ve half of sine wave s1 [510]
+        }
+
+        uint16_t array_mid_point = (mf-1);
+        uint16_t array_end_point = (2 * mf) - 1;
+
+        uint16_t n = 0;                     // carrier wave cycle counter                 
+        uint32_t result = 0;
+        uint16_t short_pulses = 0;          // Number of values shorter than min_pulse after correction
+        uint16_t max_cycle_counts = (mf/4); // Max limit for carrier wave cycle counts in one quarter of a sine wave
+        
+        /// Start time of the present carrier wave cycle. (= n * carrier_duration)
+        uint32_t carrier_start = 0;
+
+        /// Crossings of the present carrier wave cycle (see spwm_carrier_crossings())
+        uint32_t crossing[4] = {};
+    #if SPWM_EDGE_DITHER
+        /// Lead of the true crossings & rounding error carried to the next edge of s1 & s2 (Q16 T_STEP)
+        int32_t lead[4] = {};
+        int32_t s1_error = 0;
+        int32_t s2_error = 0;
+    #endif
+
+        SPWM_LUT_MARK(SPWM_PROF_LUT_SETUP);
+
+        //run one complete tri_wave carrier through its 4 quarters
+        while (n < max_cycle_counts) { 
+            //printf("N:%3d\n", n);
+            carrier_start = n * carrier_duration;
+        #if SPWM_EDGE_DITHER
+            spwm_carrier_crossings(&cp, carrier_start, carrier_duration_quarter, crossing, lead);
+        #else
+            spwm_carrier_crossings(&cp, carrier_start, carrier_duration_quarter, crossing);
+        #endif
+            
+            //-------------------------------------------------------
+            //Calculations during first quarter of the carrier wave
+            //-------------------------------------------------------
+            tri_time_counter = crossing[0];
+            time_counter = carrier_start + tri_time_counter;
+
+            if(tri_time_counter <= carrier_duration_quarter) {
+            #if SPWM_EDGE_DITHER
+                time_counter = spwm_dither_edge(time_counter, lead[0], &s1_error, h1_high_val_old, signal_duration_quarter);
+            #endif
+                if(!s1_sync_captured){
+                    h1_sync_raw = time_counter;
+                    *h1_sync = spwm_correct_value(time_counter, p_corr, &short_pulses);    //Capture the sync count for 1st sine wave
+                    //printf("n:%3d T1:%8d", n, tri_time_counter); 
+                    s1_sync_captured = true;
+                }else{
+                    //printf("n:%3d T1:%8d", n, tri_time_counter);  
+                    result = spwm_correct_value(time_counter - h1_high_val_old, p_corr, &short_pulses);
+
+                    *p_h1_ref1 = result;  //S1 Array - Original location
+                    p_h1_ref1++;
+                    if(!quarter_layout){
+                        *p_h1_ref2 = result;  //S1 Array - Mirror location
+                        p_h1_ref2--;
+                        *p_h2_ref3 = result;  //S2 Array - Copy of S1 original location
+                        p_h2_ref3++;
+                        *p_h2_ref4 = result;  //S2 Array - Copy of S1 mirror location
+                        p_h2_ref4--;
+                    }
+                }
+                //Setup for next crossing of s1
+                h1_high_val_old = time_counter;
+            }
+
+            //-------------------------------------------------------
+            //Calculations during second quarter of the carrier wave
+            //-------------------------------------------------------
+            tri_time_counter = crossing[1];
+            time_counter = carrier_start + tri_time_counter;
+
+            if(tri_time_counter <= carrier_duration_half){
+            #if SPWM_EDGE_DITHER
+                time_counter = spwm_dither_edge(time_counter, lead[1], &s2_error, h2_high_val_old, signal_duration_quarter);
+            #endif
+                if(!s2_sync_captured){
+                    h2_sync_raw = time_counter;
+                    *h2_sync = spwm_correct_value(time_counter, p_corr, &short_pulses);    //Capture the sync count for second sine wave
+                    //printf(" T2:%8d", tri_time_counter);
+
+                    result = spwm_correct_value(h1_sync_raw + h2_sync_raw, p_corr, &short_pulses);
+                    if(quarter_layout){
+                        *(p_h1_high + mf + SPWM_QUARTER_MID) = result;      //OFF duration between the half cycles
+                        *(p_h1_high + mf + SPWM_QUARTER_LINK_H1) = result;  //Links of both tables into next cycle
+                        *(p_h1_high + mf + SPWM_QUARTER_LINK_H2) = result;
+                    }else{
+                        *(p_h1_high + array_mid_point) = result; //array1[255] : end of +ve halfcycle and start of -ve halfcycle
+                        *(p_h1_high + array_end_point) = result; //array1[511] : last location. end of full cycle.
+                        *(p_h2_high + array_mid_point) = result; //array2[255]: end of +ve halfcycle and start of -ve halfcycle
+                        *(p_h2_high + array_end_point) = result; //array2[511] : last location. end of full cycle.
+                    }
+                    
+                    s2_sync_captured = true;
+                }else{
+                    //printf(" T2:%8d", tri_time_counter);
+                    result = spwm_correct_value(time_counter - h2_high_val_old, p_corr, &short_pulses);
+
+                    *p_h2_ref1 = result;  //S2 Array - Original location
+                    p_h2_ref1++;
+                    if(!quarter_layout){
+                        *p_h2_ref2 = result;  //S2 Array - Mirror location
+                        p_h2_ref2--;
+                        *p_h1_ref3 = result;  //S1 Array - Copy of S2 original location
+                        p_h1_ref3++;
+                        *p_h1_ref4 = result;  //S1 Array - Copy of S2 mirror location
+                        p_h1_ref4--;
+                    }
+                }
+                //Setup for next crossing of s2
+                h2_high_val_old = time_counter;
+            }
+
+            //-------------------------------------------------------
+            //Calculations during third quarter of the carrier wave
+            //-------------------------------------------------------
+            tri_time_counter = crossing[2];
+            time_counter = carrier_start + tri_time_counter;
+
+            if(tri_time_counter <= carrier_duration_3_quarter){
+            #if SPWM_EDGE_DITHER
+                time_counter = spwm_dither_edge(time_counter, lead[2], &s2_error, h2_high_val_old, signal_duration_quarter);
+            #endif
+                result = spwm_correct_value(time_counter - h2_high_val_old, p_corr, &short_pulses);
+
+                *p_h2_ref1 = result;  //S2 Array - Original location
+                p_h2_ref1++;
+                if(!quarter_layout){
+                    *p_h2_ref2 = result;  //S2 Array - Mirror location
+                    p_h2_ref2--;
+                    *p_h1_ref3 = result;  //S1 Array - Copy of S2 original location
+                    p_h1_ref3++;
+                    *p_h1_ref4 = result;  //S1 Array - Copy of S2 mirror location
+                    p_h1_ref4--;
+                }
+                
+                //Setup for next crossing of s2
+                h2_high_val_old = time_counter;
+            }
+
+            //-------------------------------------------------------
+            //Calculations during fourth quarter of the carrier wave
+            //-------------------------------------------------------
+            tri_time_counter = crossing[3];
+            time_counter = carrier_start + tri_time_counter;
+
+            if(tri_time_counter <= carrier_duration){
+            #if SPWM_EDGE_DITHER
+                time_counter = spwm_dither_edge(time_counter, lead[3], &s1_error, h1_high_val_old, signal_duration_quarter);
+            #endif
+                result = spwm_correct_value(time_counter - h1_high_val_old, p_corr, &short_pulses);
+
+                *p_h1_ref1 = result;  //S1 Array - Original location
+                p_h1_ref1++;
+                if(!quarter_layout){
+                    *p_h1_ref2 = result;  //S1 Array - Mirror location
+                    p_h1_ref2--;
+                    *p_h2_ref3 = result;  //S2 Array - Copy of S1 original location
+                    p_h2_ref3++;
+                    *p_h2_ref4 = result;  //S2 Array - Copy of S1 mirror location
+                    p_h2_ref4--;
+                }
+                
+                //Setup for next crossing of s1
+                h1_high_val_old = time_counter;
+            }
+            
+            //printf("Cycle:%3d of %3d complete\n", n, max_cycle_counts);
+            n++;    //run next carrier wave (0 to (mf *2)-1)
+        }//while (time_counter < signal_duration_quarter)    
+        //printf("Cycle:%3d of %3d complete\n", n, max_cycle_counts);
+        
+        //------------------------------------
+        //The above computations were for the first 90 degree of the sine wave s1 & s2.
+        //For 90 to 180 deg the Symmtry of sine wave was used and values were copied.
+        //Similary for 180 to 270 degree the symmetry used and values computed for s2 were copied.
+        //Same operations performed for computing all the array elements of s2.
+        //
+        //Total [mf/4] cycles of tri wave carriers ( = 64 if mf = 256 ) are travelled.
+        //And during this (mf/4) ON durations ( = 64 if mf = 256 ) and 
+        //[(mf/40) - 1] OFF durations ( = 63 if mf = 256 ) were computed and stored. 
+        //
+        //The code below computes the last remaining OFF duration for both the sine waves & stores. 
+        //(i.e. the element number 127 in array range from 0 to 511 if mf=256)
+        //Note: Multiplication by 2 is for using the symmetry of wave at 90 deg
+        result = spwm_correct_value(2 * (signal_duration_quarter - h1_high_val_old ), p_corr, &short_pulses);
+        *p_h1_ref1 = result;    //Array S1 element 127
+        if(!quarter_layout){
+            *p_h2_ref3 = result;    //copy same into S2 Array element number 383
+        }
+        
+        //Note: Multiplication by 2 is for using the symmetry of wave at 90 deg
+        result = spwm_correct_value(2 * (signal_duration_quarter - h2_high_val_old ), p_corr, &short_pulses);
+        *p_h2_ref1 = result;    //Array S1 element 127
+        if(!quarter_layout){
+            *p_h1_ref3 = result;    ///copy same into S1 Array element number 383
+        }
+
+        //Fix the pulses which are too short for the PIO program
+        if(short_pulses > 0){
+            if(quarter_layout){
+                spwm_limit_quarter_pulses(p_h1_high, (mf / 2), p_corr);
+                spwm_limit_quarter_pulses(p_h1_high + (mf / 2), (mf / 2), p_corr);
+            }else{
+                spwm_limit_short_pulses(p_h1_high, (2 * mf), p_corr);
+                spwm_limit_short_pulses(p_h2_high, (2 * mf), p_corr);
+            }
+            
+            //The sync values are used only once at start, a simple clamp is enough.
+            if((int32_t)*h1_sync < (int32_t)p_corr->min_pulse){
+                *h1_sync = p_corr->min_pulse;
+            }
+            if((int32_t)*h2_sync < (int32_t)p_corr->min_pulse){
+                *h2_sync = p_corr->min_pulse;
+            }
+        }
+
+        //Bipolar: H2 is the complement of H1. Its SM plays the same values, starting on the HIGH side. (see main.cpp)
+        if(strategy == SPWM_STRATEGY_BIPOLAR){
+            for(uint16_t i = 0; i < (2 * mf); i++){
+                p_h2_high[i] = p_h1_high[i];
+            }
+            *h2_sync = *h1_sync;
+        }
+        SPWM_LUT_MARK(SPWM_PROF_LUT_FINISH);
+
+        return(signal_duration);
+    }//spwm_generate_arrays()
+
+    /**
+     * @brief Carrier cycles by which phase k lags the 1st phase. k x (mf / phases), except for bipolar H2 (0).
+     */
+    constexpr uint16_t spwm_phase_lag(uint16_t mf, uint8_t phases, uint8_t k, uint8_t strategy){
+        return (strategy == SPWM_STRATEGY_BIPOLAR) ? 0 : (k * (mf / phases));
+    }
+
+    /**
+     * @brief Position of phase k in the table of 1st phase, and its sync value.
+     *
+     * @param p_ref     Table of 1st phase. (2 * mf values)
+     * @param ref_sync  Sync value of 1st phase.
+     * @param k     Phase number. Phase k lags the 1st phase by (k * 360 / phases) deg.
+     * @param p_sync    Receives the sync value of phase k.
+     * @param strategy  Modulation strategy. (see spwm_phase_lag())
+     *
+     * @returns Index of the 1st value of phase k in the table of 1st phase. (The table of phase k is that table
+     * rotated by this many values)
+     *
+     * @note
+     * Phase k lags by k x (mf / phases) carrier cycles. At time 0 it starts with carrier cycle 'start' of 1st phase.
+     * Each carrier cycle holds one ON & one OFF value. The OFF value before the first crossing of that carrier cycle
+     * becomes the link into next cycle (last value of the table).
+     */
+    SPWM_LUT_CONSTEXPR uint16_t spwm_phase_start(const uint32_t* p_ref, uint32_t ref_sync, uint16_t mf, uint8_t phases, uint8_t k,
+                                uint32_t signal_duration, const spwm_corrections_t* p_corr, uint32_t* p_sync,
+                                uint8_t strategy){
+        uint32_t carrier_duration = signal_duration / mf;
+        uint32_t offset = (p_corr == NULL) ? 0 : (p_corr->dead_time + p_corr->pio_overhead);
+        uint16_t start = (mf - spwm_phase_lag(mf, phases, k, strategy)) % mf;
+        uint16_t first = 2 * start;
+
+        //Sync = time from start of that carrier cycle to its first crossing (ON edge). (Sum of raw values)
+        uint32_t edge = ref_sync + offset;
+        for(uint16_t i = 0; i < first; i++){
+            edge += p_ref[i] + offset;
+        }
+        *p_sync = edge - (start * carrier_duration) - offset;
+        if( (p_corr != NULL) && ((int32_t)*p_sync < (int32_t)p_corr->min_pulse) ){
+            *p_sync = p_corr->min_pulse;
+        }
+        return first;
+    }
+
+    /**
+     * @brief Core of spwm_phase_arrays(). Same parameters & results, see spwm_lut.cpp for the details.
+     *
+     * @param sine_fixed_point  true for the Q31 sine table, false for double precision sin().
+     * @param strategy  Modulation strategy. SPWM_STRATEGY_BIPOLAR needs phases = 2, SPWM_STRATEGY_MIN_MAX needs 
+     * phases = 3. (0 is returned otherwise)
+     * @param sampling  Sampling of the sine wave. (see SPWM_SAMPLING in spwm_lut.h)
+     *
+     * @note
+     * The crossings are searched only once, for the 1st phase (with spwm_generate_arrays()). As mf is a multiple
+     * of phases, the phase shift (signal_duration / phases) holds complete carrier cycles and the carrier is same
+     * for all the phases. So the table of phase k is the table of 1st phase rotated by (2 * mf * k / phases) values.
+     */
+    SPWM_LUT_CONSTEXPR uint32_t spwm_generate_phase_arrays( uint8_t signal_freq, uint16_t mf, double ma, uint8_t phases,
+                                uint32_t* const* pp_tables, uint32_t* p_syncs, const spwm_corrections_t* p_corr,
+                                bool sine_fixed_point, uint8_t strategy, uint8_t sampling ){
+        if( (phases < 2) || ((mf % phases) != 0) ){
+            return 0;
+        }
+        if( ((strategy == SPWM_STRATEGY_BIPOLAR) && (phases != 2)) || ((strategy == SPWM_STRATEGY_MIN_MAX) && (phases != 3)) ){
+            return 0;
+        }
+
+        //The 2nd table is a scratch for the 180 deg table (it is exact for phases = 2, also for bipolar H2)
+        uint32_t signal_duration = spwm_generate_arrays(signal_freq, mf, ma, pp_tables[0], pp_tables[1],
+                                        &p_syncs[0], &p_syncs[1], p_corr, sine_fixed_point, strategy, sampling);
+        if( (signal_duration == 0) || (phases == 2) ){
+            return signal_duration;
+        }
+
+        uint16_t len = 2 * mf;
+        const uint32_t* p_ref = pp_tables[0];
+
+        for(uint8_t k = 1; k < phases; k++){
+            uint16_t first = spwm_phase_start(p_ref, p_syncs[0], mf, phases, k, signal_duration, p_corr, &p_syncs[k], strategy);
+            for(uint16_t i = 0; i < len; i++){
+                pp_tables[k][i] = p_ref[(first + i) % len];
+            }
+        }
+        return signal_duration;
+    }//spwm_generate_phase_arrays()
+
+    /**
+     * @brief Alignment of a table of (2 * mf) values. Its own size if that is a power of two, else a word.
+     */
+    constexpr uint32_t spwm_table_align(uint16_t mf){
+        return (((2u * mf * 4u) & ((2u * mf * 4u) - 1u)) == 0) ? (2u * mf * 4u) : 4u;
+    }
+
+
+    /// Lookup tables computed by the compiler. They are placed as const data in flash.
+    /// The tables are aligned to their own size (if it is a power of two) so that DMA can use its ring. 
+    template <uint16_t MF>
+    struct spwm_const_tables_t {
+        alignas(spwm_table_align(MF)) uint32_t h1_high[2 * MF];
+        alignas(spwm_table_align(MF)) uint32_t h2_high[2 * MF];
+        uint32_t h1_sync;
+        uint32_t h2_sync;
+        uint32_t signal_duration;   //0 if MF is not supported
+    };
+
+    /**
+     * @brief Computes the corrected lookup tables at compile time.
+     * 
+     * @tparam MF   Freq modulation index. Must be a multiple of 4.
+     * 
+     * @note
+     * Use it only to initialise a constexpr variable, e.g.
+     * constexpr spwm_const_tables_t<256> tables = spwm_make_const_tables<256>(50, 0.8, &corr);
+     * The Q31 sine table is used as double precision sin() can not be evaluated by the compiler. The tables are 
+     * same as those of spwm_unipolar_arrays() built with SPWM_SINE_FIXED_POINT=1.
+     * The strategy is SPWM_STRATEGY_UNIPOLAR or SPWM_STRATEGY_BIPOLAR (H bridge tables). Any sampling can be used.
+     */
+    template <uint16_t MF>
+    constexpr spwm_const_tables_t<MF> spwm_make_const_tables(uint8_t signal_freq, double ma, const spwm_corrections_t* p_corr,
+                                                            uint8_t strategy = SPWM_STRATEGY_UNIPOLAR,
+                                                            uint8_t sampling = SPWM_SAMPLING_NATURAL){
+        spwm_const_tables_t<MF> tables = {};
+        tables.signal_duration = spwm_generate_arrays(signal_freq, MF, ma, tables.h1_high, tables.h2_high, 
+                                                    &tables.h1_sync, &tables.h2_sync, p_corr, true, strategy, sampling);
+        return tables;
+    }
+
+    #undef PI
+    #undef T_STEP
+    #undef scaling_factor
+    #undef SPWM_LUT_COUNT
+    #undef SPWM_LUT_CONSTEXPR
+    #undef SPWM_LUT_MARK
+#endif
@@ -0,0 +1,305 @@
+#include "spwm_patch.h"
+#include "spwm_alloc.h"
+#include "spwm_lut_gen.h"
+
+//Crossings of each carrier cycle in the 1st quarter of sine wave, at the 'ma' being played. (see spwm_carrier_crossings())
+//All the values of all the tables are made of these.
+static uint32_t patch_crossing[SPWM_MF_MAX / 4][4];
+static bool patch_done[SPWM_MF_MAX / 4];        //Carrier cycles of 1st quarter already patched for the new 'ma'
+
+static spwm_bank_t* p_patch_bank = NULL;        //Only bank, played by DMA & patched in place
+static const spwm_corrections_t* p_patch_corr = NULL;
+static uint8_t patch_legs = 0;
+static uint8_t patch_freq = 0;
+static uint16_t patch_mf = 0;
+static uint32_t patch_quarter = 0;              //Duration of a quarter of carrier cycle
+static uint16_t patch_start[SPWM_LEGS_MAX];     //Carrier cycle of 1st leg which starts the table of each leg
+
+/**
+ * @brief Carrier cycle of the 1st quarter of sine wave whose crossings make a carrier cycle of 1st leg.
+ *
+ * @param c Carrier cycle of 1st leg (0 to mf - 1).
+ */
+static uint16_t source_carrier(uint16_t c){
+    uint16_t quarter = patch_mf / 4;
+    uint16_t half = patch_mf / 2;
+    if(c < quarter){
+        return c;                   //s1
+    }else if(c < half){
+        return half - 1 - c;        //Mirror image of s1
+    }else if(c < (half + quarter)){
+        return c - half;            //s2
+    }
+    return patch_mf - 1 - c;        //Mirror image of s2
+}
+
+/**
+ * @brief Raw ON edge (from the start of carrier cycle) & ON duration of a carrier cycle of 1st leg.
+ */
+static void carrier_pulse(uint16_t c, uint32_t* p_edge, uint32_t* p_on){
+    uint16_t quarter = patch_mf / 4;
+    uint16_t half = patch_mf / 2;
+    uint32_t carrier_duration = 4 * patch_quarter;
+    const uint32_t* t = patch_crossing[source_carrier(c)];
+
+    if(c < half){
+        *p_edge = (c < quarter) ? t[0] : (carrier_duration - t[3]);
+        *p_on = t[3] - t[0];
+    }else{
+        *p_edge = (c < (half + quarter)) ? t[1] : (carrier_duration - t[2]);
+        *p_on = t[2] - t[1];
+    }
+}
+
+/**
+ * @brief Corrected value of the table of 1st leg, from the crossings.
+ *
+ * @param j Index of the value (0 to 2 * mf - 1). An even one is the ON duration of carrier cycle (j / 2).
+ * An odd one is the OFF duration from there to the ON edge of next carrier cycle.
+ * @param p_value   Receives the value.
+ *
+ * @returns false if the value is shorter than min_pulse after correction.
+ *
+ * @note The values are same as those of spwm_phase_arrays(), if the tables have no short pulse.
+ */
+static bool table_value(uint16_t j, uint32_t* p_value){
+    uint32_t edge = 0;
+    uint32_t on = 0;
+    carrier_pulse(j / 2, &edge, &on);
+
+    uint32_t raw = on;
+    if((j & 1) != 0){
+        uint32_t next_edge = 0;
+        uint32_t next_on = 0;
+        carrier_pulse(((j / 2) + 1) % patch_mf, &next_edge, &next_on);
+        raw = (4 * patch_quarter) - edge - on + next_edge;
+    }
+
+    uint32_t offset = 0;
+    uint32_t min_pulse = 0;
+    if(p_patch_corr != NULL){
+        offset = p_patch_corr->dead_time + p_patch_corr->pio_overhead;
+        min_pulse = p_patch_corr->min_pulse;
+    }
+    if(raw < (offset + min_pulse)){
+        return false;
+    }
+    *p_value = raw - offset;
+    return true;
+}
+
+/**
+ * @brief Checks if DMA is far enough from some consecutive values of a leg table.
+ *
+ * @param first Index of the 1st value.
+ * @param count Number of values.
+ *
+ * @note
+ * DMA may pick the values of a carrier cycle (OFF before it, its ON & OFF after it) all before or all after they
+ * are written, but not some of each. Otherwise the edges of that carrier cycle would be played partly for the 
+ * old 'ma' and partly for the new one. So DMA must not be between them, or within SPWM_PATCH_GUARD words before them.
+ */
+static bool dma_is_clear(uint8_t leg, uint16_t first, uint16_t count){
+    uint32_t len = 2 * patch_mf;
+    uint32_t guard_start = (first + len - SPWM_PATCH_GUARD) % len;
+    uint32_t read = spwm_swap_read_index(leg);
+    return (((read + len - guard_start) % len) >= (uint32_t)(SPWM_PATCH_GUARD + count));
+}
+
+/**
+ * @brief Rewrites the values made of one carrier cycle of 1st quarter of sine wave, on all the legs.
+ *
+ * @param q Carrier cycle of 1st quarter (0 to mf/4 - 1). It makes 4 carrier cycles of each table: s1, its
+ * mirror image, s2 & its mirror image.
+ * @param p_cp  Carrier & signal wave details for the new 'ma'.
+ *
+ * @returns false if a new value would be too short (nothing is written then).
+ *
+ * @note
+ * The values of each of the 4 carrier cycles are written together. The values of 2 neighbours (around 0, 90, 180 
+ * & 270 deg) share an OFF value, so these are written together. Each leg is written separately, so that DMA is 
+ * never waited for more than a few carrier cycles.
+ */
+static bool patch_carrier(uint16_t q, const spwm_crossing_params_t* p_cp){
+    uint32_t crossing[4];
+    spwm_carrier_crossings(p_cp, q * 4 * patch_quarter, patch_quarter, crossing);
+    for(uint8_t k = 0; k < 4; k++){
+        if(crossing[k] > ((k + 1) * patch_quarter)){
+            return false;
+        }
+    }
+
+    uint32_t old_crossing[4];
+    for(uint8_t k = 0; k < 4; k++){
+        old_crossing[k] = patch_crossing[q][k];
+        patch_crossing[q][k] = crossing[k];
+    }
+
+    //Runs of neighbouring carrier cycles (in table of 1st leg) made of q: 1st carrier cycle & number of them
+    uint16_t len = 2 * patch_mf;
+    uint16_t quarter = patch_mf / 4;
+    uint16_t half = patch_mf / 2;
+    uint16_t run_start[4];
+    uint16_t run_carriers[4];
+    uint8_t runs = 0;
+    if(q == 0){
+        run_start[0] = patch_mf - 1;        //s2 mirror image at 360 deg & s1 at 0 deg
+        run_start[1] = half - 1;            //s1 mirror image & s2 at 180 deg
+        run_carriers[0] = run_carriers[1] = 2;
+        runs = 2;
+    }else if(q == (quarter - 1)){
+        run_start[0] = q;                   //s1 & its mirror image at 90 deg
+        run_start[1] = half + q;            //s2 & its mirror image at 270 deg
+        run_carriers[0] = run_carriers[1] = 2;
+        runs = 2;
+    }else{
+        run_start[0] = q;
+        run_start[1] = half - 1 - q;
+        run_start[2] = half + q;
+        run_start[3] = patch_mf - 1 - q;
+        run_carriers[0] = run_carriers[1] = run_carriers[2] = run_carriers[3] = 1;
+        runs = 4;
+    }
+
+    //Each run has the OFF value before it, then ON & OFF of each carrier cycle
+    uint16_t run_first[4];
+    uint16_t run_count[4];
+    uint32_t value[4][5];
+    for(uint8_t r = 0; r < runs; r++){
+        run_first[r] = ((2 * run_start[r]) + len - 1) % len;
+        run_count[r] = (2 * run_carriers[r]) + 1;
+        for(uint16_t w = 0; w < run_count[r]; w++){
+            if(!table_value((run_first[r] + w) % len, &value[r][w])){
+                for(uint8_t k = 0; k < 4; k++){
+                    patch_crossing[q][k] = old_crossing[k];
+                }
+                return false;
+            }
+        }
+    }
+
+    //Table of each leg is that of 1st leg rotated by (2 * patch_start) values
+    for(uint8_t leg = 0; leg < patch_legs; leg++){
+        uint16_t rotation = 2 * patch_start[leg];
+        for(uint8_t r = 0; r < runs; r++){
+            uint16_t first = (run_first[r] + len - rotation) % len;
+
+            //Wait (if required) till DMA has passed the values. It is never more than a few carrier cycles.
+            uint32_t irq_status;
+            while(true){
+                irq_status = save_and_disable_interrupts();
+                if(dma_is_clear(leg, first, run_count[r])){
+                    break;
+                }
+                restore_interrupts(irq_status);
+                tight_loop_contents();
+            }
+            for(uint16_t w = 0; w < run_count[r]; w++){
+                p_patch_bank->p_table[leg][(first + w) % len] = value[r][w];
+            }
+            restore_interrupts(irq_status);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Fills the tables of the only bank from the crossings, and keeps these for later patches.
+ *
+ * @param p_bank    Bank to be played by DMA. Its tables are rewritten here, so call it before spwm_swap_init().
+ * @param legs  Number of legs (phases). mf must be a multiple of it.
+ * @param signal_freq, mf, ma, p_corr   Same as used for spwm_fill_bank(). (The sync values are taken from it)
+ *
+ * @returns false if mf is not supported (less than SPWM_PATCH_MF_MIN) or if a value is shorter than min_pulse
+ * after correction.
+ *
+ * @note The values are same as those of spwm_fill_bank(), if the tables have no short pulse.
+ */
+bool spwm_patch_init(spwm_bank_t* p_bank, uint8_t legs, uint8_t signal_freq, uint16_t mf, double ma,
+                    const spwm_corrections_t* p_corr){
+    p_patch_bank = NULL;
+    if( (mf < SPWM_PATCH_MF_MIN) || (mf > SPWM_MF_MAX) || (legs < 2) || (legs > SPWM_LEGS_MAX) || ((mf % legs) != 0) ){
+        return false;
+    }
+
+    spwm_crossing_params_t cp = {};
+    patch_quarter = spwm_crossing_setup(signal_freq, mf, ma, (SPWM_SINE_FIXED_POINT != 0), SPWM_STRATEGY, SPWM_SAMPLING, &cp);
+    if(patch_quarter == 0){
+        return false;
+    }
+    p_patch_corr = p_corr;
+    patch_legs = legs;
+    patch_freq = signal_freq;
+    patch_mf = mf;
+
+    //Phase k lags the 1st phase by k x (mf / legs) carrier cycles (bipolar H2 by none). (see spwm_phase_start())
+    for(uint8_t leg = 0; leg < legs; leg++){
+        patch_start[leg] = (mf - spwm_phase_lag(mf, legs, leg, SPWM_STRATEGY)) % mf;
+    }
+
+    for(uint16_t q = 0; q < (mf / 4); q++){
+        spwm_carrier_crossings(&cp, q * 4 * patch_quarter, patch_quarter, patch_crossing[q]);
+        for(uint8_t k = 0; k < 4; k++){
+            if(patch_crossing[q][k] > ((k + 1) * patch_quarter)){
+                return false;
+            }
+        }
+    }
+
+    uint16_t len = 2 * mf;
+    for(uint8_t leg = 0; leg < legs; leg++){
+        for(uint16_t i = 0; i < len; i++){
+            if(!table_value(((2 * patch_start[leg]) + i) % len, &p_bank->p_table[leg][i])){
+                return false;
+            }
+        }
+    }
+    p_patch_bank = p_bank;
+    return true;
+}
+
+/**
+ * @brief Changes 'ma' of the tables being played, without a second bank & without stopping PIO & DMA.
+ *
+ * The carrier cycles are patched in the order DMA plays them, starting from the one after the carrier cycle
+ * being read by the 1st leg. Each carrier cycle of the 1st quarter of sine wave is computed once and its
+ * mirrored & inverted counterparts (on all the legs) are written with it. Half a fundamental cycle holds one
+ * of these counterparts for every carrier cycle, so all the values are rewritten in one pass.
+ *
+ * @param ma    New amplitude modulation index.
+ *
+ * @returns false if the crossings can not be found or a value would be shorter than min_pulse after correction.
+ * The carrier cycles patched till then keep the new 'ma'. (The tables stay consistent, try a lower 'ma')
+ *
+ * @note
+ * The new 'ma' reaches the outputs after the words already in TX FIFO, i.e. in about 4 carrier cycles.
+ * The total duration of each carrier cycle stays exact, so the pulse edges are never torn at the boundary of
+ * patched & old values. The call returns after all the values are rewritten. (about the time of spwm_fill_bank())
+ */
+bool spwm_patch_set_ma(double ma){
+    if(p_patch_bank == NULL){
+        return false;
+    }
+
+    spwm_crossing_params_t cp = {};
+    if(spwm_crossing_setup(patch_freq, patch_mf, ma, (SPWM_SINE_FIXED_POINT != 0), SPWM_STRATEGY, SPWM_SAMPLING, &cp) != patch_quarter){
+        return false;
+    }
+
+    for(uint16_t q = 0; q < (patch_mf / 4); q++){
+        patch_done[q] = false;
+    }
+
+    uint16_t next = (spwm_swap_read_index(0) / 2) + 1;
+    for(uint16_t i = 0; i < (patch_mf / 2); i++){
+        uint16_t q = source_carrier((next + i) % patch_mf);
+        if(patch_done[q]){
+            continue;
+        }
+        if(!patch_carrier(q, &cp)){
+            return false;
+        }
+        patch_done[q] = true;
+    }
+    return true;
+}
@@ -0,0 +1,26 @@
+#ifndef SPWM_PATCH
+    #define SPWM_PATCH
+
+    #include "pico/stdlib.h"
+    #include "spwm_lut.h"
+    #include "spwm_swap.h"
+
+    //Changes of 'ma' by patching the tables being played. Pass cmake -DSPWM_INCREMENTAL_PATCH=1 for it.
+    //0 : the spare bank is refilled & swapped in at the start of next fundamental cycle. (spwm_swap.cpp)
+    //1 : only one bank. The values are rewritten in place, one carrier cycle at a time, starting just ahead of
+    //    the DMA. (spwm_patch.cpp)
+    #ifndef SPWM_INCREMENTAL_PATCH
+        #define SPWM_INCREMENTAL_PATCH 0
+    #endif
+
+    //Max number of table words which DMA may read while the values of one carrier cycle are being written.
+    //The values are not written while DMA is this close to them (or between them).
+    #define SPWM_PATCH_GUARD 4
+
+    //Min mf for patching. Below it the values being written (with the guard) would be most of a table.
+    #define SPWM_PATCH_MF_MIN 16
+
+    bool spwm_patch_init(spwm_bank_t* p_bank, uint8_t legs, uint8_t signal_freq, uint16_t mf, double ma,
+                        const spwm_corrections_t* p_corr);
+    bool spwm_patch_set_ma(double ma);
+#endif
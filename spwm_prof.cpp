@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include "hardware/structs/m33.h"
+#include "hardware/clocks.h"
+#include "hardware/sync.h"
+#include "spwm_prof.h"
+#include "spwm_lut_gen.h"
+
+#if SPWM_LUT_STATS
+//Counters updated by the LUT generator (see SPWM_LUT_STATS in spwm_lut_gen.h)
+spwm_lut_stats_t spwm_lut_stats;
+#endif
+
+//Ring buffer in RAM. Printing is done only on request (spwm_prof_dump()), never while recording.
+static spwm_prof_record_t prof_ring[SPWM_PROF_RING_SIZE];
+static uint32_t prof_count = 0;                 //Total records written (index of next record = count % size)
+
+//Values at previous record of each core. (Each core has its own DWT cycle counter)
+static uint32_t prof_last_cycles[2];
+static uint32_t prof_last_iterations[2];
+static uint32_t prof_last_sine_evals[2];
+
+static spin_lock_t* p_prof_lock = NULL;
+
+static const char* const prof_event_names[SPWM_PROF_EVENTS] = {
+    "init", "lut_call", "lut_setup", "quarter_1", "quarter_2", "quarter_3", "quarter_4", "lut_finish",
+    "alloc", "pio_setup", "dma_setup", "sync_out_setup", "pio_start"
+};
+
+/**
+ * @brief Starts the DWT cycle counter of the calling core.
+ */
+static inline void start_cycle_counter(void){
+    m33_hw->demcr |= M33_DEMCR_TRCENA_BITS;
+    m33_hw->dwt_ctrl |= M33_DWT_CTRL_CYCCNTENA_BITS;
+}
+
+static inline uint8_t saturate_u8(uint32_t value){
+    return (value > 255) ? 255 : (uint8_t)value;
+}
+
+/**
+ * @brief Clears the ring buffer & starts recording. Call once at boot before any other call.
+ */
+void spwm_prof_init(void){
+    if(p_prof_lock == NULL){
+        p_prof_lock = spin_lock_instance(spin_lock_claim_unused(true));
+    }
+    prof_count = 0;
+    start_cycle_counter();
+    spwm_prof_mark(SPWM_PROF_INIT);
+}
+
+/**
+ * @brief Records the cycles spent since the previous record of this core (i.e. in the phase ending with 'event').
+ *
+ * Along with cycles, the crossing search iterations & sine evaluations done by the LUT generator are recorded.
+ * The cycle counter of the other core is started on its first record.
+ */
+void __not_in_flash_func(spwm_prof_mark)(uint8_t event){
+    if((m33_hw->dwt_ctrl & M33_DWT_CTRL_CYCCNTENA_BITS) == 0){
+        start_cycle_counter();
+    }
+    uint32_t cycles = m33_hw->dwt_cyccnt;
+    uint core = get_core_num();
+
+    uint32_t irq_status = spin_lock_blocking(p_prof_lock);
+    spwm_prof_record_t* p_record = &prof_ring[prof_count & (SPWM_PROF_RING_SIZE - 1)];
+    p_record->cycles = cycles - prof_last_cycles[core];
+    p_record->event = event;
+    p_record->core = (uint8_t)core;
+#if SPWM_LUT_STATS
+    p_record->iterations = saturate_u8(spwm_lut_stats.iterations - prof_last_iterations[core]);
+    p_record->sine_evals = saturate_u8(spwm_lut_stats.sine_evals - prof_last_sine_evals[core]);
+    prof_last_iterations[core] = spwm_lut_stats.iterations;
+    prof_last_sine_evals[core] = spwm_lut_stats.sine_evals;
+#else
+    p_record->iterations = 0;
+    p_record->sine_evals = 0;
+#endif
+    prof_count++;
+    spin_unlock(p_prof_lock, irq_status);
+
+    //The time taken by this function is not charged to the next phase
+    prof_last_cycles[core] = m33_hw->dwt_cyccnt;
+}
+
+/**
+ * @brief Prints the records (oldest first) followed by a summary of each event, e.g. over USB.
+ *
+ * @note
+ * The records are copied out of the ring first, so recording can go on while printing.
+ */
+void spwm_prof_dump(void){
+    static spwm_prof_record_t records[SPWM_PROF_RING_SIZE];
+    uint32_t irq_status = spin_lock_blocking(p_prof_lock);
+    uint32_t count = prof_count;
+    for(uint32_t i = 0; i < SPWM_PROF_RING_SIZE; i++){
+        records[i] = prof_ring[i];
+    }
+    spin_unlock(p_prof_lock, irq_status);
+
+    uint32_t first = (count > SPWM_PROF_RING_SIZE) ? (count - SPWM_PROF_RING_SIZE) : 0;
+    float cycles_per_us = (float)clock_get_hz(clk_sys) / 1.0e6f;
+
+    uint32_t event_count[SPWM_PROF_EVENTS] = {0};
+    uint64_t event_cycles[SPWM_PROF_EVENTS] = {0};
+    uint32_t event_max[SPWM_PROF_EVENTS] = {0};
+
+    printf("---- Profile: %lu records (%lu lost) ----\n", (unsigned long)(count - first), (unsigned long)first);
+    printf("  #    core event           cycles        us  iter  sine\n");
+    for(uint32_t n = first; n < count; n++){
+        const spwm_prof_record_t* p_record = &records[n & (SPWM_PROF_RING_SIZE - 1)];
+        uint8_t event = (p_record->event < SPWM_PROF_EVENTS) ? p_record->event : 0;
+        printf("%6lu %u %-14s %10lu %9.2f %5u %5u\n", (unsigned long)n, p_record->core, prof_event_names[event], 
+                (unsigned long)p_record->cycles, p_record->cycles / cycles_per_us, p_record->iterations, p_record->sine_evals);
+        event_count[event]++;
+        event_cycles[event] += p_record->cycles;
+        if(p_record->cycles > event_max[event]){
+            event_max[event] = p_record->cycles;
+        }
+    }
+
+    printf("---- Summary ----\n");
+    printf("event           count     total_us    mean_cycles  max_cycles\n");
+    for(uint8_t event = 0; event < SPWM_PROF_EVENTS; event++){
+        if(event_count[event] == 0){
+            continue;
+        }
+        printf("%-14s %6lu %12.2f %12lu %11lu\n", prof_event_names[event], (unsigned long)event_count[event],
+                event_cycles[event] / cycles_per_us, (unsigned long)(event_cycles[event] / event_count[event]),
+                (unsigned long)event_max[event]);
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef SPWM_PROF
+    #define SPWM_PROF
+
+    #include "pico/stdlib.h"
+
+    //Number of records held in RAM ring buffer. Must be a power of two. The oldest records are overwritten.
+    #ifndef SPWM_PROF_RING_SIZE
+        #define SPWM_PROF_RING_SIZE 1024
+    #endif
+
+    //Events recorded by the profiler. Each record holds the cycles spent since the previous record,
+    //i.e. in the phase ending with this event.
+    #define SPWM_PROF_INIT 0            //Profiler started
+    #define SPWM_PROF_LUT_CALL 1        //Anything done before calling the LUT generator
+    #define SPWM_PROF_LUT_SETUP 2       //LUT generator: carrier & signal parameters
+    #define SPWM_PROF_QUARTER_1 3       //LUT generator: 1st quarter of a carrier cycle (one edge)
+    #define SPWM_PROF_QUARTER_2 4       //LUT generator: 2nd quarter of a carrier cycle (one edge)
+    #define SPWM_PROF_QUARTER_3 5       //LUT generator: 3rd quarter of a carrier cycle (one edge)
+    #define SPWM_PROF_QUARTER_4 6       //LUT generator: 4th quarter of a carrier cycle (one edge)
+    #define SPWM_PROF_LUT_FINISH 7      //LUT generator: last OFF durations & the correction of short pulses
+    #define SPWM_PROF_ALLOC 8           //Allocation of tables
+    #define SPWM_PROF_PIO_SETUP 9       //Setup of the PIO SMs for both half bridges
+    #define SPWM_PROF_DMA_SETUP 10      //Setup of the DMA channels
+    #define SPWM_PROF_SYNC_OUT_SETUP 11 //Setup of the SYNC_OUT SM
+    #define SPWM_PROF_PIO_START 12      //Start of all SMs
+    #define SPWM_PROF_EVENTS 13
+
+    /// One record in the ring buffer
+    typedef struct {
+        uint32_t cycles;        //CPU cycles since previous record (DWT cycle counter)
+        uint8_t event;          //SPWM_PROF_xxx
+        uint8_t iterations;     //Crossing search iterations since previous record (saturated to 255)
+        uint8_t sine_evals;     //Sine evaluations since previous record (saturated to 255)
+        uint8_t core;           //Core which recorded the event
+    } spwm_prof_record_t;
+
+    //Records an event. It compiles to nothing if SPWM_PROFILE is not set.
+    #if SPWM_PROFILE
+        #define SPWM_PROF_MARK(event) spwm_prof_mark(event)
+    #else
+        #define SPWM_PROF_MARK(event)
+    #endif
+
+    void spwm_prof_init(void);
+    void spwm_prof_mark(uint8_t event);
+    void spwm_prof_dump(void);
+#endif
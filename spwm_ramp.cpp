@@ -0,0 +1,133 @@
+#include "spwm_ramp.h"
+#include "spwm_alloc.h"
+#if SPWM_FAULT_TRIP
+    #include "spwm_trip.h"
+#endif
+
+//Settings of the ramp being played (see spwm_ramp_start())
+static uint8_t ramp_legs = 0;
+static uint8_t ramp_signal_freq = 0;
+static uint16_t ramp_mf = 0;
+static double ramp_ma_target = 0;
+static uint16_t ramp_cycles = 0;
+static const spwm_corrections_t* p_ramp_corr = NULL;
+
+static uint16_t ramp_step = 0;              //Last step published (0 : the boot tables)
+static bool ramp_running = false;           //true till the target is published, or the ramp is stopped
+static uint16_t ramp_late = 0;              //Steps published after their fundamental cycle (see spwm_ramp_late())
+static uint32_t ramp_period_us = 0;         //Duration of one fundamental cycle
+static uint64_t ramp_publish_us = 0;        //Time of the last publish (or of the start)
+
+/**
+ * @brief 'ma' of a step of the soft start. It rises in equal steps from 0 to the target.
+ *
+ * @param step  0 (tables at boot) to cycles (target 'ma').
+ * @param cycles    Number of fundamental cycles of the ramp.
+ * @param ma_target 'ma' at the end of ramp.
+ */
+double spwm_ramp_ma(uint16_t step, uint16_t cycles, double ma_target){
+    if( (cycles == 0) || (step >= cycles) ){
+        return ma_target;
+    }
+    return (ma_target * step) / cycles;
+}
+
+/**
+ * @brief Starts stepping 'ma' from the boot tables (step 0) to the target, one step in each fundamental cycle.
+ *
+ * The steps are taken by spwm_ramp_poll(), so the caller is not blocked for the (cycles) fundamental cycles.
+ *
+ * @param legs, signal_freq, mf, p_corr   Same as used for the boot tables. (p_corr must stay valid till the end)
+ * @param ma_target 'ma' at the end of ramp.
+ * @param cycles    Number of fundamental cycles of the ramp. (e.g. 50 for 1s at 50Hz)
+ *
+ * @note
+ * Call once, just after the SMs are started with the tables of spwm_ramp_ma(0, ...).
+ * Only from core0 before spwm_core1_start(), as it uses the swaps directly. No other swap may be published 
+ * while spwm_ramp_active().
+ */
+void spwm_ramp_start(uint8_t legs, uint8_t signal_freq, uint16_t mf, double ma_target, uint16_t cycles,
+                    const spwm_corrections_t* p_corr){
+    ramp_legs = legs;
+    ramp_signal_freq = signal_freq;
+    ramp_mf = mf;
+    ramp_ma_target = ma_target;
+    ramp_cycles = cycles;
+    p_ramp_corr = p_corr;
+    ramp_step = 0;
+    ramp_late = 0;
+    ramp_running = (cycles != 0);
+    ramp_period_us = spwm_swap_get_active()->signal_duration / 100;    //T_STEP = 10ns
+    ramp_publish_us = time_us_64();
+}
+
+/**
+ * @brief Takes the next step of the ramp, if the spare bank is free. Never waits for it.
+ *
+ * The tables of each step are filled into the spare bank while the previous step is being played, and 
+ * swapped in at the start of next cycle. (see spwm_swap_publish()) The spare bank is free from the start of 
+ * the cycle in which the previous step is played, so a step is in time if it is polled (and filled) within
+ * that cycle. Else the previous 'ma' is played for one more cycle, and the step is counted as late.
+ * The table computation takes tens of us. So polling every ms leaves most of each cycle to spare.
+ *
+ * @returns true while the ramp runs. false once the target 'ma' is published, or if the ramp is stopped
+ * (the tables of a step could not be filled, or the fault trip stopped the switching).
+ *
+ * @note
+ * This is CPU paced: the swaps need a poll in each fundamental cycle. The late steps are found from the 
+ * time between two publishes (over 1.5 cycles), which holds while the jitter of the polls is under half a cycle.
+ */
+bool spwm_ramp_poll(void){
+    if(!ramp_running){
+        return false;
+    }
+#if SPWM_FAULT_TRIP
+    if(spwm_trip_tripped()){
+        ramp_running = false;   //Table DMA is aborted. The swap would never complete.
+        return false;
+    }
+#endif
+    //Spare bank is free when all the legs have started the previous step
+    spwm_bank_t* p_bank = spwm_swap_get_spare();
+    if(p_bank == NULL){
+        return true;
+    }
+
+    uint16_t step = ramp_step + 1;
+    if(spwm_fill_bank(p_bank, ramp_legs, ramp_signal_freq, ramp_mf, spwm_ramp_ma(step, ramp_cycles, ramp_ma_target), 
+                        p_ramp_corr) == 0){
+        ramp_running = false;
+        return false;
+    }
+    spwm_swap_publish();
+
+    uint64_t now_us = time_us_64();
+    if((now_us - ramp_publish_us) > (ramp_period_us + (ramp_period_us / 2))){
+        ramp_late++;
+    }
+    ramp_publish_us = now_us;
+    ramp_step = step;
+    ramp_running = (step < ramp_cycles);
+    return ramp_running;
+}
+
+/**
+ * @brief Checks if the ramp is being played. Other changes of the tables must wait till it ends.
+ */
+bool spwm_ramp_active(void){
+    return ramp_running;
+}
+
+/**
+ * @brief Checks if the ramp has published the tables of the target 'ma'. (false if it was stopped before)
+ */
+bool spwm_ramp_reached(void){
+    return (ramp_step >= ramp_cycles);
+}
+
+/**
+ * @brief Number of steps published after their fundamental cycle, i.e. the previous 'ma' was played once more.
+ */
+uint16_t spwm_ramp_late(void){
+    return ramp_late;
+}
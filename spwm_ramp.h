@@ -0,0 +1,23 @@
+#ifndef SPWM_RAMP
+    #define SPWM_RAMP
+
+    #include "pico/stdlib.h"
+    #include "spwm_lut.h"
+    #include "spwm_swap.h"
+
+    //Soft start at power-on. Pass cmake -DSPWM_SOFT_START=1 for it.
+    //0 : the SMs start with the tables of the target 'ma'.
+    //1 : the SMs start with 'ma' = 0 (50% duty, no output voltage). 'ma' is then stepped up once in each
+    //    fundamental cycle, by swaps of the spare bank. The steps are taken by polls of the idle loop. (see spwm_ramp.cpp)
+    #ifndef SPWM_SOFT_START
+        #define SPWM_SOFT_START 0
+    #endif
+
+    double spwm_ramp_ma(uint16_t step, uint16_t cycles, double ma_target);
+    void spwm_ramp_start(uint8_t legs, uint8_t signal_freq, uint16_t mf, double ma_target, uint16_t cycles,
+                        const spwm_corrections_t* p_corr);
+    bool spwm_ramp_poll(void);
+    bool spwm_ramp_active(void);
+    bool spwm_ramp_reached(void);
+    uint16_t spwm_ramp_late(void);
+#endif
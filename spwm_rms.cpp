@@ -0,0 +1,244 @@
+#include <math.h>
+#include "spwm_rms.h"
+
+//ADC samples written by DMA in a ring. It is aligned to its own size for the DMA ring.
+static volatile uint16_t __attribute__ ((aligned(1u << SPWM_RMS_RING_BITS))) rms_ring[SPWM_RMS_RING];
+
+//Word written into ADC CS by DMA to start each conversion
+static uint32_t rms_start_word = 0;
+
+static int rms_start_dma = -1;          //Starts a conversion at each tick of the DMA timer
+static int rms_drain_dma = -1;          //Takes each sample from ADC FIFO into the ring
+
+static uint32_t rms_read = 0;           //Index of next sample to be processed
+static uint32_t rms_samples_per_cycle = 0;
+static uint32_t rms_count = 0;          //Samples of present cycle processed so far
+static uint64_t rms_sum = 0;            //Sum of samples of present cycle
+static uint64_t rms_sum_sq = 0;         //Sum of squares of samples of present cycle
+static uint64_t rms_rate = 0;           //Samples per second (sys clk * X / Y of DMA timer)
+static uint64_t rms_poll_us = 0;        //Time of the last poll
+static uint32_t rms_lap_count = 0;      //Polls which found the ring lapped by DMA
+static bool rms_exact = false;          //true if the fraction of DMA timer is exact (see spwm_rms_exact())
+static double rms_drift_ppm = 0;        //Error of the approximated sample rate, in ppm
+
+static double reg_ma = 0;               //Present output of regulator
+static double reg_error_old = 0;        //Error of previous cycle
+
+//Greatest common divisor, to reduce the fraction of DMA timer
+static uint32_t rms_gcd(uint32_t a, uint32_t b){
+    while(b != 0){
+        uint32_t r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+/**
+ * @brief Starts sampling the output voltage in sync with the carrier. It runs in the background by DMA only.
+ *
+ * A DMA timer (fraction of sys clk, like the PIO clk) paces a DMA channel which starts one ADC conversion at
+ * each tick. A second DMA channel drains the ADC FIFO into the RAM ring. As both the PIO and the DMA timer
+ * run from sys clk, the samples stay locked to the carrier. No CPU or PIO time is taken.
+ *
+ * @param adc_input ADC input of the voltage sense (0 to 3 for GP26 to GP29, already set with adc_gpio_init()).
+ * @param cycle_sys_clk Duration of one fundamental cycle in sys clk. (signal_duration * PIO clkdiv)
+ * @param samples_per_carrier   ADC samples in each carrier cycle.
+ * @param mf    Freq modulation index. One RMS value is computed for every (samples_per_carrier * mf) samples.
+ *
+ * @returns false if the sampling can not be set up. (more than 65535 samples per cycle, too fast for the ADC, or
+ * more than SPWM_RMS_RING samples in SPWM_RMS_POLL_MS_MAX)
+ *
+ * @note
+ * The sampling is exactly synchronous if the reduced fraction (samples per cycle / cycle_sys_clk) fits in 16 bits.
+ * (e.g. 256 / 3000000 = 4 / 46875 for mf = 256 at 50Hz) Else it is approximated by halving both, and the samples
+ * drift slowly along the carrier. (see spwm_rms_exact() & spwm_rms_drift_ppm()) As for the few ppm of freq tracking.
+ * Call after the SMs are started, so that the samples start near a carrier peak.
+ */
+bool spwm_rms_start(uint adc_input, uint32_t cycle_sys_clk, uint16_t samples_per_carrier, uint16_t mf){
+    uint32_t samples_per_cycle = (uint32_t)samples_per_carrier * mf;
+    if( (samples_per_cycle == 0) || (samples_per_cycle > 0xFFFF) ){
+        return false;
+    }
+
+    //Sample rate = sys clk * X / Y. Both must fit in 16 bits.
+    uint32_t div = rms_gcd(samples_per_cycle, cycle_sys_clk);
+    uint32_t timer_x = samples_per_cycle / div;
+    uint32_t timer_y = cycle_sys_clk / div;
+    bool exact = true;
+    while( (timer_y > SPWM_RMS_TIMER_MAX) || (timer_x > SPWM_RMS_TIMER_MAX) ){
+        timer_x >>= 1;
+        timer_y >>= 1;
+        exact = false;
+    }
+    //ADC needs SPWM_RMS_ADC_SYS_CLK for each conversion
+    if( (timer_x == 0) || (((uint64_t)timer_y) < ((uint64_t)timer_x * SPWM_RMS_ADC_SYS_CLK)) ){
+        return false;
+    }
+    //The ring must hold the samples taken between two polls (and the guard)
+    uint64_t rate = ((uint64_t)clock_get_hz(clk_sys) * timer_x) / timer_y;
+    if( ((rate * SPWM_RMS_POLL_MS_MAX) / 1000) > (SPWM_RMS_RING - SPWM_RMS_RING_GUARD) ){
+        return false;
+    }
+
+    for(uint32_t i = 0; i < SPWM_RMS_RING; i++){
+        rms_ring[i] = 0;
+    }
+    rms_read = 0;
+    rms_samples_per_cycle = samples_per_cycle;
+    rms_count = 0;
+    rms_sum = 0;
+    rms_sum_sq = 0;
+    rms_rate = rate;
+    rms_lap_count = 0;
+    rms_poll_us = time_us_64();
+    //Rate of the timer against the exact rate (samples_per_cycle / cycle_sys_clk). 0 if exact.
+    rms_exact = exact;
+    rms_drift_ppm = exact ? 0 : ((((double)timer_x * cycle_sys_clk) / ((double)timer_y * samples_per_cycle)) - 1.0) * 1.0e6;
+
+    //ADC converts only when started by DMA. Each sample raises DREQ_ADC.
+    adc_init();
+    adc_select_input(adc_input);
+    adc_fifo_setup(true, true, 1, false, false);
+    rms_start_word = adc_hw->cs | ADC_CS_START_ONCE_BITS;
+
+    rms_drain_dma = dma_claim_unused_channel(true);
+    dma_channel_config drain_cfg = dma_channel_get_default_config(rms_drain_dma);
+    channel_config_set_transfer_data_size(&drain_cfg, DMA_SIZE_16);
+    channel_config_set_read_increment(&drain_cfg, false);
+    channel_config_set_write_increment(&drain_cfg, true);
+    channel_config_set_ring(&drain_cfg, true, SPWM_RMS_RING_BITS);       //Wrap-up the write address
+    channel_config_set_dreq(&drain_cfg, DREQ_ADC);
+    dma_channel_configure(
+        rms_drain_dma,
+        &drain_cfg,
+        rms_ring,                               // Write address (RAM ring)
+        &adc_hw->fifo,                          // Read address (ADC FIFO)
+        dma_encode_endless_transfer_count(),    // Never stops. (RP2350)
+        true                                    // Start immediately. (waits for DREQ_ADC)
+    );
+
+    int timer = dma_claim_unused_timer(true);
+    dma_timer_set_fraction(timer, timer_x, timer_y);
+
+    rms_start_dma = dma_claim_unused_channel(true);
+    dma_channel_config start_cfg = dma_channel_get_default_config(rms_start_dma);
+    channel_config_set_transfer_data_size(&start_cfg, DMA_SIZE_32);
+    channel_config_set_read_increment(&start_cfg, false);
+    channel_config_set_write_increment(&start_cfg, false);
+    channel_config_set_dreq(&start_cfg, dma_get_timer_dreq(timer));
+    dma_channel_configure(
+        rms_start_dma,
+        &start_cfg,
+        &adc_hw->cs,                            // Write address (ADC control)
+        &rms_start_word,                        // Read address (START_ONCE with the present settings)
+        dma_encode_endless_transfer_count(),    // Never stops. (RP2350)
+        true                                    // Start immediately. (paced by DMA timer)
+    );
+    return true;
+}
+
+/**
+ * @brief Processes the new samples in the ring upto the end of the next fundamental cycle. It is incremental, so it
+ * can be called at any time.
+ *
+ * @param p_rms Receives the RMS of AC part of the fundamental cycle just completed, in ADC counts.
+ * (The DC bias of voltage sense is removed : RMS^2 = mean of squares - square of mean)
+ *
+ * @returns false if no more cycle is complete. Call it again till then, for one RMS value per cycle.
+ *
+ * @note Call it at least every SPWM_RMS_POLL_MS_MAX. The write address of DMA can not show a lap of the ring, so a
+ * longer gap since the last poll (the samples in it are taken from the DMA timer rate) is taken as a lap: the ring
+ * is dropped & the cycle starts again from the latest sample. (An RMS over any whole cycle is the same, so the
+ * cycle needs no alignment) The laps are counted. (see spwm_rms_laps())
+ */
+bool spwm_rms_poll(uint32_t* p_rms){
+    //Write address of DMA points to the slot after the latest sample
+    uint32_t next = (dma_channel_hw_addr(rms_drain_dma)->write_addr - (uint32_t)rms_ring) / 2;
+    uint64_t now_us = time_us_64();
+    uint64_t samples = ((now_us - rms_poll_us) * rms_rate) / 1000000;
+    rms_poll_us = now_us;
+    if(samples >= (SPWM_RMS_RING - SPWM_RMS_RING_GUARD)){
+        rms_lap_count++;
+        rms_read = next;
+        rms_count = 0;
+        rms_sum = 0;
+        rms_sum_sq = 0;
+        return false;
+    }
+    uint64_t sample = 0;
+
+    while(rms_read != next){
+        sample = rms_ring[rms_read];
+        rms_read = (rms_read + 1) % SPWM_RMS_RING;
+        rms_sum += sample;
+        rms_sum_sq += sample * sample;
+        rms_count++;
+
+        if(rms_count == rms_samples_per_cycle){
+            uint64_t n = rms_count;
+            uint64_t variance = ((rms_sum_sq * n) - (rms_sum * rms_sum)) / (n * n);
+            *p_rms = (uint32_t)(sqrt((double)variance) + 0.5);
+            rms_count = 0;
+            rms_sum = 0;
+            rms_sum_sq = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Number of polls which found the ring lapped by DMA (samples lost, see spwm_rms_poll()).
+ */
+uint32_t spwm_rms_laps(void){
+    return rms_lap_count;
+}
+
+/**
+ * @brief Checks if the samples are exactly locked to the carrier, i.e. the fraction of DMA timer was not approximated.
+ */
+bool spwm_rms_exact(void){
+    return rms_exact;
+}
+
+/**
+ * @brief Error of the sample rate when approximated (see spwm_rms_exact()), in ppm. The samples move along the
+ * carrier by this much of a carrier cycle in each carrier cycle. 0 if exact.
+ */
+double spwm_rms_drift_ppm(void){
+    return rms_drift_ppm;
+}
+
+/**
+ * @brief Sets the starting point of the voltage regulator.
+ *
+ * @param ma    'ma' of the tables being played.
+ */
+void spwm_rms_regulator_init(double ma){
+    reg_ma = ma;
+    reg_error_old = 0;
+}
+
+/**
+ * @brief PI regulator of the output voltage. (velocity form, so the limits of 'ma' also stop the windup)
+ * One step for each fundamental cycle, so the gains do not depend on the poll period.
+ *
+ * @param rms   RMS of one cycle from spwm_rms_poll().
+ * @param target    Target RMS in ADC counts.
+ *
+ * @returns New 'ma' to be played, within SPWM_RMS_MA_MIN & SPWM_RMS_MA_MAX. (see spwm_update_ma())
+ */
+double spwm_rms_regulate(uint32_t rms, uint32_t target){
+    double error = ((double)target - (double)rms) / (double)target;
+
+    reg_ma += (SPWM_RMS_KP * (error - reg_error_old)) + (SPWM_RMS_KI * error);
+    reg_error_old = error;
+
+    if(reg_ma > SPWM_RMS_MA_MAX){
+        reg_ma = SPWM_RMS_MA_MAX;
+    }else if(reg_ma < SPWM_RMS_MA_MIN){
+        reg_ma = SPWM_RMS_MA_MIN;
+    }
+    return reg_ma;
+}
@@ -0,0 +1,64 @@
+#ifndef SPWM_RMS
+    #define SPWM_RMS
+
+    #include "pico/stdlib.h"
+    #include "hardware/adc.h"
+    #include "hardware/dma.h"
+    #include "hardware/clocks.h"
+    #include "spwm_alloc.h"
+
+    //Max time between two calls of spwm_rms_poll(). (The main loop polls every 100 ms)
+    #define SPWM_RMS_POLL_MS_MAX 150
+
+    //Max sample rate (samples per second) which the ring is sized for: one sample per carrier, upto mf = SPWM_MF_MAX 
+    //at 65 Hz. Pass cmake -DSPWM_RMS_RATE_MAX=.. for more samples per carrier. (VOUT_SAMPLES_PER_CARRIER, checked in main.cpp)
+    #ifndef SPWM_RMS_RATE_MAX
+        #define SPWM_RMS_RATE_MAX ((uint64_t)SPWM_MF_MAX * 65)
+    #endif
+
+    //Samples which the ring must hold: those of SPWM_RMS_POLL_MS_MAX at SPWM_RMS_RATE_MAX, and the guard (1/8 of the ring)
+    #define SPWM_RMS_RING_MIN ((((uint64_t)SPWM_RMS_RATE_MAX * SPWM_RMS_POLL_MS_MAX * 8) / 7000) + 1)
+
+    /**
+     * @brief Smallest ring size (in bits of bytes, 2 bytes per sample) which holds a number of samples.
+     */
+    constexpr uint32_t spwm_rms_ring_bits(uint64_t samples){
+        uint32_t bits = 1;
+        while(((1ull << bits) / 2) < samples){
+            bits++;
+        }
+        return bits;
+    }
+
+    //Samples kept in the RAM ring by DMA. Ring size in bytes = (1 << SPWM_RMS_RING_BITS), 2 bytes per sample.
+    //It holds the samples of SPWM_RMS_POLL_MS_MAX (checked by spwm_rms_start()). e.g. 16384 samples (32 KB) for 
+    //SPWM_MF_MAX = 1024, 4096 samples (8 KB) for 256, 1024 samples (2 KB) for 64.
+    #define SPWM_RMS_RING_BITS spwm_rms_ring_bits(SPWM_RMS_RING_MIN)
+    #define SPWM_RMS_RING ((1u << SPWM_RMS_RING_BITS) / 2)
+    static_assert(SPWM_RMS_RING_BITS <= 15, "ADC ring of the voltage loop is over the 32 KB DMA ring. Lower SPWM_RMS_RATE_MAX");
+
+    //Samples which DMA may write while a poll processes the ring. A longer gap since the last poll is taken as a lap.
+    #define SPWM_RMS_RING_GUARD (SPWM_RMS_RING / 8)
+
+    //Max value of DMA timer fraction (X / Y, 16 bits each)
+    #define SPWM_RMS_TIMER_MAX 0xFFFF
+
+    //Min sys clk between two ADC starts. (96 ADC clk of 48MHz = 2us per conversion, at 150MHz sys clk)
+    #define SPWM_RMS_ADC_SYS_CLK 300
+
+    //Limits of 'ma' set by the voltage regulator
+    #define SPWM_RMS_MA_MIN 0.05
+    #define SPWM_RMS_MA_MAX 0.98
+
+    //Gains of the PI regulator, per RMS value (i.e. per fundamental cycle). The error is relative to target.
+    #define SPWM_RMS_KP 0.2
+    #define SPWM_RMS_KI 0.05
+
+    bool spwm_rms_start(uint adc_input, uint32_t cycle_sys_clk, uint16_t samples_per_carrier, uint16_t mf);
+    bool spwm_rms_poll(uint32_t* p_rms);
+    uint32_t spwm_rms_laps(void);
+    bool spwm_rms_exact(void);
+    double spwm_rms_drift_ppm(void);
+    void spwm_rms_regulator_init(double ma);
+    double spwm_rms_regulate(uint32_t rms, uint32_t target);
+#endif
@@ -0,0 +1,98 @@
+#ifndef SPWM_SINE
+    #define SPWM_SINE
+
+    #include <stdint.h>
+
+    //Number of segments in one quarter (0 to 90 deg) of the sine table. Must be a power of two.
+    //With linear interpolation the error is less than 3.0e-7 of full scale (i.e. < 0.3 count for ma_scaled = 1,000,000)
+    #define SPWM_SINE_TABLE_BITS 10
+    #define SPWM_SINE_TABLE_SIZE (1 << SPWM_SINE_TABLE_BITS)
+
+    //Phase is a 32 bit binary angle. 2^32 counts = 360 deg. The top 2 bits are the quadrant of sine wave.
+    #define SPWM_PHASE_QUADRANT_BITS 30
+    #define SPWM_PHASE_FRAC_BITS (SPWM_PHASE_QUADRANT_BITS - SPWM_SINE_TABLE_BITS)
+
+    /**
+     * @brief Sine function evaluated at compile time (Taylor series). Valid for 0 <= x <= PI/2.
+     */
+    constexpr double spwm_sine_taylor(double x){
+        double x2 = x * x;
+        double term = x;
+        double sum = x;
+        for(int k = 1; k < 20; k++){
+            term = -term * x2 / (double)((2 * k) * ((2 * k) + 1));
+            sum += term;
+        }
+        return sum;
+    }
+
+    /// Quarter wave sine table in Q31 format. Entry [SPWM_SINE_TABLE_SIZE] is sin(90 deg), saturated to INT32_MAX.
+    struct spwm_sine_table_t {
+        int32_t q31[SPWM_SINE_TABLE_SIZE + 1];
+    };
+
+    constexpr spwm_sine_table_t spwm_make_sine_table(){
+        spwm_sine_table_t table = {};
+        for(int i = 0; i <= SPWM_SINE_TABLE_SIZE; i++){
+            double x = (3.14159265358979323846 / 2.0) * (double)i / (double)SPWM_SINE_TABLE_SIZE;
+            double v = spwm_sine_taylor(x) * 2147483648.0;
+            table.q31[i] = (v >= 2147483647.0) ? INT32_MAX : (int32_t)(v + 0.5);
+        }
+        return table;
+    }
+
+    //Generated by the compiler. It is placed as const data, no sin() is evaluated at run time.
+    inline constexpr spwm_sine_table_t spwm_sine_table = spwm_make_sine_table();
+
+    /**
+     * @brief Phase increment for one T_STEP in Q32.32 format. (= 2^64 / signal_duration)
+     *
+     * @param signal_duration   Duration of one cycle of sine wave in T_STEP counts.
+     */
+    constexpr uint64_t spwm_phase_step(uint32_t signal_duration){
+        return UINT64_MAX / signal_duration;
+    }
+
+    /**
+     * @brief Phase (32 bit binary angle) of sine wave at a time instance.
+     *
+     * @param phase_step    Phase increment for one T_STEP. (see spwm_phase_step())
+     * @param time_counter  Time instance (1 count = 1 T_STEP) from the start of sine wave.
+     *
+     * @note Overflow of the 64 bit product is intentional. Only the fraction of full cycle is retained.
+     */
+    constexpr uint32_t spwm_phase(uint64_t phase_step, uint32_t time_counter){
+        return (uint32_t)((phase_step * time_counter) >> 32);
+    }
+
+    /**
+     * @brief Sine of a phase in Q31 format, using quarter wave table with linear interpolation.
+     */
+    constexpr int32_t spwm_sin_q31(uint32_t phase){
+        uint32_t quadrant = phase >> SPWM_PHASE_QUADRANT_BITS;
+        uint32_t angle = phase & ((1u << SPWM_PHASE_QUADRANT_BITS) - 1);
+
+        //2nd & 4th quadrant are mirror of the 1st & 3rd quadrant
+        if(quadrant & 1u){
+            angle = (1u << SPWM_PHASE_QUADRANT_BITS) - angle;
+        }
+
+        uint32_t index = angle >> SPWM_PHASE_FRAC_BITS;
+        uint32_t frac = angle & ((1u << SPWM_PHASE_FRAC_BITS) - 1);
+        int32_t value = spwm_sine_table.q31[index];
+        if(frac != 0){
+            int64_t delta = (int64_t)spwm_sine_table.q31[index + 1] - value;
+            value += (int32_t)((delta * (int64_t)frac) >> SPWM_PHASE_FRAC_BITS);
+        }
+
+        //3rd & 4th quadrant are negative
+        return (quadrant & 2u) ? -value : value;
+    }
+
+    /**
+     * @brief Scales the Q31 sine value by an integer amplitude. Truncated towards zero like the (int32_t) cast.
+     */
+    constexpr int32_t spwm_scale_q31(uint32_t amplitude, int32_t sin_q31){
+        return (int32_t)(((int64_t)amplitude * sin_q31) / 2147483648LL);
+    }
+#endif
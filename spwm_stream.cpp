@@ -0,0 +1,397 @@
+#include "spwm_stream.h"
+#include "spwm_lut_gen.h"
+#if SPWM_FAULT_TRIP
+    #include "spwm_trip.h"
+#endif
+
+//Durations of each leg, written ahead by the CPU & played by DMA. Each ring is aligned to its own size for the DMA ring.
+static uint32_t __attribute__ ((aligned(1u << SPWM_STREAM_RING_BITS))) stream_ring[SPWM_LEGS_MAX][SPWM_STREAM_RING];
+
+static int stream_data_ch[SPWM_LEGS_MAX];       //Plays the ring of a leg into its TX FIFO, SPWM_STREAM_CHUNK words at a time
+static int stream_ctrl_ch[SPWM_LEGS_MAX];       //Restarts the data channel with 'stream_chunk' words
+static uint32_t stream_chunk = SPWM_STREAM_CHUNK;
+
+static spwm_stream_ref_t stream_ref = NULL;
+static void* p_stream_ctx = NULL;
+static const spwm_corrections_t* p_stream_corr = NULL;
+static uint8_t stream_legs = 0;
+static uint32_t stream_half = 0;                //Duration of half carrier cycle
+
+static uint32_t stream_carrier = 0;             //Next carrier cycle to be computed
+static uint32_t stream_write = 0;               //Ring index of next word to be written (same for all the legs)
+static double stream_ref_start[SPWM_LEGS_MAX];  //Reference at the start of next carrier cycle
+static uint32_t stream_tail[SPWM_LEGS_MAX];     //Raw time from the last OFF edge to the end of its carrier cycle
+static int32_t stream_debt[SPWM_LEGS_MAX];      //Time given to the last short value, taken from the next one
+static double stream_error[SPWM_LEGS_MAX];      //Rounding error of the last edge, added to the next one (SPWM_EDGE_DITHER)
+
+//Overrun checks of the refill (see stream_overrun())
+static uint32_t stream_ahead[SPWM_LEGS_MAX];    //Words written ahead of DMA at the last refill
+static uint32_t stream_last_read[SPWM_LEGS_MAX];//Ring index read by DMA at the last refill
+static uint64_t stream_fill_us = 0;             //Time of the last refill. 0 till DMA has played a chunk.
+static volatile uint32_t stream_overrun_count = 0;
+static volatile bool stream_trip = false;
+
+/**
+ * @brief Reference of a leg from the callback, limited to +/- SPWM_STREAM_REF_MAX.
+ */
+static double stream_sample(uint8_t leg, uint32_t sample){
+    double ref = stream_ref(leg, sample, p_stream_ctx);
+    if(ref > SPWM_STREAM_REF_MAX){
+        return SPWM_STREAM_REF_MAX;
+    }else if(ref < -SPWM_STREAM_REF_MAX){
+        return -SPWM_STREAM_REF_MAX;
+    }
+    return ref;
+}
+
+/**
+ * @brief Rounds an edge within half carrier cycle to T_STEP.
+ *
+ * With SPWM_EDGE_DITHER the rounding error of the previous edge of the leg is added first. (error feedback,
+ * see spwm_dither_edge()) Otherwise it is rounded to nearest.
+ */
+static uint32_t stream_round(uint8_t leg, double edge){
+#if SPWM_EDGE_DITHER
+    double exact = edge + stream_error[leg];
+    double rounded = floor(exact + 0.5);
+    if(rounded < 0.0){
+        rounded = 0.0;
+    }else if(rounded > (double)stream_half){
+        rounded = (double)stream_half;
+    }
+    stream_error[leg] = exact - rounded;
+    return (uint32_t)rounded;
+#else
+    (void)leg;
+    return (uint32_t)(edge + 0.5);
+#endif
+}
+
+/**
+ * @brief ON & OFF edges (from the start of carrier cycle) of the next carrier cycle of a leg.
+ *
+ * The reference is taken as a straight line between its samples at the carrier peaks (start, middle & end).
+ * So each edge has a closed form, without any crossing search (u = time / half carrier duration):
+ * - falling carrier (1 - 2u) meets (r0 + (rm - r0) u) at u = (1 - r0) / (2 + rm - r0).
+ * - rising carrier (-1 + 2u) meets (rm + (r1 - rm) u) at u = (1 + rm) / (2 + rm - r1).
+ * Neither the symmetry of a sine wave, nor its period is assumed.
+ *
+ * With regular sampling (SPWM_SAMPLING) the sample is held on the ramp instead of the straight line:
+ * - SPWM_SAMPLING_SYMMETRIC : rm on both ramps. One callback per carrier cycle.
+ * - SPWM_SAMPLING_ASYMMETRIC : r0 on the falling ramp & rm on the rising ramp. (usual asymmetric sampling at the
+ *   carrier peaks, as the callback is sampled there. The tables sample at the middle of ramps instead)
+ */
+static void carrier_edges(uint8_t leg, uint32_t* p_on_edge, uint32_t* p_off_edge){
+    uint32_t sample = 2 * stream_carrier;
+    double r0 = stream_ref_start[leg];
+    double rm = stream_sample(leg, sample + 1);
+#if SPWM_SAMPLING == SPWM_SAMPLING_SYMMETRIC
+    double u_on = (1.0 - rm) / 2.0;
+    double u_off = (1.0 + rm) / 2.0;
+    (void)r0;
+#elif SPWM_SAMPLING == SPWM_SAMPLING_ASYMMETRIC
+    double u_on = (1.0 - r0) / 2.0;
+    double u_off = (1.0 + rm) / 2.0;
+    stream_ref_start[leg] = stream_sample(leg, sample + 2);
+#else
+    double r1 = stream_sample(leg, sample + 2);
+    stream_ref_start[leg] = r1;
+
+    double u_on = (1.0 - r0) / (2.0 + rm - r0);
+    double u_off = (1.0 + rm) / (2.0 + rm - r1);
+#endif
+    *p_on_edge = stream_round(leg, u_on * stream_half);
+    *p_off_edge = stream_half + stream_round(leg, u_off * stream_half);
+}
+
+/**
+ * @brief Corrects a raw duration of a leg. (see spwm_correct_value())
+ *
+ * A value shorter than min_pulse is stretched to min_pulse (or dropped to 0, see SPWM_PULSE_DROP). The time
+ * is taken from (or given to) the next value, which is of opposite logic level. So the edges after it stay exact.
+ */
+static uint32_t stream_value(uint8_t leg, uint32_t raw){
+    if(p_stream_corr == NULL){
+        return raw;
+    }
+    int32_t value = (int32_t)raw - (int32_t)(p_stream_corr->dead_time + p_stream_corr->pio_overhead) - stream_debt[leg];
+    int32_t min_pulse = (int32_t)p_stream_corr->min_pulse;
+    stream_debt[leg] = 0;
+    if(value < min_pulse){
+        int32_t target = (p_stream_corr->short_pulse_mode == SPWM_PULSE_DROP) ? 0 : min_pulse;
+        stream_debt[leg] = target - value;
+        value = target;
+    }
+    return (uint32_t)value;
+}
+
+/**
+ * @brief Computes the next carrier cycle of all the legs into the rings.
+ *
+ * Two words of each leg: OFF duration into the next carrier cycle (tail of last one + head of new one), then
+ * the ON duration of new carrier cycle.
+ */
+static void stream_step(void){
+    uint32_t off_index = stream_write;
+    uint32_t on_index = (stream_write + 1) % SPWM_STREAM_RING;
+    for(uint8_t leg = 0; leg < stream_legs; leg++){
+        uint32_t on_edge = 0;
+        uint32_t off_edge = 0;
+        carrier_edges(leg, &on_edge, &off_edge);
+        stream_ring[leg][off_index] = stream_value(leg, stream_tail[leg] + on_edge);
+        stream_ring[leg][on_index] = stream_value(leg, off_edge - on_edge);
+        stream_tail[leg] = (2 * stream_half) - off_edge;
+    }
+    stream_write = (stream_write + 2) % SPWM_STREAM_RING;
+    stream_carrier++;
+}
+
+/**
+ * @brief Index of the next word to be read by DMA from the ring of a leg. 0 before DMA is started.
+ */
+static uint32_t stream_read_index(uint8_t leg){
+    if(stream_data_ch[leg] < 0){
+        return 0;
+    }
+    return ((dma_hw->ch[stream_data_ch[leg]].read_addr - (uint32_t)stream_ring[leg]) / 4) % SPWM_STREAM_RING;
+}
+
+/**
+ * @brief Words read by DMA from the ring of a leg since the last refill.
+ *
+ * The read address gives them modulo the ring only. The timer gives the laps: 2 words are played in each
+ * carrier cycle, so the words from the time are within a few words of the true count (far less than half a ring).
+ */
+static uint32_t stream_played(uint8_t leg, uint32_t read, uint64_t now_us){
+    uint32_t played = (read + SPWM_STREAM_RING - stream_last_read[leg]) % SPWM_STREAM_RING;
+    if(stream_fill_us == 0){
+        return played;
+    }
+    //1 T_STEP = 10 ns, a carrier cycle is (2 * stream_half)
+    uint64_t timed = ((now_us - stream_fill_us) * 100) / stream_half;
+    while((played + (SPWM_STREAM_RING / 2)) < timed){
+        played += SPWM_STREAM_RING;
+    }
+    return played;
+}
+
+/**
+ * @brief Checks that DMA has not read past the words written by the last refill (e.g. a refill held off by the
+ * other IRQs for longer than the ring). Else the stale words are being played, and the refill starts again just
+ * ahead of DMA. The edges carry on from the last carrier cycle computed, so the reference lags by the time lost.
+ *
+ * @param p_read    Ring index read by DMA on each leg.
+ */
+static void stream_overrun(const uint32_t* p_read, uint64_t now_us){
+    uint32_t lead = 0;          //Leg furthest ahead
+    uint32_t lead_played = 0;
+    bool overrun = false;
+    for(uint8_t leg = 0; leg < stream_legs; leg++){
+        uint32_t played = stream_played(leg, p_read[leg], now_us);
+        overrun = overrun || (played > stream_ahead[leg]);
+        if(played >= lead_played){
+            lead_played = played;
+            lead = leg;
+        }
+    }
+    if(!overrun){
+        return;
+    }
+    stream_overrun_count++;
+    //An OFF duration is always at an odd index.
+    stream_write = ((p_read[lead] + SPWM_STREAM_GUARD) | 1) % SPWM_STREAM_RING;
+#if SPWM_FAULT_TRIP
+    //The legs play stale words, not the reference. Trip to both switches OFF.
+    if( (SPWM_STREAM_TRIP_OVERRUNS > 0) && (stream_overrun_count >= SPWM_STREAM_TRIP_OVERRUNS) && !stream_trip ){
+        spwm_trip_now();
+        stream_trip = true;
+    }
+#endif
+}
+
+/**
+ * @brief Computes carrier cycles till the rings are full (upto SPWM_STREAM_GUARD words behind DMA on every leg).
+ * Once DMA is started, an overrun since the last refill is checked first. (see stream_overrun())
+ */
+static void stream_fill(void){
+    uint32_t read[SPWM_LEGS_MAX];
+    uint64_t now_us = time_us_64();
+    bool running = (stream_data_ch[0] >= 0);
+    for(uint8_t leg = 0; leg < stream_legs; leg++){
+        read[leg] = stream_read_index(leg);
+    }
+    if(running){
+        stream_overrun(read, now_us);
+    }
+
+    uint32_t used_max = 0;
+    for(uint8_t leg = 0; leg < stream_legs; leg++){
+        uint32_t used = (stream_write + SPWM_STREAM_RING - read[leg]) % SPWM_STREAM_RING;
+        if(used > used_max){
+            used_max = used;
+        }
+    }
+    while((used_max + 2) <= (SPWM_STREAM_RING - SPWM_STREAM_GUARD)){
+        stream_step();
+        used_max += 2;
+    }
+
+    for(uint8_t leg = 0; leg < stream_legs; leg++){
+        stream_ahead[leg] = (stream_write + SPWM_STREAM_RING - read[leg]) % SPWM_STREAM_RING;
+        stream_last_read[leg] = read[leg];
+    }
+    //The SMs may be enabled some time after DMA is started, so the time counts from the 1st chunk played
+    stream_fill_us = running ? now_us : 0;
+}
+
+/**
+ * @brief DMA IRQ at the end of each chunk of 1st leg. The rings are refilled behind DMA.
+ *
+ * @note DMA_IRQ_0 is shared with the handlers of other channels. Only the IRQ of the 1st data channel is taken here.
+ */
+static void stream_dma_irq(void){
+    if(!dma_channel_get_irq0_status(stream_data_ch[0])){
+        return;
+    }
+    dma_channel_acknowledge_irq0(stream_data_ch[0]);
+    stream_fill();
+}
+
+/**
+ * @brief Computes the 1st carrier cycles of the stream, from a reference callback in place of the sine wave.
+ *
+ * @param legs  Number of legs. Not more than SPWM_LEGS_MAX.
+ * @param signal_freq, mf   The carrier freq is (mf * signal_freq), same as for the tables. (The reference
+ * can have any period, or none)
+ * @param ref   Reference of each leg at the carrier peaks. It is called from the DMA IRQ, 2 times for each
+ * carrier cycle of each leg, and must return quickly.
+ * @param p_ctx Passed to ref.
+ * @param p_corr    Corrections for the PIO program. (same as for the tables)
+ * @param p_syncs   Receives the sync count of each leg, to be loaded into its TX FIFO before spwm_stream_start().
+ *
+ * @returns Duration of the carrier cycle. 0 if mf is not supported.
+ */
+uint32_t spwm_stream_init(uint8_t legs, uint8_t signal_freq, uint16_t mf, spwm_stream_ref_t ref, void* p_ctx,
+                        const spwm_corrections_t* p_corr, uint32_t* p_syncs){
+    spwm_crossing_params_t cp = {};
+    uint32_t quarter = spwm_crossing_setup(signal_freq, mf, 0, false, SPWM_STRATEGY_UNIPOLAR, SPWM_SAMPLING, &cp);
+    if( (quarter == 0) || (legs > SPWM_LEGS_MAX) || (ref == NULL) ){
+        return 0;
+    }
+
+    stream_ref = ref;
+    p_stream_ctx = p_ctx;
+    p_stream_corr = p_corr;
+    stream_legs = legs;
+    stream_half = 2 * quarter;
+    stream_carrier = 0;
+
+    //The SM starts with the sync count (head of 1st carrier cycle), then the 1st ON duration.
+    for(uint8_t leg = 0; leg < legs; leg++){
+        stream_data_ch[leg] = -1;
+        stream_debt[leg] = 0;
+        stream_error[leg] = 0.0;
+        stream_ref_start[leg] = stream_sample(leg, 0);
+        uint32_t on_edge = 0;
+        uint32_t off_edge = 0;
+        carrier_edges(leg, &on_edge, &off_edge);
+        p_syncs[leg] = stream_value(leg, on_edge);
+        stream_ring[leg][0] = stream_value(leg, off_edge - on_edge);
+        stream_tail[leg] = (2 * stream_half) - off_edge;
+    }
+    stream_carrier = 1;
+    stream_write = 1;
+    stream_fill();
+    return 4 * quarter;
+}
+
+/**
+ * @brief Starts the DMA channels playing the rings into the TX FIFO of each leg, and the refill by DMA IRQ.
+ *
+ * The data channel plays SPWM_STREAM_CHUNK words and triggers its ctrl channel, which restarts it (from the
+ * next word of the ring) by writing 'stream_chunk' into its TRANS_COUNT_TRIG. The data channel of 1st leg
+ * raises DMA_IRQ_0 at the end of each chunk. The rings are then refilled, far ahead of DMA.
+ * The handler is added as a shared handler of DMA_IRQ_0, so the other channels may use it too.
+ *
+ * @param pio   PIO running the spwm_leg program on each leg.
+ * @param p_sm  State machine of each leg.
+ *
+ * @note Call after spwm_stream_init() & loading the sync counts. SMs can be enabled afterwards.
+ */
+void spwm_stream_start(PIO pio, const uint* p_sm){
+    for(uint8_t leg = 0; leg < stream_legs; leg++){
+        stream_data_ch[leg] = dma_claim_unused_channel(true);
+        stream_ctrl_ch[leg] = dma_claim_unused_channel(true);
+
+        //Control channel: restarts the data channel for the next chunk
+        dma_channel_config ctrl_cfg = dma_channel_get_default_config(stream_ctrl_ch[leg]);
+        channel_config_set_transfer_data_size(&ctrl_cfg, DMA_SIZE_32);
+        channel_config_set_read_increment(&ctrl_cfg, false);
+        channel_config_set_write_increment(&ctrl_cfg, false);
+        channel_config_set_high_priority(&ctrl_cfg, SPWM_DMA_PRIORITY);
+
+        dma_channel_configure(
+            stream_ctrl_ch[leg],
+            &ctrl_cfg,
+            &dma_hw->ch[stream_data_ch[leg]].al1_transfer_count_trig,   // Write address (data channel count + trigger)
+            &stream_chunk,                                              // Read address (words of a chunk)
+            1,                                                          // One word only
+            false                                                       // Started by the data channel
+        );
+
+        //Data channel: one chunk into PIO TX FIFO, then chain to control channel
+        dma_channel_config data_cfg = dma_channel_get_default_config(stream_data_ch[leg]);
+        channel_config_set_transfer_data_size(&data_cfg, DMA_SIZE_32);
+        channel_config_set_read_increment(&data_cfg, true);
+        channel_config_set_write_increment(&data_cfg, false);
+        channel_config_set_ring(&data_cfg, false, SPWM_STREAM_RING_BITS);  //Wrap-up within the ring
+        channel_config_set_dreq(&data_cfg, pio_get_dreq(pio, p_sm[leg], true));
+        channel_config_set_chain_to(&data_cfg, stream_ctrl_ch[leg]);
+        channel_config_set_high_priority(&data_cfg, SPWM_DMA_PRIORITY);
+
+        dma_channel_configure(
+            stream_data_ch[leg],
+            &data_cfg,
+            &pio->txf[p_sm[leg]],           // Write address (PIO FIFO)
+            stream_ring[leg],               // Read address (1st ON duration)
+            SPWM_STREAM_CHUNK,              // One chunk
+            false                           // Started below, for all the legs at once
+        );
+    }
+
+    irq_add_shared_handler(DMA_IRQ_0, stream_dma_irq, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    dma_channel_set_irq0_enabled(stream_data_ch[0], true);
+    irq_set_enabled(DMA_IRQ_0, true);
+
+    uint32_t mask = 0;
+    for(uint8_t leg = 0; leg < stream_legs; leg++){
+        mask |= (1u << stream_data_ch[leg]);
+    }
+    stream_fill_us = 0;
+    dma_start_channel_mask(mask);
+}
+
+/**
+ * @brief Mask of all the DMA channels (data & ctrl) playing the rings. e.g. for aborting them at a trip.
+ */
+uint32_t spwm_stream_dma_mask(void){
+    uint32_t mask = 0;
+    for(uint8_t leg = 0; leg < stream_legs; leg++){
+        mask |= (1u << stream_data_ch[leg]) | (1u << stream_ctrl_ch[leg]);
+    }
+    return mask;
+}
+
+/**
+ * @brief Number of refills which found that DMA had read past the words written ahead. (see stream_overrun())
+ */
+uint32_t spwm_stream_overruns(void){
+    return stream_overrun_count;
+}
+
+/**
+ * @brief true once the legs are tripped for the overruns. (SPWM_FAULT_TRIP & SPWM_STREAM_TRIP_OVERRUNS)
+ */
+bool spwm_stream_tripped(void){
+    return stream_trip;
+}
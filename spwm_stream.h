@@ -0,0 +1,51 @@
+#ifndef SPWM_STREAM
+    #define SPWM_STREAM
+
+    #include "pico/stdlib.h"
+    #include "hardware/dma.h"
+    #include "hardware/pio.h"
+    #include "hardware/irq.h"
+    #include "spwm_lut.h"
+    #include "spwm_swap.h"
+
+    //Streaming mode (pass cmake -DSPWM_STREAMING=1): the durations are computed from a reference callback,
+    //a few carrier cycles ahead of DMA, in place of the tables. (see spwm_stream.cpp)
+
+    //Durations buffered ahead of DMA for each leg, in a RAM ring. Ring size in bytes = (1 << SPWM_STREAM_RING_BITS)
+    //(64 words = 32 carrier cycles, i.e. 625us at mf = 1024 & 50Hz)
+    #define SPWM_STREAM_RING_BITS 8
+    #define SPWM_STREAM_RING ((1u << SPWM_STREAM_RING_BITS) / 4)
+
+    //Words played by the data channel between two refills (DMA IRQ of 1st leg)
+    #define SPWM_STREAM_CHUNK (SPWM_STREAM_RING / 4)
+
+    //Words kept free just behind the DMA read address, which may be in flight
+    #define SPWM_STREAM_GUARD 2
+
+    //Overruns (DMA read past the words written by the refill) before the trip, with SPWM_FAULT_TRIP. The words
+    //played then are stale, so the legs no longer follow the reference. 0 : only counted, never tripped.
+    #ifndef SPWM_STREAM_TRIP_OVERRUNS
+        #define SPWM_STREAM_TRIP_OVERRUNS 1
+    #endif
+
+    //Largest reference (of carrier peak) used. The edge of a carrier cycle is undefined at +/- 1.
+    #define SPWM_STREAM_REF_MAX 0.999
+
+    /**
+     * @brief Reference of a leg at the peaks of carrier wave. (like s1 or s2 in spwm_unipolar_arrays())
+     *
+     * @param leg   Leg (0 to legs - 1).
+     * @param sample    Half carrier cycles from the start. (even: start of a carrier cycle at +1, odd: its middle at -1)
+     * @param p_ctx Context passed to spwm_stream_init().
+     *
+     * @returns Reference from -1 to +1. (i.e. ma * wave, in units of carrier amplitude)
+     */
+    typedef double (*spwm_stream_ref_t)(uint8_t leg, uint32_t sample, void* p_ctx);
+
+    uint32_t spwm_stream_init(uint8_t legs, uint8_t signal_freq, uint16_t mf, spwm_stream_ref_t ref, void* p_ctx,
+                            const spwm_corrections_t* p_corr, uint32_t* p_syncs);
+    void spwm_stream_start(PIO pio, const uint* p_sm);
+    uint32_t spwm_stream_dma_mask(void);
+    uint32_t spwm_stream_overruns(void);
+    bool spwm_stream_tripped(void);
+#endif
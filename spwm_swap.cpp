@@ -0,0 +1,482 @@
+#include "spwm_swap.h"
+#include "spwm_lut.h"
+#include "spwm_uni.pio.h"
+
+/// DMA channels used by one leg (half bridge)
+typedef struct {
+    int data_ch;        //Transfers one fundamental cycle of table values into PIO TX FIFO
+    int ctrl_ch;        //Re-arms data_ch at the end of fundamental cycle with the address held in next_read_addr
+} leg_dma_t;
+
+static leg_dma_t leg_dma[SPWM_LEGS_MAX];
+
+//Address of the table to be played in the next fundamental cycle by each leg. (Read by the ctrl channels)
+static volatile uint32_t next_read_addr[SPWM_LEGS_MAX];
+
+static spwm_bank_t* p_active_bank;      //Bank being played by DMA
+static spwm_bank_t* p_spare_bank;       //Bank which is free for writing (or waiting to be played)
+static bool swap_pending = false;       //true after publishing, till all the legs have moved to the new bank.
+
+static PIO sync_out_pio = NULL;         //PIO & SM of SYNC_OUT, which take the duration of each new bank
+static uint sync_out_sm = 0;
+
+static uint8_t swap_legs = 0;           //Number of legs being played
+static uint8_t swap_tables = 0;         //Number of tables in each bank (the parallel legs play them too)
+static uint16_t swap_mf = 0;            //Freq modulation index of the tables
+static uint16_t table_len = 0;          //Number of words in each table (= SPWM_TABLE_WORDS(mf))
+
+#if SPWM_QUARTER_TABLES
+/// DMA control block. The ctrl channel writes it into the alias 3 registers of data channel, the last one triggers it.
+typedef struct {
+    uint32_t ctrl;
+    uint32_t write_addr;
+    uint32_t transfer_count;
+    uint32_t read_addr;
+} dma_block_t;
+
+//Segments played in one fundamental cycle (see spwm_quarter_arrays()) + one block to restart the list
+#define QUARTER_SEGMENTS 6
+#define QUARTER_BLOCKS (QUARTER_SEGMENTS + 1)
+
+//A swap is allowed only till the data channel plays this segment (2nd quarter forward). The remaining segments 
+//take a quarter of the cycle, so the link & next list are never picked while being written.
+#define QUARTER_SWAP_LAST_SEGMENT 3
+
+//Control block lists of both banks for each leg. The ctrl channel writes one block at a time (ring of 16 bytes).
+static dma_block_t __attribute__ ((aligned(16))) block_list[2][SPWM_LEGS_MAX][QUARTER_BLOCKS];
+static spwm_bank_t* p_list_bank[2];     //Bank played by each set of lists
+#endif
+
+/**
+ * @brief Configures a pair of DMA channels to play a lookup table into the TX FIFO of a PIO SM.
+ *
+ * The data channel transfers SPWM_TABLE_WORDS(mf) words i.e. one fundamental cycle and then triggers the control channel.
+ * The control channel writes 'next_read_addr' into the READ_ADDR_TRIG register of data channel.
+ * It restarts the data channel from the table to be played in next cycle. No CPU help is required for this.
+ *
+ * The ring on read address is retained, so the data channel never reads outside a BUFFER_SIZE aligned table.
+ */
+static void configure_dma_for_pio(PIO pio_spwm, uint sm_spwm, leg_dma_t* p_leg, volatile uint32_t* next_read_addr,
+                                uint ring_size_bits){
+
+    p_leg->data_ch = dma_claim_unused_channel(true);
+    p_leg->ctrl_ch = dma_claim_unused_channel(true);
+
+    //Control channel: single 32 bit transfer from 'next_read_addr' into READ_ADDR_TRIG of data channel
+    dma_channel_config ctrl_cfg = dma_channel_get_default_config(p_leg->ctrl_ch);
+    channel_config_set_transfer_data_size(&ctrl_cfg, DMA_SIZE_32);
+    channel_config_set_read_increment(&ctrl_cfg, false);
+    channel_config_set_write_increment(&ctrl_cfg, false);
+    channel_config_set_high_priority(&ctrl_cfg, SPWM_DMA_PRIORITY);
+
+    dma_channel_configure(
+        p_leg->ctrl_ch,
+        &ctrl_cfg,
+        &dma_hw->ch[p_leg->data_ch].al3_read_addr_trig,    // Write address (data channel read address + trigger)
+        next_read_addr,                                     // Read address (table for next cycle)
+        1,                                                  // One word only
+        false                                               // Started by the data channel
+    );
+
+    //Data channel: one fundamental cycle into PIO TX FIFO, then chain to control channel
+    dma_channel_config data_cfg = dma_channel_get_default_config(p_leg->data_ch);
+    channel_config_set_transfer_data_size(&data_cfg, DMA_SIZE_32); //32-bit transfers
+    channel_config_set_read_increment(&data_cfg, true);            //Inc read address (data array)
+    channel_config_set_write_increment(&data_cfg, false);          //Don't inc write address (PIO FIFO)
+    channel_config_set_ring(&data_cfg, false, ring_size_bits);     //Wrap-up within the aligned table
+    channel_config_set_dreq(&data_cfg, pio_get_dreq(pio_spwm, sm_spwm, true));   //Pace to PIO DREQ
+    channel_config_set_chain_to(&data_cfg, p_leg->ctrl_ch);        //Re-arm at the end of fundamental cycle
+    channel_config_set_high_priority(&data_cfg, SPWM_DMA_PRIORITY);
+
+    dma_channel_configure(
+        p_leg->data_ch,
+        &data_cfg,
+        &pio_spwm->txf[sm_spwm],            // Write address (PIO FIFO)
+        (const void*)(*next_read_addr),     // Adress of 1st value in SPWM lookup table
+        table_len,                          // One fundamental cycle. Reloaded on every trigger.
+        true                                // Start immediately.
+    );
+}
+
+/**
+ * @brief Checks if the read address of a data channel lies inside a lookup table.
+ */
+static bool dma_reads_table(const leg_dma_t* p_leg, const uint32_t* p_table){
+    uint32_t read_addr = dma_hw->ch[p_leg->data_ch].read_addr;
+    return ( (read_addr >= (uint32_t)p_table) && (read_addr < (uint32_t)(p_table + table_len)) );
+}
+
+#if SPWM_QUARTER_TABLES
+/**
+ * @brief Fills the control block list which plays the quarter wave layout of a bank as the full table of a leg.
+ *
+ * Each block holds (ctrl, write address, transfer count, read address) for one segment of the table. 
+ * The reverse segments are read with decreasing address (INCR_READ_REV of RP2350 DMA). At the end of each 
+ * segment the data channel triggers the ctrl channel, which loads the next block.
+ * The last block makes the data channel copy 'next_list_addr' into READ_ADDR_TRIG of the ctrl channel (unpaced).
+ * So the ctrl channel restarts from the list to be played in next cycle, without CPU help.
+ */
+static void fill_block_list(dma_block_t* p_list, PIO pio_spwm, uint sm_spwm, const leg_dma_t* p_leg, uint8_t leg,
+                            const uint32_t* p_quarter, volatile uint32_t* next_list_addr){
+    uint16_t quarter_len = swap_mf / 2;
+    const uint32_t* p_first = (leg == SPWM_LEG_H1) ? p_quarter : (p_quarter + quarter_len);
+    const uint32_t* p_second = (leg == SPWM_LEG_H1) ? (p_quarter + quarter_len) : p_quarter;
+    const uint32_t* p_link = p_quarter + swap_mf + ((leg == SPWM_LEG_H1) ? SPWM_QUARTER_LINK_H1 : SPWM_QUARTER_LINK_H2);
+    uint32_t txf = (uint32_t)&pio_spwm->txf[sm_spwm];
+
+    //Segments into PIO TX FIFO, paced by PIO DREQ
+    dma_channel_config cfg = dma_channel_get_default_config(p_leg->data_ch);
+    channel_config_set_transfer_data_size(&cfg, DMA_SIZE_32);
+    channel_config_set_read_increment(&cfg, true);
+    channel_config_set_write_increment(&cfg, false);
+    channel_config_set_dreq(&cfg, pio_get_dreq(pio_spwm, sm_spwm, true));
+    channel_config_set_chain_to(&cfg, p_leg->ctrl_ch);
+    channel_config_set_high_priority(&cfg, SPWM_DMA_PRIORITY);
+    uint32_t forward = channel_config_get_ctrl_value(&cfg);
+    uint32_t reverse = forward | DMA_CH0_CTRL_TRIG_INCR_READ_REV_BITS;
+
+    p_list[0] = (dma_block_t){forward, txf, quarter_len, (uint32_t)p_first};
+    p_list[1] = (dma_block_t){reverse, txf, (uint32_t)(quarter_len - 1), (uint32_t)(p_first + quarter_len - 2)};
+    p_list[2] = (dma_block_t){forward, txf, 1, (uint32_t)(p_quarter + swap_mf + SPWM_QUARTER_MID)};
+    p_list[3] = (dma_block_t){forward, txf, quarter_len, (uint32_t)p_second};
+    p_list[4] = (dma_block_t){reverse, txf, (uint32_t)(quarter_len - 1), (uint32_t)(p_second + quarter_len - 2)};
+    p_list[5] = (dma_block_t){forward, txf, 1, (uint32_t)p_link};
+
+    //Restart: one word, unpaced & not chained (chain to itself)
+    dma_channel_config restart_cfg = dma_channel_get_default_config(p_leg->data_ch);
+    channel_config_set_transfer_data_size(&restart_cfg, DMA_SIZE_32);
+    channel_config_set_read_increment(&restart_cfg, false);
+    channel_config_set_write_increment(&restart_cfg, false);
+    channel_config_set_high_priority(&restart_cfg, SPWM_DMA_PRIORITY);
+    p_list[6] = (dma_block_t){channel_config_get_ctrl_value(&restart_cfg), 
+                            (uint32_t)&dma_hw->ch[p_leg->ctrl_ch].al3_read_addr_trig, 1, (uint32_t)next_list_addr};
+}
+
+/**
+ * @brief Configures a pair of DMA channels to play the quarter wave layout into the TX FIFO of a PIO SM.
+ *
+ * The ctrl channel writes the control blocks (4 words each) into the alias 3 registers of data channel.
+ * Its write address wraps up after each block (ring of 16 bytes). It starts immediately with the 1st block.
+ */
+static void configure_quarter_dma_for_pio(leg_dma_t* p_leg, volatile uint32_t* next_list_addr){
+    dma_channel_config ctrl_cfg = dma_channel_get_default_config(p_leg->ctrl_ch);
+    channel_config_set_transfer_data_size(&ctrl_cfg, DMA_SIZE_32);
+    channel_config_set_read_increment(&ctrl_cfg, true);
+    channel_config_set_write_increment(&ctrl_cfg, true);
+    channel_config_set_ring(&ctrl_cfg, true, 4);                  //Wrap-up within the 4 registers of alias 3
+    channel_config_set_high_priority(&ctrl_cfg, SPWM_DMA_PRIORITY);
+
+    dma_channel_configure(
+        p_leg->ctrl_ch,
+        &ctrl_cfg,
+        &dma_hw->ch[p_leg->data_ch].al3_ctrl,           // Write address (alias 3 registers of data channel)
+        (const void*)(*next_list_addr),                 // Read address (1st block of the list)
+        4,                                              // One block. Reloaded on every trigger.
+        true                                            // Start immediately.
+    );
+}
+
+/**
+ * @brief Index (0 or 1) of the block lists playing a bank.
+ */
+static uint8_t list_index(const spwm_bank_t* p_bank){
+    return (p_bank == p_list_bank[0]) ? 0 : 1;
+}
+
+/**
+ * @brief Number of blocks of a list already loaded by the ctrl channel of a leg. 0 if it reads another list.
+ */
+static uint32_t blocks_loaded(uint8_t leg, const spwm_bank_t* p_bank){
+    uint32_t read_addr = dma_hw->ch[leg_dma[leg].ctrl_ch].read_addr;
+    uint32_t list_addr = (uint32_t)block_list[list_index(p_bank)][leg];
+    if( (read_addr <= list_addr) || (read_addr > (list_addr + sizeof(block_list[0][0]))) ){
+        return 0;
+    }
+    return (read_addr - list_addr) / sizeof(dma_block_t);
+}
+#endif
+
+/**
+ * @brief Table (and sync) of a bank played by a leg. (see SPWM_INTERLEAVE)
+ */
+static uint8_t leg_table(uint8_t leg){
+    return SPWM_LEG_TABLE(leg, swap_tables);
+}
+
+/**
+ * @brief Address of the link (last value of table) of a leg into next cycle.
+ *
+ * @note A parallel leg shares the link of its table. Both take the same value at a swap.
+ */
+static uint32_t* link_addr(spwm_bank_t* p_bank, uint8_t leg){
+#if SPWM_QUARTER_TABLES
+    return p_bank->p_table[0] + swap_mf + ((leg == SPWM_LEG_H1) ? SPWM_QUARTER_LINK_H1 : SPWM_QUARTER_LINK_H2);
+#else
+    return &p_bank->p_table[leg_table(leg)][table_len - 1];
+#endif
+}
+
+/**
+ * @brief Address to be loaded by the ctrl channel of a leg for playing a bank from start of next cycle.
+ */
+static uint32_t start_addr(spwm_bank_t* p_bank, uint8_t leg){
+#if SPWM_QUARTER_TABLES
+    return (uint32_t)block_list[list_index(p_bank)][leg];
+#else
+    return (uint32_t)p_bank->p_table[leg_table(leg)];
+#endif
+}
+
+/**
+ * @brief Checks if a leg is far enough from the end of present cycle to write its link & next address.
+ */
+static bool leg_can_swap(uint8_t leg){
+#if SPWM_QUARTER_TABLES
+    //The 1st segment holds atleast SPWM_SWAP_LEAD words (see spwm_swap_set_sync_out())
+    uint32_t loaded = blocks_loaded(leg, p_active_bank);
+    uint32_t loaded_min = (sync_out_pio == NULL) ? 1 : 2;
+    return ( (loaded >= loaded_min) && (loaded <= (QUARTER_SWAP_LAST_SEGMENT + 1)) );
+#else
+    uint32_t left = dma_channel_hw_addr(leg_dma[leg].data_ch)->transfer_count;
+    if( (sync_out_pio != NULL) && ((table_len - left) < SPWM_SWAP_LEAD) ){
+        return false;   //PIO may still be playing the end of previous cycle
+    }
+    return (left >= SPWM_SWAP_GUARD);
+#endif
+}
+
+/**
+ * @brief Checks if a leg plays a bank.
+ */
+static bool leg_plays(uint8_t leg, spwm_bank_t* p_bank){
+#if SPWM_QUARTER_TABLES
+    return (blocks_loaded(leg, p_bank) > 0);
+#else
+    return dma_reads_table(&leg_dma[leg], p_bank->p_table[leg_table(leg)]);
+#endif
+}
+
+/**
+ * @brief Starts the DMA channels for all the legs with double buffered lookup tables.
+ *
+ * @param p_pio PIO running the spwm_leg program of each leg.
+ * @param p_sm  State machine of each leg. (e.g. H1 & H2 half bridges, or phase A, B & C)
+ * @param legs  Number of legs. Not more than SPWM_LEGS_MAX. With SPWM_INTERLEAVE the legs after the first
+ * (legs / SPWM_INTERLEAVE) are the parallel legs, which play the tables of the others. (see SPWM_LEG_TABLE())
+ * @param mf    Freq modulation index. Each table holds (2 * mf) values in SPWM_TABLE_WORDS(mf) words.
+ * @param ring_size_bits    Table size in bytes = (1 << ring_size_bits). Tables must be aligned to this size.
+ * @param p_bank_a  Bank with the tables to be played from start. It must be filled & corrected already.
+ * @param p_bank_b  Spare bank. To be filled later for next swap.
+ *
+ * @note
+ * The SMs must be configured and their sync counts loaded in TX FIFO before calling this function.
+ * The DMA starts filling the FIFO immediately. SMs can be enabled afterwards.
+ */
+void spwm_swap_init(const PIO* p_pio, const uint* p_sm, uint8_t legs, uint16_t mf, uint ring_size_bits,
+                    spwm_bank_t* p_bank_a, spwm_bank_t* p_bank_b){
+    hard_assert(legs <= SPWM_LEGS_MAX);
+    swap_legs = legs;
+    swap_tables = legs / SPWM_INTERLEAVE;
+    swap_mf = mf;
+    table_len = SPWM_TABLE_WORDS(mf);
+    p_active_bank = p_bank_a;
+    p_spare_bank = p_bank_b;
+    swap_pending = false;
+
+#if SPWM_QUARTER_TABLES
+    //Only the H bridge layout is supported (see spwm_quarter_arrays())
+    hard_assert(legs == 2);
+    (void)ring_size_bits;
+    p_list_bank[0] = p_bank_a;
+    p_list_bank[1] = p_bank_b;
+    for(uint8_t leg = 0; leg < swap_legs; leg++){
+        leg_dma[leg].data_ch = dma_claim_unused_channel(true);
+        leg_dma[leg].ctrl_ch = dma_claim_unused_channel(true);
+        fill_block_list(block_list[0][leg], p_pio[leg], p_sm[leg], &leg_dma[leg], leg, p_bank_a->p_table[0], &next_read_addr[leg]);
+        fill_block_list(block_list[1][leg], p_pio[leg], p_sm[leg], &leg_dma[leg], leg, p_bank_b->p_table[0], &next_read_addr[leg]);
+        next_read_addr[leg] = start_addr(p_active_bank, leg);
+        configure_quarter_dma_for_pio(&leg_dma[leg], &next_read_addr[leg]);
+    }
+#else
+    for(uint8_t leg = 0; leg < swap_legs; leg++){
+        next_read_addr[leg] = start_addr(p_active_bank, leg);
+        configure_dma_for_pio(p_pio[leg], p_sm[leg], &leg_dma[leg], &next_read_addr[leg], ring_size_bits);
+    }
+#endif
+}
+
+/**
+ * @brief Makes SYNC_OUT follow the duration of the tables. Each swap also pushes the duration of new bank.
+ *
+ * @param pio   PIO running the sync_out program. (same as the legs)
+ * @param sm    State machine of SYNC_OUT. Its rising edges must come at the start of fundamental cycles.
+ *
+ * @returns false if the tables are too short. (SYNC_OUT then keeps the duration it has)
+ *
+ * @note
+ * The duration is taken by SYNC_OUT at the start of next cycle, as are the new tables. For that, the swap is 
+ * done only after the PIO (not just DMA) has started the present cycle, i.e. after SPWM_SWAP_LEAD words.
+ * So SYNC_OUT stays exact when the duration of a cycle changes (e.g. with SPWM_FREQ_TRACKING).
+ * Call after spwm_swap_init().
+ */
+bool spwm_swap_set_sync_out(PIO pio, uint sm){
+#if SPWM_QUARTER_TABLES
+    if((swap_mf / 2) < SPWM_SWAP_LEAD){
+        return false;
+    }
+#else
+    if(table_len < (SPWM_SWAP_LEAD + SPWM_SWAP_GUARD)){
+        return false;
+    }
+#endif
+    sync_out_sm = sm;
+    sync_out_pio = pio;
+    return true;
+}
+
+/**
+ * @brief Provides the bank which can be refilled with new tables.
+ *
+ * @returns Pointer to spare bank. NULL if last swap is still pending (i.e. spare bank still being read by DMA).
+ */
+spwm_bank_t* spwm_swap_get_spare(void){
+    if(spwm_swap_pending()){
+        return NULL;
+    }
+    return p_spare_bank;
+}
+
+/**
+ * @brief Provides the bank being played by DMA (or to be played from next cycle, if a swap is pending).
+ *
+ * @note Its tables must not be modified. They can be copied into the spare bank, e.g. for a small patch.
+ */
+const spwm_bank_t* spwm_swap_get_active(void){
+    return p_active_bank;
+}
+
+/**
+ * @brief Makes the spare bank active from the start of next fundamental cycle.
+ *
+ * The spare bank must be refilled by the LUT generator (corrected tables & sync counts) before each call.
+ *
+ * @returns true if the swap is scheduled. false if the previous swap is still pending.
+ *
+ * @note
+ * The last value of each table is the OFF duration which links the end of one cycle with the first pulse of
+ * next cycle, i.e. (tail + sync) where tail is the time from the last edge to the end of cycle. The generator 
+ * stores the link of each table to itself. When the next cycle comes from another bank, it is rewritten in 
+ * the active bank as:
+ * - link = (last value - sync) of active bank + sync of new bank
+ * (e.g. for H1 : h2_sync of active bank + h1_sync of new bank). So the pulse edges stay exact across the swap.
+ * With SPWM_PACKED_TABLES the link is the upper half of the last word. The whole word is written at once.
+ *
+ * DMA may not pick these values or the next table address while they are being written. So the writes are
+ * done only when all the data channels have atleast SPWM_SWAP_GUARD values left in the present cycle.
+ * The wait for it is only a few carrier cycles when called near the end of a fundamental cycle.
+ * With SPWM_QUARTER_TABLES the writes are done till the 2nd quarter is being played forward, so the wait 
+ * can be upto a quarter of the fundamental cycle.
+ * With spwm_swap_set_sync_out() the duration of new bank is pushed to SYNC_OUT at the same time.
+ */
+bool spwm_swap_publish(void){
+    if(spwm_swap_pending()){
+        return false;
+    }
+
+    spwm_bank_t* p_old = p_active_bank;
+    spwm_bank_t* p_new = p_spare_bank;
+
+    //The active bank still links to itself. Corrections cancel out, as both syncs & links are corrected values.
+    uint32_t link[SPWM_LEGS_MAX];
+    for(uint8_t leg = 0; leg < swap_legs; leg++){
+#if SPWM_PACKED_TABLES
+        uint32_t word = *link_addr(p_old, leg);
+        uint32_t value = (word >> 16) - p_old->sync[leg_table(leg)] + p_new->sync[leg_table(leg)];
+        link[leg] = (word & 0xFFFF) | (value << 16);
+#else
+        link[leg] = *link_addr(p_old, leg) - p_old->sync[leg_table(leg)] + p_new->sync[leg_table(leg)];
+#endif
+    }
+
+    uint32_t irq_status;
+    uint8_t leg = 0;
+    while(true){
+        irq_status = save_and_disable_interrupts();
+        for(leg = 0; leg < swap_legs; leg++){
+            if(!leg_can_swap(leg)){
+                break;
+            }
+        }
+        if(leg == swap_legs){
+            break;
+        }
+        restore_interrupts(irq_status);
+        tight_loop_contents();
+    }
+
+    for(leg = 0; leg < swap_legs; leg++){
+        *link_addr(p_old, leg) = link[leg];
+        next_read_addr[leg] = start_addr(p_new, leg);
+    }
+    //Taken at the next rising edge of SYNC_OUT. (There is never more than one duration pending per swap)
+    if(sync_out_pio != NULL){
+        pio_sm_put(sync_out_pio, sync_out_sm, sync_out_duration_word(p_new->signal_duration));
+    }
+    restore_interrupts(irq_status);
+
+    p_active_bank = p_new;
+    p_spare_bank = p_old;
+    swap_pending = true;
+    return true;
+}
+
+/**
+ * @brief Checks if the last published bank is yet to be picked by all the legs.
+ */
+bool spwm_swap_pending(void){
+    if(swap_pending){
+        uint8_t leg = 0;
+        while( (leg < swap_legs) && leg_plays(leg, p_active_bank) ){
+            leg++;
+        }
+        swap_pending = (leg < swap_legs);
+    }
+    return swap_pending;
+}
+
+/**
+ * @brief Mask of all the DMA channels (data & ctrl) playing the tables. e.g. for aborting them at a trip.
+ *
+ * @note Call after spwm_swap_init().
+ */
+uint32_t spwm_swap_dma_mask(void){
+    uint32_t mask = 0;
+    for(uint8_t leg = 0; leg < swap_legs; leg++){
+        mask |= (1u << leg_dma[leg].data_ch) | (1u << leg_dma[leg].ctrl_ch);
+    }
+    return mask;
+}
+
+/**
+ * @brief DMA channel which plays the tables of a leg into its TX FIFO. (e.g. for its transfer count)
+ *
+ * @note Call after spwm_swap_init().
+ */
+uint spwm_swap_data_ch(uint8_t leg){
+    return (uint)leg_dma[leg].data_ch;
+}
+
+#if !SPWM_QUARTER_TABLES
+/**
+ * @brief Index of the next word to be read by DMA from the table of a leg in the active bank.
+ *
+ * @returns 0 to (SPWM_TABLE_WORDS(mf) - 1). It is 0 at the end of cycle, till the re-arm by the ctrl channel.
+ *
+ * @note DMA keeps reading while it is used, so it is already late. e.g. for patching the tables in place
+ * (see spwm_patch.cpp) keep a guard of few words.
+ */
+uint16_t spwm_swap_read_index(uint8_t leg){
+    uint32_t read_addr = dma_hw->ch[leg_dma[leg].data_ch].read_addr;
+    return (uint16_t)(((read_addr - (uint32_t)p_active_bank->p_table[leg_table(leg)]) / 4) % table_len);
+}
+#endif
@@ -0,0 +1,86 @@
+#ifndef SPWM_SWAP
+    #define SPWM_SWAP
+
+    #include "pico/stdlib.h"
+    #include "hardware/dma.h"
+    #include "hardware/pio.h"
+
+    //Min number of table values which DMA must still transfer (on all the legs) in the present
+    //fundamental cycle before a swap is allowed. It keeps the swap away from the end of cycle.
+    #define SPWM_SWAP_GUARD 8
+
+    //Max number of table words buffered ahead of the PIO (joined TX FIFO of 8 words + OSR).
+    //With SYNC_OUT following the tables, a swap is also kept away from the start of cycle by this many words,
+    //so that the PIO has surely started the present cycle. (see spwm_swap_set_sync_out())
+    #define SPWM_SWAP_LEAD 9
+
+    //Parallel legs with interleaved carriers. Pass cmake -DSPWM_INTERLEAVE=2 for the H bridge.
+    //1 : one leg for each table.
+    //2 : H1 & H2 are followed by their parallel legs H1' & H2', whose carrier is shifted by half its period.
+    //    The shifted carrier is the inverted carrier, so H1' = NOT H2 & H2' = NOT H1. Each parallel leg plays
+    //    the table of the other leg from its HIGH side (as bipolar H2 does). No table is added. The ripple at the
+    //    odd multiples of the carrier freq cancels between the parallel legs.
+    #ifndef SPWM_INTERLEAVE
+        #define SPWM_INTERLEAVE 1
+    #endif
+
+    //Max number of tables in a bank (legs with their own table). One leg of each, or without SPWM_MULTI_PIO
+    //(see main.cpp) all the legs, are played from one PIO, as one of its 4 SMs is used for SYNC_OUT.
+    //A H bridge uses 2 legs (H1 & H2), a 3 phase inverter uses 3 legs.
+    #define SPWM_TABLES_MAX 3
+    #define SPWM_LEGS_MAX (SPWM_TABLES_MAX * SPWM_INTERLEAVE)
+
+    //Table played by a leg, when (tables) legs have their own tables. (see SPWM_INTERLEAVE)
+    #define SPWM_LEG_TABLE(leg, tables) (((leg) < (tables)) ? (leg) : ((((leg) - (tables)) + 1) % (tables)))
+    #define SPWM_LEG_H1 0
+    #define SPWM_LEG_H2 1
+
+    //Table format played by DMA. Pass cmake -DSPWM_PACKED_TABLES=1 for the packed tables.
+    //0 : one duration per 32 bit word. (spwm_phase_arrays(), spwm_leg PIO program)
+    //1 : two 16 bit durations per 32 bit word. Half the SRAM & DMA transfers. (spwm_packed_phase_arrays(), spwm_leg16)
+    #ifndef SPWM_PACKED_TABLES
+        #define SPWM_PACKED_TABLES 0
+    #endif
+
+    //Storage of the H bridge tables. Pass cmake -DSPWM_QUARTER_TABLES=1 for the quarter wave layout.
+    //0 : full table of (2 * mf) durations for each leg.
+    //1 : only the 2 quarter waves & 3 values shared by H1 & H2 (spwm_quarter_arrays()). DMA control blocks 
+    //    play the quarters forward & backward into the same PIO program. (see spwm_swap.cpp)
+    #ifndef SPWM_QUARTER_TABLES
+        #define SPWM_QUARTER_TABLES 0
+    #endif
+
+    //Priority of the DMA channels playing the tables (or streaming rings). Pass cmake -DSPWM_DMA_PRIORITY=1 so that
+    //they are served ahead of other DMA channels (e.g. ADC or a memory copy), and DMA ahead of the CPUs on the bus fabric.
+    #ifndef SPWM_DMA_PRIORITY
+        #define SPWM_DMA_PRIORITY 0
+    #endif
+
+    //Number of 32 bit words in a table of (2 * mf) durations
+    #if SPWM_PACKED_TABLES
+        #define SPWM_TABLE_WORDS(mf) (mf)
+    #else
+        #define SPWM_TABLE_WORDS(mf) (2 * (mf))
+    #endif
+
+    /// One set of lookup tables (for all the legs) which can be played by DMA.
+    typedef struct {
+        uint32_t* p_table[SPWM_LEGS_MAX];   //Corrected ON & OFF durations of each leg. Size = SPWM_TABLE_WORDS(mf)
+                                            //(SPWM_QUARTER_TABLES: all legs share a SPWM_QUARTER_WORDS(mf) layout)
+        uint32_t sync[SPWM_LEGS_MAX];       //Corrected synchronisation count of each table.
+        uint32_t signal_duration;           //Duration of one fundamental cycle.
+        int64_t track_pad;                  //Ticks added to each cycle by freq tracking in Q32.32 (see spwm_track.cpp)
+    } spwm_bank_t;
+
+    void spwm_swap_init(const PIO* p_pio, const uint* p_sm, uint8_t legs, uint16_t mf, uint ring_size_bits,
+                        spwm_bank_t* p_bank_a, spwm_bank_t* p_bank_b);
+
+    bool spwm_swap_set_sync_out(PIO pio, uint sm);
+    spwm_bank_t* spwm_swap_get_spare(void);
+    const spwm_bank_t* spwm_swap_get_active(void);
+    bool spwm_swap_publish(void);
+    bool spwm_swap_pending(void);
+    uint16_t spwm_swap_read_index(uint8_t leg);
+    uint32_t spwm_swap_dma_mask(void);
+    uint spwm_swap_data_ch(uint8_t leg);
+#endif
@@ -0,0 +1,124 @@
+#include "spwm_sync_in.h"
+
+//Counts of sync_in SM, written by DMA in a ring. It is aligned to its own size for the DMA ring.
+static volatile uint32_t __attribute__ ((aligned(1u << SPWM_SYNC_IN_RING_BITS))) sync_in_ring[SPWM_SYNC_IN_RING];
+
+static int sync_in_dma = -1;            //DMA channel draining the RX FIFO of sync_in SM
+static double lock_integral_ppm = 0;    //Integral part of the phase lock
+
+/**
+ * @brief Starts the DMA which takes every count of the sync_in SM into the RAM ring. It runs endlessly.
+ *
+ * @param pio   PIO running the sync_in program.
+ * @param sm    State machine of SYNC_IN. It can be enabled before or after this call.
+ */
+void spwm_sync_in_start(PIO pio, uint sm){
+    for(uint i = 0; i < SPWM_SYNC_IN_RING; i++){
+        sync_in_ring[i] = SPWM_SYNC_IN_NONE;
+    }
+    lock_integral_ppm = 0;
+
+    sync_in_dma = dma_claim_unused_channel(true);
+    dma_channel_config cfg = dma_channel_get_default_config(sync_in_dma);
+    channel_config_set_transfer_data_size(&cfg, DMA_SIZE_32);
+    channel_config_set_read_increment(&cfg, false);
+    channel_config_set_write_increment(&cfg, true);
+    channel_config_set_ring(&cfg, true, SPWM_SYNC_IN_RING_BITS);     //Wrap-up the write address
+    channel_config_set_dreq(&cfg, pio_get_dreq(pio, sm, false));
+
+    dma_channel_configure(
+        sync_in_dma,
+        &cfg,
+        sync_in_ring,                           // Write address (RAM ring)
+        &pio->rxf[sm],                          // Read address (RX FIFO of sync_in SM)
+        dma_encode_endless_transfer_count(),    // Never stops. (RP2350)
+        true                                    // Start immediately.
+    );
+}
+
+/**
+ * @brief Phase error of SYNC_OUT against SYNC_IN, from the latest capture.
+ *
+ * @param signal_duration   Duration of the fundamental cycle being played. (bank duration)
+ * @param p_error   Receives the time (PIO clk) from the rising edge of SYNC_OUT to that of SYNC_IN, in the
+ * range of +/- half cycle. It is +ve if SYNC_OUT leads.
+ *
+ * @returns false if there is no new capture since the last call.
+ *
+ * @note The resolution is SPWM_SYNC_IN_CLK_PER_COUNT clk. Older captures are skipped.
+ */
+bool spwm_sync_in_error(uint32_t signal_duration, int32_t* p_error){
+    //Write address of DMA points to the slot after the latest capture
+    uint32_t next = (dma_channel_hw_addr(sync_in_dma)->write_addr - (uint32_t)sync_in_ring) / 4;
+    uint32_t latest = (next + SPWM_SYNC_IN_RING - 1) % SPWM_SYNC_IN_RING;
+    uint32_t count = sync_in_ring[latest];
+    if(count == SPWM_SYNC_IN_NONE){
+        return false;
+    }
+    sync_in_ring[latest] = SPWM_SYNC_IN_NONE;
+
+    //A late edge (after a full cycle) is the same as an early one
+    uint32_t ticks = ((count * SPWM_SYNC_IN_CLK_PER_COUNT) + SPWM_SYNC_IN_LATENCY) % signal_duration;
+    *p_error = (ticks > (signal_duration / 2)) ? ((int32_t)ticks - (int32_t)signal_duration) : (int32_t)ticks;
+    return true;
+}
+
+/**
+ * @brief Output frequency which slews the phase of SPWM (and SYNC_OUT) towards SYNC_IN.
+ *
+ * A PI loop on the phase error. To remove an error of e clk in N cycles, each cycle must be (e / N) clk
+ * longer. So the freq is trimmed by -(e / N) / signal_duration.
+ *
+ * @param error Phase error from spwm_sync_in_error().
+ * @param signal_duration   Duration of the fundamental cycle being played.
+ * @param nominal_uhz   Nominal output freq in micro Hz. (e.g. 50 Hz = 50000000)
+ *
+ * @returns Output frequency in micro Hz, for spwm_update_freq(). (see spwm_track.cpp)
+ *
+ * @note Call it for each new capture, atleast once in every few cycles.
+ */
+uint32_t spwm_sync_in_lock(int32_t error, uint32_t signal_duration, uint32_t nominal_uhz){
+    double step_ppm = ((double)error * 1.0e6) / ((double)SPWM_SYNC_IN_SETTLE_CYCLES * signal_duration);
+
+    lock_integral_ppm += step_ppm / SPWM_SYNC_IN_INTEGRAL_DIV;
+    if(lock_integral_ppm > SPWM_SYNC_IN_SLEW_PPM){
+        lock_integral_ppm = SPWM_SYNC_IN_SLEW_PPM;
+    }else if(lock_integral_ppm < -SPWM_SYNC_IN_SLEW_PPM){
+        lock_integral_ppm = -SPWM_SYNC_IN_SLEW_PPM;
+    }
+
+    double trim_ppm = step_ppm + lock_integral_ppm;
+    if(trim_ppm > SPWM_SYNC_IN_SLEW_PPM){
+        trim_ppm = SPWM_SYNC_IN_SLEW_PPM;
+    }else if(trim_ppm < -SPWM_SYNC_IN_SLEW_PPM){
+        trim_ppm = -SPWM_SYNC_IN_SLEW_PPM;
+    }
+
+    //SYNC_OUT leads (+ve error) : longer cycles i.e. lower freq
+    return (uint32_t)((double)nominal_uhz * (1.0 - (trim_ppm * 1.0e-6)));
+}
+
+/**
+ * @brief Waits for a rising edge on SYNC_IN, so that SPWM can be started in phase with it.
+ *
+ * @param pin   SYNC_IN pin. (set up by sync_in_program_init())
+ * @param timeout_us    Max wait, e.g. a few cycles. Standalone inverters start after it.
+ *
+ * @returns false if no edge came within timeout_us.
+ *
+ * @note The edge is polled by CPU, so the start is within a few micro seconds. The phase lock removes the rest.
+ */
+bool spwm_sync_in_wait_edge(uint pin, uint32_t timeout_us){
+    absolute_time_t timeout = make_timeout_time_us(timeout_us);
+    while(gpio_get(pin)){
+        if(time_reached(timeout)){
+            return false;
+        }
+    }
+    while(!gpio_get(pin)){
+        if(time_reached(timeout)){
+            return false;
+        }
+    }
+    return true;
+}
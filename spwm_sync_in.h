@@ -0,0 +1,31 @@
+#ifndef SPWM_SYNC_IN
+    #define SPWM_SYNC_IN
+
+    #include "pico/stdlib.h"
+    #include "hardware/dma.h"
+    #include "hardware/pio.h"
+
+    //Captures kept in the RAM ring by DMA. Ring size in bytes = (1 << SPWM_SYNC_IN_RING_BITS)
+    #define SPWM_SYNC_IN_RING_BITS 5
+    #define SPWM_SYNC_IN_RING ((1u << SPWM_SYNC_IN_RING_BITS) / 4)
+
+    //Marks a slot of the ring which is already read (or never written). The counter never reaches it.
+    #define SPWM_SYNC_IN_NONE 0xFFFFFFFF
+
+    //PIO clk per count of sync_in program & clk from the SYNC_OUT edge to the first sample of SYNC_IN.
+    //(Both the pins go through the same input synchroniser)
+    #define SPWM_SYNC_IN_CLK_PER_COUNT 2
+    #define SPWM_SYNC_IN_LATENCY 2
+
+    //Phase lock: the error is removed in about SPWM_SYNC_IN_SETTLE_CYCLES fundamental cycles by the
+    //proportional part. The integral part (SPWM_SYNC_IN_INTEGRAL_DIV times slower) removes the freq offset
+    //of the crystals. The output freq is never trimmed by more than SPWM_SYNC_IN_SLEW_PPM.
+    #define SPWM_SYNC_IN_SETTLE_CYCLES 50
+    #define SPWM_SYNC_IN_INTEGRAL_DIV 8
+    #define SPWM_SYNC_IN_SLEW_PPM 500
+
+    void spwm_sync_in_start(PIO pio, uint sm);
+    bool spwm_sync_in_error(uint32_t signal_duration, int32_t* p_error);
+    uint32_t spwm_sync_in_lock(int32_t error, uint32_t signal_duration, uint32_t nominal_uhz);
+    bool spwm_sync_in_wait_edge(uint pin, uint32_t timeout_us);
+#endif
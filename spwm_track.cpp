@@ -0,0 +1,177 @@
+#include <string.h>
+#include "spwm_track.h"
+
+//Each value of the quarter wave layout is played in several carrier cycles of both legs
+#if SPWM_QUARTER_TABLES
+    #error "Freq tracking (SPWM_FREQ_TRACKING) needs full tables. Build without SPWM_QUARTER_TABLES"
+#endif
+
+//Target freq of the tables in micro Hz. 0 : no tracking, the tables are played as generated.
+static volatile uint32_t track_freq_uhz = 0;
+
+/**
+ * @brief Duration of one cycle of the target freq in T_STEP counts. (Q32.32)
+ */
+static uint64_t target_duration(uint32_t freq_uhz){
+    uint64_t ticks_uhz = SPWM_TRACK_TICKS_PER_S * SPWM_TRACK_UHZ_PER_HZ;
+    uint64_t whole = ticks_uhz / freq_uhz;
+    uint64_t rem = ticks_uhz % freq_uhz;
+    return (whole << 32) | ((rem << 32) / freq_uhz);
+}
+
+/**
+ * @brief Ticks added at the end of carrier cycle c, for a pad of whole cycle.
+ *
+ * A phase accumulator advances by (pad / mf) in each carrier cycle. The whole ticks it crosses in a cycle are
+ * added in that cycle. So the pads of any two cycles differ by atmost one tick.
+ */
+static int32_t pad_at(int64_t pad, uint16_t mf, uint16_t c){
+    const int64_t half = (int64_t)1 << 31;    //Start at half a tick, so the total is rounded to nearest tick
+    int64_t acc_start = ((pad * c) / mf) + half;
+    int64_t acc_end = ((pad * (c + 1)) / mf) + half;
+    return (int32_t)((acc_end >> 32) - (acc_start >> 32));
+}
+
+/**
+ * @brief Ticks added in one cycle for a pad. (Sum of pad_at() over all the carrier cycles)
+ */
+static int32_t pad_total(int64_t pad){
+    return (int32_t)((pad + ((int64_t)1 << 31)) >> 32);
+}
+
+/**
+ * @brief OFF duration at the end of carrier cycle c.
+ */
+static int32_t slot_value(const uint32_t* p_table, uint16_t c){
+#if SPWM_PACKED_TABLES
+    return (int32_t)(p_table[c] >> 16);
+#else
+    return (int32_t)p_table[(2 * c) + 1];
+#endif
+}
+
+static void set_slot_value(uint32_t* p_table, uint16_t c, int32_t value){
+#if SPWM_PACKED_TABLES
+    p_table[c] = (p_table[c] & 0xFFFF) | ((uint32_t)value << 16);
+#else
+    p_table[(2 * c) + 1] = (uint32_t)value;
+#endif
+}
+
+/**
+ * @brief Sets the target frequency of the tables. Takes effect with the next table filled or retrimmed.
+ *
+ * @param freq_uhz  Frequency in micro Hz, e.g. nominal freq + fine trim from the PLL on a grid sense input.
+ * 0 to play the tables as generated.
+ */
+void spwm_track_set_freq(uint32_t freq_uhz){
+    track_freq_uhz = freq_uhz;
+}
+
+/**
+ * @brief Present target frequency in micro Hz. (0 if tracking is off)
+ */
+uint32_t spwm_track_get_freq(void){
+    return track_freq_uhz;
+}
+
+/**
+ * @brief Pads the tables of a bank, so that one cycle takes the duration of the target frequency.
+ *
+ * The generator truncates the carrier duration to whole T_STEP counts. So the cycle is shorter than the
+ * nominal one (e.g. 1999872 in place of 2000000 counts for 50 Hz & mf = 256) and the output drifts against
+ * the grid. The difference (pad) is spread over the carrier cycles by a fractional phase accumulator and
+ * added to the OFF duration at the end of each carrier cycle. Every leg is OFF (in the table) around the
+ * carrier peak, so all the legs are padded at the same instant and the pulses stay aligned.
+ *
+ * @param p_bank    Filled bank. Any pad applied earlier (p_bank->track_pad) is replaced.
+ * @param legs  Number of legs in the bank.
+ * @param mf    Freq modulation index of the bank.
+ * @param p_corr    Corrections of the tables. A pad may not shorten any value below min_pulse.
+ *
+ * @returns false if the pad can not be applied. (The bank is not modified)
+ * i.e. the change is more than SPWM_TRACK_MAX_PPM, a value would go below min_pulse (or above 16 bits with
+ * SPWM_PACKED_TABLES).
+ *
+ * @note
+ * The pads are whole ticks. The duration of a cycle is within half a tick of the target (0.25 ppm at 50Hz).
+ * The remaining drift is corrected by the trims of the PLL, so the phase error stays bounded.
+ * The signal_duration of the bank is updated with the pad.
+ */
+bool spwm_track_apply(spwm_bank_t* p_bank, uint8_t legs, uint16_t mf, const spwm_corrections_t* p_corr){
+    int64_t old_pad = p_bank->track_pad;
+    uint32_t generated = p_bank->signal_duration - pad_total(old_pad);
+    uint32_t freq_uhz = track_freq_uhz;
+    int64_t new_pad = 0;
+
+    if(freq_uhz != 0){
+        new_pad = (int64_t)(target_duration(freq_uhz) - ((uint64_t)generated << 32));
+        int64_t max_pad = ((int64_t)generated * SPWM_TRACK_MAX_PPM) / 1000000;
+        if( ((new_pad >> 32) > max_pad) || ((new_pad >> 32) < -max_pad) ){
+            return false;
+        }
+    }
+
+    int32_t min_value = (p_corr == NULL) ? 0 : (int32_t)p_corr->min_pulse;
+    int32_t delta = 0;
+    int32_t value = 0;
+
+    //Check all the values first, so that a failed pad leaves the bank as it is
+    for(uint16_t c = 0; c < mf; c++){
+        delta = pad_at(new_pad, mf, c) - pad_at(old_pad, mf, c);
+        for(uint8_t leg = 0; (leg < legs) && (delta != 0); leg++){
+            value = slot_value(p_bank->p_table[leg], c) + delta;
+            if( (delta < 0) && (value < min_value) ){
+                return false;
+            }
+#if SPWM_PACKED_TABLES
+            if(value > SPWM_PACKED_VALUE_MAX){
+                return false;
+            }
+#endif
+        }
+    }
+
+    for(uint16_t c = 0; c < mf; c++){
+        delta = pad_at(new_pad, mf, c) - pad_at(old_pad, mf, c);
+        for(uint8_t leg = 0; (leg < legs) && (delta != 0); leg++){
+            set_slot_value(p_bank->p_table[leg], c, slot_value(p_bank->p_table[leg], c) + delta);
+        }
+    }
+    p_bank->track_pad = new_pad;
+    p_bank->signal_duration = generated + pad_total(new_pad);
+    return true;
+}
+
+/**
+ * @brief Plays the present tables at the present target freq from the start of next cycle, without
+ * computing them again.
+ *
+ * The active bank is copied into the spare bank, only its pads are changed (spwm_track_apply()) and the spare
+ * bank is published. Call it after each trim of spwm_track_set_freq().
+ *
+ * @returns false if the last swap is still pending (try again later) or the pad can not be applied.
+ *
+ * @note
+ * Only the owner of the swaps may call it. (i.e. core1 with SPWM_MULTICORE, see spwm_core1_retrim())
+ */
+bool spwm_track_retrim(uint8_t legs, uint16_t mf, const spwm_corrections_t* p_corr){
+    spwm_bank_t* p_spare = spwm_swap_get_spare();
+    if(p_spare == NULL){
+        return false;
+    }
+
+    //The active bank always links to itself. (see spwm_swap_publish())
+    const spwm_bank_t* p_active = spwm_swap_get_active();
+    for(uint8_t leg = 0; leg < legs; leg++){
+        memcpy(p_spare->p_table[leg], p_active->p_table[leg], SPWM_TABLE_WORDS(mf) * sizeof(uint32_t));
+        p_spare->sync[leg] = p_active->sync[leg];
+    }
+    p_spare->signal_duration = p_active->signal_duration;
+    p_spare->track_pad = p_active->track_pad;
+
+    if(!spwm_track_apply(p_spare, legs, mf, p_corr)){
+        return false;
+    }
+    return spwm_swap_publish();
+}
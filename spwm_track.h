@@ -0,0 +1,27 @@
+#ifndef SPWM_TRACK
+    #define SPWM_TRACK
+
+    #include "pico/stdlib.h"
+    #include "spwm_lut.h"
+    #include "spwm_swap.h"
+
+    //Pass cmake -DSPWM_FREQ_TRACKING=1 to pad every table to the target freq (e.g. for grid-tie).
+    #ifndef SPWM_FREQ_TRACKING
+        #define SPWM_FREQ_TRACKING 0
+    #endif
+
+    //Target frequency is given in micro Hz. (e.g. 50 Hz = 50000000)
+    #define SPWM_TRACK_UHZ_PER_HZ 1000000u
+
+    //Table values are PIO counts of T_STEP (10ns at 100MHz PIO clk)
+    #define SPWM_TRACK_TICKS_PER_S 100000000ull
+
+    //Max change of cycle duration by padding, in parts per million of the generated duration.
+    //Larger changes must regenerate the tables for the new signal_freq.
+    #define SPWM_TRACK_MAX_PPM 20000
+
+    void spwm_track_set_freq(uint32_t freq_uhz);
+    uint32_t spwm_track_get_freq(void);
+    bool spwm_track_apply(spwm_bank_t* p_bank, uint8_t legs, uint16_t mf, const spwm_corrections_t* p_corr);
+    bool spwm_track_retrim(uint8_t legs, uint16_t mf, const spwm_corrections_t* p_corr);
+#endif
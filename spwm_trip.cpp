@@ -0,0 +1,153 @@
+#include "spwm_trip.h"
+
+/// DMA control block. The ctrl channel writes it into the alias 0 registers of data channel, the last one triggers it.
+typedef struct {
+    uint32_t read_addr;
+    uint32_t write_addr;
+    uint32_t transfer_count;
+    uint32_t ctrl;
+} trip_block_t;
+
+//Trip list played once at a fault. The ctrl channel writes one block at a time (ring of 16 bytes).
+static trip_block_t __attribute__ ((aligned(16))) trip_list[SPWM_TRIP_BLOCKS];
+
+//Words set into (STATUS, CTRL) of each GPIO from the 1st leg pin. 0 (no change) for STATUS & other pins.
+static uint32_t trip_pin_word[2 * SPWM_TRIP_PINS_MAX];
+static uint32_t trip_abort_mask = 0;    //Table DMA channels, written into CHAN_ABORT
+static uint32_t trip_rx_word = 0;       //Word pushed by the fault_trip SM (not used)
+
+static PIO trip_pio = NULL;             //PIO & SM running the fault_trip program
+static uint trip_sm = 0;
+static uint trip_pin_base = 0;          //1st leg pin
+
+/**
+ * @brief Arms the fast trip. From now on a fault stops the switching without CPU help.
+ *
+ * At the fault the fault_trip SM pushes a word. Its DREQ starts a DMA channel which takes it and chains to
+ * the ctrl channel. The ctrl channel loads the blocks of trip_list into a data channel, one by one:
+ * - Sets the output override of all the leg pins at once. (one burst into the SET alias of the GPIO registers)
+ *   The pads then keep both the switches of each leg OFF, whatever the SMs drive. (the dead time state 0b00)
+ * - Aborts all the DMA channels playing the tables, so nothing more is pulled by the SMs.
+ * - Null block (CTRL = 0), which ends the list.
+ * All the trip channels are high priority. The pins are OFF about 20 sys clk after the fault reaches the
+ * pad (2 sys clk of input synchroniser, 2 of the SM & the DMA chain).
+ *
+ * @param pio   PIO running the fault_trip program. (see fault_trip_program_init())
+ * @param sm    State machine of FAULT_IN. It is enabled by this call.
+ * @param p_leg_pins    First of the 2 consecutive pins (HIGH & LOW side) of each leg.
+ * @param legs  Number of legs.
+ * @param dma_mask  DMA channels to be aborted at the trip. (see spwm_swap_dma_mask())
+ *
+ * @returns false if the leg pins span more than SPWM_TRIP_PINS_MAX GPIO.
+ *
+ * @note The trip is latched till reboot. Arm it before the leg SMs are started.
+ */
+bool spwm_trip_arm(PIO pio, uint sm, const uint* p_leg_pins, uint8_t legs, uint32_t dma_mask){
+    uint pin_first = p_leg_pins[0];
+    uint pin_last = p_leg_pins[0] + 1;
+    for(uint8_t leg = 0; leg < legs; leg++){
+        if(p_leg_pins[leg] < pin_first){
+            pin_first = p_leg_pins[leg];
+        }
+        if((p_leg_pins[leg] + 1) > pin_last){
+            pin_last = p_leg_pins[leg] + 1;
+        }
+    }
+    uint pin_count = pin_last - pin_first + 1;
+    if(pin_count > SPWM_TRIP_PINS_MAX){
+        return false;
+    }
+
+    for(uint i = 0; i < (2 * SPWM_TRIP_PINS_MAX); i++){
+        trip_pin_word[i] = 0;
+    }
+    for(uint8_t leg = 0; leg < legs; leg++){
+        uint i = p_leg_pins[leg] - pin_first;
+        trip_pin_word[(2 * i) + 1] = SPWM_TRIP_OUTOVER_OFF_BITS;          //HIGH side
+        trip_pin_word[(2 * (i + 1)) + 1] = SPWM_TRIP_OUTOVER_OFF_BITS;    //LOW side
+    }
+    trip_abort_mask = dma_mask;
+    trip_pio = pio;
+    trip_sm = sm;
+    trip_pin_base = pin_first;
+
+    int kick_ch = dma_claim_unused_channel(true);
+    int ctrl_ch = dma_claim_unused_channel(true);
+    int data_ch = dma_claim_unused_channel(true);
+
+    //Blocks of the data channel: unpaced, chained back to the ctrl channel for the next block
+    dma_channel_config pins_cfg = dma_channel_get_default_config(data_ch);
+    channel_config_set_transfer_data_size(&pins_cfg, DMA_SIZE_32);
+    channel_config_set_read_increment(&pins_cfg, true);
+    channel_config_set_write_increment(&pins_cfg, true);
+    channel_config_set_high_priority(&pins_cfg, true);
+    channel_config_set_chain_to(&pins_cfg, ctrl_ch);
+
+    dma_channel_config abort_cfg = pins_cfg;
+    channel_config_set_read_increment(&abort_cfg, false);
+    channel_config_set_write_increment(&abort_cfg, false);
+
+    trip_list[0] = (trip_block_t){(uint32_t)trip_pin_word, (uint32_t)hw_set_alias_untyped(&io_bank0_hw->io[pin_first].status),
+                                2 * pin_count, channel_config_get_ctrl_value(&pins_cfg)};
+    trip_list[1] = (trip_block_t){(uint32_t)&trip_abort_mask, (uint32_t)&dma_hw->abort, 1,
+                                channel_config_get_ctrl_value(&abort_cfg)};
+    trip_list[2] = (trip_block_t){0, 0, 0, 0};
+
+    //Ctrl channel: one block (4 words) into the alias 0 registers of data channel on each trigger
+    dma_channel_config ctrl_cfg = dma_channel_get_default_config(ctrl_ch);
+    channel_config_set_transfer_data_size(&ctrl_cfg, DMA_SIZE_32);
+    channel_config_set_read_increment(&ctrl_cfg, true);
+    channel_config_set_write_increment(&ctrl_cfg, true);
+    channel_config_set_ring(&ctrl_cfg, true, 4);                  //Wrap-up within the 4 registers of alias 0
+    channel_config_set_high_priority(&ctrl_cfg, true);
+
+    dma_channel_configure(
+        ctrl_ch,
+        &ctrl_cfg,
+        &dma_hw->ch[data_ch].read_addr,         // Write address (alias 0 registers of data channel)
+        trip_list,                              // Read address (1st block of the list)
+        4,                                      // One block. Reloaded on every trigger.
+        false                                   // Started by the kick channel.
+    );
+
+    //Kick channel: takes the word of fault_trip SM, then starts the list
+    dma_channel_config kick_cfg = dma_channel_get_default_config(kick_ch);
+    channel_config_set_transfer_data_size(&kick_cfg, DMA_SIZE_32);
+    channel_config_set_read_increment(&kick_cfg, false);
+    channel_config_set_write_increment(&kick_cfg, false);
+    channel_config_set_dreq(&kick_cfg, pio_get_dreq(pio, sm, false));
+    channel_config_set_high_priority(&kick_cfg, true);
+    channel_config_set_chain_to(&kick_cfg, ctrl_ch);
+
+    dma_channel_configure(
+        kick_ch,
+        &kick_cfg,
+        &trip_rx_word,                          // Write address (not used)
+        &pio->rxf[sm],                          // Read address (RX FIFO of fault_trip SM)
+        1,                                      // Only one trip
+        true                                    // Start immediately. (waits for the fault)
+    );
+
+    pio_sm_clear_fifos(pio, sm);
+    pio_sm_set_enabled(pio, sm, true);
+    return true;
+}
+
+/**
+ * @brief Trips from software (e.g. a limit checked by the control loop), through the same DMA path as a fault.
+ */
+void spwm_trip_now(void){
+    if(trip_pio != NULL){
+        pio_sm_exec(trip_pio, trip_sm, pio_encode_push(false, false));
+    }
+}
+
+/**
+ * @brief Checks if the trip has forced the leg pins OFF.
+ */
+bool spwm_trip_tripped(void){
+    if(trip_pio == NULL){
+        return false;
+    }
+    return ((io_bank0_hw->io[trip_pin_base].ctrl & SPWM_TRIP_OUTOVER_OFF_BITS) != 0);
+}
@@ -0,0 +1,22 @@
+#ifndef SPWM_TRIP
+    #define SPWM_TRIP
+
+    #include "pico/stdlib.h"
+    #include "hardware/dma.h"
+    #include "hardware/pio.h"
+    #include "hardware/structs/io_bank0.h"
+
+    //Max number of GPIO from the 1st to the last leg pin. (GP14 to GP20 in the 3 phase build)
+    #define SPWM_TRIP_PINS_MAX 8
+
+    //Blocks of the trip DMA list : leg pins OFF, abort of table DMA & a null block which ends the list
+    #define SPWM_TRIP_BLOCKS 3
+
+    //Set (atomic alias) into GPIO CTRL of each leg pin at a trip. It makes OUTOVER = LOW from NORMAL and
+    //HIGH from INVERT (GATE_ACTIVE_LOW), i.e. the switch is OFF in both cases.
+    #define SPWM_TRIP_OUTOVER_OFF_BITS (GPIO_OVERRIDE_LOW << IO_BANK0_GPIO0_CTRL_OUTOVER_LSB)
+
+    bool spwm_trip_arm(PIO pio, uint sm, const uint* p_leg_pins, uint8_t legs, uint32_t dma_mask);
+    void spwm_trip_now(void);
+    bool spwm_trip_tripped(void);
+#endif